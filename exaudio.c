@@ -1,27 +1,61 @@
+#ifdef __linux__
+#define _GNU_SOURCE // O_DIRECT and fallocate
+#endif
+
+// the SIMD kernels only make the same bits as their C references if the
+// compiler fuses nothing into an fma behind their backs. clang takes the
+// pragma, gcc ignores it and gets -ffp-contract=off from the Makefile
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif
+
 #include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 #define FD_PRINTF_MAX (1024)
 
-static char _fd_printf_buf[FD_PRINTF_MAX];
-
+// the loader workers and the disk thread log too, so each call formats
+// into a buffer of its own
 int fd_printf(int fd, const char * fmt, ...) {
+  char buf[FD_PRINTF_MAX];
   int n;
   va_list ap;
   va_start (ap, fmt);
-  n = vsnprintf (_fd_printf_buf, FD_PRINTF_MAX, fmt, ap);
+  n = vsnprintf (buf, FD_PRINTF_MAX, fmt, ap);
   va_end (ap);
-  write (fd, _fd_printf_buf, n);
+  if (n < 0) return n;
+  if (n >= FD_PRINTF_MAX) n = FD_PRINTF_MAX - 1;
+  write (fd, buf, n);
   return n;
 }
 
+// strerror off the main thread, into the caller's buffer
+static const char *exa_strerror(int err, char *buf, size_t size) {
+#ifdef __GLIBC__
+  return strerror_r(err, buf, size); // the GNU one, see _GNU_SOURCE
+#else
+  strerror_r(err, buf, size);
+  return buf;
+#endif
+}
+
 #define EXA_LOG_ALL (0)
 #define EXA_LOG_FATAL (1)
 #define EXA_LOG_ERROR (2)
@@ -92,6 +126,7 @@ enum {
 struct exa_tuple {
   uint8_t type;
   int32_t val;
+  int32_t arg; // third element when it is a number
   char key[KEY_STORE];
   uint8_t count;
   uint8_t *blob;
@@ -112,8 +147,10 @@ void exa_dump(struct exa_tuple *tuple) {
       break;
     case exa_int:
       LOG(",%d", tuple->val);
+      if (tuple->count > 2) LOG(",%d", tuple->arg);
       break;
     case exa_list:
+      if (tuple->count > 2) LOG(",%d", tuple->val);
       LOG(",[");
       for (int i=0; i<tuple->len; i++) {
         LOG("%s%d", s, tuple->list[i]);
@@ -122,6 +159,7 @@ void exa_dump(struct exa_tuple *tuple) {
       LOG("]");
       break;
     case exa_binary:
+      if (tuple->count > 2) LOG(",%d", tuple->val);
       LOG(",\"%s\"", tuple->blob);
       break;
     default:
@@ -252,10 +290,77 @@ int free_list_fail(struct exa_tuple *tuple, int r) {
 
 enum {
   write_okay = 100,
+  write_error,
+  write_no_memory,
 } write_errors;
 
+static uint8_t *put_b4(uint8_t *p, uint32_t n) {
+  *p++ = n >> 24; *p++ = n >> 16; *p++ = n >> 8; *p++ = n;
+  return p;
+}
+
+// the reverse of exa_parse, {"key"} {"key", val} {"key", val, arg}
+// {"key", [list]} {"key", "blob"} and the same with val in the middle.
+// the whole term goes out in one write so replies don't interleave.
 int exa_send(int fd, struct exa_tuple *tuple) {
-  return write_okay;
+  if (!tuple) return -write_error;
+  size_t keylen = strlen(tuple->key);
+  size_t size = 3 + 5 + keylen + 5 + 5;
+  if (tuple->type == exa_list) size += 5 + tuple->len * 5 + 1;
+  if (tuple->type == exa_binary) size += 5 + tuple->len;
+  uint8_t *term = malloc(size);
+  if (!term) return -write_no_memory;
+  uint8_t *p = term;
+  *p++ = ETF_MAGIC;
+  *p++ = SMALL_TUPLE_EXT;
+  *p++ = tuple->count;
+  if (tuple->count > 0) {
+    *p++ = BINARY_EXT;
+    p = put_b4(p, keylen);
+    memcpy(p, tuple->key, keylen);
+    p += keylen;
+  }
+  if (tuple->count > 2) {
+    *p++ = INTEGER_EXT;
+    p = put_b4(p, tuple->val);
+  }
+  if (tuple->count > 1) {
+    switch (tuple->type) {
+      case exa_int:
+        *p++ = INTEGER_EXT;
+        p = put_b4(p, tuple->count > 2 ? tuple->arg : tuple->val);
+        break;
+      case exa_list:
+        *p++ = LIST_EXT;
+        p = put_b4(p, tuple->len);
+        for (int i=0; i<tuple->len; i++) {
+          *p++ = INTEGER_EXT;
+          p = put_b4(p, tuple->list[i]);
+        }
+        *p++ = NIL_EXT;
+        break;
+      case exa_binary:
+        *p++ = BINARY_EXT;
+        p = put_b4(p, tuple->len);
+        memcpy(p, tuple->blob, tuple->len);
+        p += tuple->len;
+        break;
+      default:
+        *p++ = NIL_EXT;
+        break;
+    }
+  }
+  size_t len = p - term;
+  int r = write(fd, term, len) == len ? write_okay : -write_error;
+  free(term);
+  return r;
+}
+
+// events are {"key", id, number}
+int exa_event(int fd, char *key, int32_t id, int32_t value) {
+  struct exa_tuple event = {.type = exa_int, .val = id, .arg = value, .count = 3};
+  snprintf(event.key, KEY_STORE, "%s", key);
+  return exa_send(fd, &event);
 }
 
 /*
@@ -267,6 +372,7 @@ int exa_send(int fd, struct exa_tuple *tuple) {
   {"key", number, []}
   {"key", number, [0,1,2]}
   {"key", number, [-1,1024]}
+  {"key", number, "binary"}
 
   examples
   {"capture"}
@@ -276,8 +382,11 @@ int exa_send(int fd, struct exa_tuple *tuple) {
   {"play", devid, bufid}
   {"store", bufid, [0,1,2]}
   {"store", bufid, [-1000,1000]}
+  {"stream", devid, "path"}
 */
 
+int exa_parse_term(int fd, struct exa_tuple *tuple, int32_t *val);
+
 int exa_parse(int fd, struct exa_tuple *tuple) {
   LOG("exa_parse"CR);
   if (fd < 0) return -read_fd_negative;
@@ -307,11 +416,10 @@ int exa_parse(int fd, struct exa_tuple *tuple) {
   if (one != SMALL_TUPLE_EXT) return -read_not_tuple;
   // get tuple len
   if ((n = readb1(fd, &one)) <= 0) return n;
-  if (one > 2) return -read_bad_tuple_len;
+  if (one > 3) return -read_bad_tuple_len;
   tuple->count = one;
   LOG("tuple->count = %d"CR, tuple->count);
   if (tuple->count == 0) return read_okay;
-  if (one > 2) return -read_bad_tuple_len;
   // match bin
   if ((n = readb1(fd, &one)) <= 0) return n;
   if (one != BINARY_EXT) return -read_bad_ext;
@@ -327,6 +435,22 @@ int exa_parse(int fd, struct exa_tuple *tuple) {
 
   if (tuple->count == 1) return read_okay;
 
+  if (tuple->count == 2) return exa_parse_term(fd, tuple, &tuple->val);
+
+  // three elements means the middle one has to be a number
+  // and the last one is parsed like the second one of a pair
+  if ((n = exa_parse_term(fd, tuple, &tuple->val)) != read_okay) return n;
+  if (tuple->type != exa_int) return -read_bad_ext;
+  return exa_parse_term(fd, tuple, &tuple->arg);
+}
+
+int exa_parse_term(int fd, struct exa_tuple *tuple, int32_t *val) {
+  uint8_t one;
+  uint32_t four;
+  uint16_t two;
+  uint32_t len;
+  int n;
+
   // next we look for...
   //
   // NIL_EXT = no list follows
@@ -345,12 +469,12 @@ int exa_parse(int fd, struct exa_tuple *tuple) {
     case SMALL_INTEGER_EXT:
       if ((n = readb1(fd, &one)) <= 0) return n;
       tuple->type = exa_int;
-      tuple->val = one;
+      *val = one;
       return read_okay;
     case INTEGER_EXT:
       if ((n = readb4(fd, &four)) <= 0) return n;
       tuple->type = exa_int;
-      tuple->val = four;
+      *val = four;
       return read_okay;
     case BINARY_EXT:
       if ((n = readb4(fd, &four)) <= 0) return n;
@@ -463,8 +587,6 @@ void cleaner(void) {
 
 // MA stuff
 
-#define MA_NO_FLAC
-#define MA_NO_MP3
 #define MA_NO_RESOURCE_MANAGER
 #define MA_NO_NODE_GRAPH
 #define MA_NO_ENGINE
@@ -477,7 +599,7 @@ void cleaner(void) {
 
 #define SAMPLERATE (44100)
 #define CHANNELS (1)
-#define FORMAT ma_format_s16
+#define FORMAT ma_format_s16 // only the device edge, inside everything is f32
 
 #define USE_PERIOD_IN_FRAMES
 
@@ -487,6 +609,368 @@ void cleaner(void) {
 #define PERIOD_IN_MS (10) // I have not played with this yet
 #endif
 
+// -----------------------------------------------------------
+
+// format conversion at the device edge
+//
+// inside exaudio everything is a mono f32 bus. data_cb renders each
+// period into the device's mix buffer and converts it once on the
+// way out (or once on the way in for capture), whatever format the
+// device was opened with. the s16 kernels do the clamp, the optional
+// TPDF dither and the interleave to the device's channel count in one
+// pass. they are picked at startup: AVX2 or SSE2 on x86, NEON on
+// aarch64, plain C everywhere else.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EXA_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define EXA_NEON
+#endif
+
+#define MIX_FRAMES (4096) // data_cb works through a period in chunks of this
+#define DITHER_LANES (8)
+#define S16_SCALE (32767.0f)
+#define RNG_SCALE (1.0f / 16777216.0f) // top 24 bits of a uint32 to [0,1)
+
+// xorshift32, one state per SIMD lane
+static inline uint32_t xorshift32(uint32_t x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+// triangular noise in (-1,1) LSB from two uniform draws
+static inline float tpdf_c(uint32_t *rng) {
+  uint32_t a = xorshift32(*rng);
+  uint32_t b = xorshift32(a);
+  *rng = b;
+  return ((float)(a >> 8) - (float)(b >> 8)) * RNG_SCALE;
+}
+
+static inline int16_t f32_to_s16_c(float f, uint32_t *rng) {
+  f *= S16_SCALE;
+  if (rng) f += tpdf_c(rng);
+  if (f > S16_SCALE) f = S16_SCALE;
+  if (f < -S16_SCALE) f = -S16_SCALE;
+  return (int16_t)lrintf(f);
+}
+
+// rng is NULL for no dither, otherwise DITHER_LANES states
+typedef void (*edge_out_s16_fn)(int16_t *dst, const float *src, int frames, int channels, uint32_t *rng);
+typedef void (*edge_in_s16_fn)(float *dst, const int16_t *src, int frames, int channels);
+
+// frame i dithers from lane i % DITHER_LANES, as the SIMD kernels do,
+// so a dithered period comes out the same bits whichever kernel runs
+static void edge_out_s16_c(int16_t *dst, const float *src, int frames, int channels, uint32_t *rng) {
+  for (int i=0; i<frames; i++) {
+    int16_t v = f32_to_s16_c(src[i], rng ? &rng[i % DITHER_LANES] : NULL);
+    for (int c=0; c<channels; c++) *dst++ = v;
+  }
+}
+
+static void edge_in_s16_c(float *dst, const int16_t *src, int frames, int channels) {
+  float scale = 1.0f / (32768.0f * channels);
+  for (int i=0; i<frames; i++) {
+    int32_t acc = 0;
+    for (int c=0; c<channels; c++) acc += *src++;
+    dst[i] = acc * scale;
+  }
+}
+
+#ifdef EXA_X86
+
+static inline __m128i xorshift_sse2(__m128i x) {
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+  x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+  return x;
+}
+
+static inline __m128 tpdf_sse2(__m128i *state) {
+  __m128i a = xorshift_sse2(*state);
+  __m128i b = xorshift_sse2(a);
+  *state = b;
+  __m128 fa = _mm_cvtepi32_ps(_mm_srli_epi32(a, 8));
+  __m128 fb = _mm_cvtepi32_ps(_mm_srli_epi32(b, 8));
+  return _mm_mul_ps(_mm_sub_ps(fa, fb), _mm_set1_ps(RNG_SCALE));
+}
+
+static inline __m128i f32_to_s32_sse2(__m128 f, __m128i *state) {
+  f = _mm_mul_ps(f, _mm_set1_ps(S16_SCALE));
+  if (state) f = _mm_add_ps(f, tpdf_sse2(state));
+  f = _mm_min_ps(f, _mm_set1_ps(S16_SCALE));
+  f = _mm_max_ps(f, _mm_set1_ps(-S16_SCALE));
+  return _mm_cvtps_epi32(f);
+}
+
+static void edge_out_s16_sse2(int16_t *dst, const float *src, int frames, int channels, uint32_t *rng) {
+  if (channels > 2) {
+    edge_out_s16_c(dst, src, frames, channels, rng);
+    return;
+  }
+  __m128i state0, state1, *s0 = NULL, *s1 = NULL;
+  if (rng) {
+    state0 = _mm_loadu_si128((__m128i *)&rng[0]);
+    state1 = _mm_loadu_si128((__m128i *)&rng[4]);
+    s0 = &state0;
+    s1 = &state1;
+  }
+  int i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i a = f32_to_s32_sse2(_mm_loadu_ps(&src[i]), s0);
+    __m128i b = f32_to_s32_sse2(_mm_loadu_ps(&src[i + 4]), s1);
+    __m128i v = _mm_packs_epi32(a, b);
+    if (channels == 1) {
+      _mm_storeu_si128((__m128i *)&dst[i], v);
+    } else {
+      _mm_storeu_si128((__m128i *)&dst[i * 2], _mm_unpacklo_epi16(v, v));
+      _mm_storeu_si128((__m128i *)&dst[i * 2 + 8], _mm_unpackhi_epi16(v, v));
+    }
+  }
+  if (rng) {
+    _mm_storeu_si128((__m128i *)&rng[0], state0);
+    _mm_storeu_si128((__m128i *)&rng[4], state1);
+  }
+  edge_out_s16_c(&dst[i * channels], &src[i], frames - i, channels, rng);
+}
+
+static void edge_in_s16_sse2(float *dst, const int16_t *src, int frames, int channels) {
+  if (channels != 1) {
+    edge_in_s16_c(dst, src, frames, channels);
+    return;
+  }
+  __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  int i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+    // sign extend by putting each sample in the top half and shifting down
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(&dst[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  edge_in_s16_c(&dst[i], &src[i], frames - i, 1);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i xorshift_avx2(__m256i x) {
+  x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+  x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+  return x;
+}
+
+AVX2 static inline __m256i f32_to_s32_avx2(__m256 f, __m256i *state) {
+  f = _mm256_mul_ps(f, _mm256_set1_ps(S16_SCALE));
+  if (state) {
+    __m256i a = xorshift_avx2(*state);
+    __m256i b = xorshift_avx2(a);
+    *state = b;
+    __m256 fa = _mm256_cvtepi32_ps(_mm256_srli_epi32(a, 8));
+    __m256 fb = _mm256_cvtepi32_ps(_mm256_srli_epi32(b, 8));
+    f = _mm256_add_ps(f, _mm256_mul_ps(_mm256_sub_ps(fa, fb), _mm256_set1_ps(RNG_SCALE)));
+  }
+  f = _mm256_min_ps(f, _mm256_set1_ps(S16_SCALE));
+  f = _mm256_max_ps(f, _mm256_set1_ps(-S16_SCALE));
+  return _mm256_cvtps_epi32(f);
+}
+
+AVX2 static void edge_out_s16_avx2(int16_t *dst, const float *src, int frames, int channels, uint32_t *rng) {
+  if (channels > 2) {
+    edge_out_s16_c(dst, src, frames, channels, rng);
+    return;
+  }
+  __m256i state, *s = NULL;
+  if (rng) {
+    state = _mm256_loadu_si256((__m256i *)rng);
+    s = &state;
+  }
+  int i = 0;
+  for (; i + 16 <= frames; i += 16) {
+    __m256i a = f32_to_s32_avx2(_mm256_loadu_ps(&src[i]), s);
+    __m256i b = f32_to_s32_avx2(_mm256_loadu_ps(&src[i + 8]), s);
+    // packs works inside each 128 bit lane, put the quads back in order
+    __m256i v = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+    if (channels == 1) {
+      _mm256_storeu_si256((__m256i *)&dst[i], v);
+    } else {
+      __m256i lo = _mm256_unpacklo_epi16(v, v);
+      __m256i hi = _mm256_unpackhi_epi16(v, v);
+      _mm256_storeu_si256((__m256i *)&dst[i * 2], _mm256_permute2x128_si256(lo, hi, 0x20));
+      _mm256_storeu_si256((__m256i *)&dst[i * 2 + 16], _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+  }
+  if (rng) _mm256_storeu_si256((__m256i *)rng, state);
+  edge_out_s16_c(&dst[i * channels], &src[i], frames - i, channels, rng);
+}
+
+AVX2 static void edge_in_s16_avx2(float *dst, const int16_t *src, int frames, int channels) {
+  if (channels != 1) {
+    edge_in_s16_c(dst, src, frames, channels);
+    return;
+  }
+  __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+  int i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)&src[i]));
+    _mm256_storeu_ps(&dst[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  edge_in_s16_c(&dst[i], &src[i], frames - i, 1);
+}
+
+#endif // EXA_X86
+
+#ifdef EXA_NEON
+
+static inline uint32x4_t xorshift_neon(uint32x4_t x) {
+  x = veorq_u32(x, vshlq_n_u32(x, 13));
+  x = veorq_u32(x, vshrq_n_u32(x, 17));
+  x = veorq_u32(x, vshlq_n_u32(x, 5));
+  return x;
+}
+
+static inline int32x4_t f32_to_s32_neon(float32x4_t f, uint32x4_t *state) {
+  f = vmulq_n_f32(f, S16_SCALE);
+  if (state) {
+    uint32x4_t a = xorshift_neon(*state);
+    uint32x4_t b = xorshift_neon(a);
+    *state = b;
+    float32x4_t d = vsubq_f32(vcvtq_f32_u32(vshrq_n_u32(a, 8)), vcvtq_f32_u32(vshrq_n_u32(b, 8)));
+    f = vmlaq_n_f32(f, d, RNG_SCALE);
+  }
+  f = vminq_f32(f, vdupq_n_f32(S16_SCALE));
+  f = vmaxq_f32(f, vdupq_n_f32(-S16_SCALE));
+  return vcvtnq_s32_f32(f);
+}
+
+static void edge_out_s16_neon(int16_t *dst, const float *src, int frames, int channels, uint32_t *rng) {
+  if (channels > 2) {
+    edge_out_s16_c(dst, src, frames, channels, rng);
+    return;
+  }
+  uint32x4_t state0, state1, *s0 = NULL, *s1 = NULL;
+  if (rng) {
+    state0 = vld1q_u32(&rng[0]);
+    state1 = vld1q_u32(&rng[4]);
+    s0 = &state0;
+    s1 = &state1;
+  }
+  int i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    int32x4_t a = f32_to_s32_neon(vld1q_f32(&src[i]), s0);
+    int32x4_t b = f32_to_s32_neon(vld1q_f32(&src[i + 4]), s1);
+    int16x8_t v = vcombine_s16(vqmovn_s32(a), vqmovn_s32(b));
+    if (channels == 1) {
+      vst1q_s16(&dst[i], v);
+    } else {
+      int16x8x2_t lr = {{v, v}};
+      vst2q_s16(&dst[i * 2], lr);
+    }
+  }
+  if (rng) {
+    vst1q_u32(&rng[0], state0);
+    vst1q_u32(&rng[4], state1);
+  }
+  edge_out_s16_c(&dst[i * channels], &src[i], frames - i, channels, rng);
+}
+
+static void edge_in_s16_neon(float *dst, const int16_t *src, int frames, int channels) {
+  if (channels != 1) {
+    edge_in_s16_c(dst, src, frames, channels);
+    return;
+  }
+  int i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    int16x8_t v = vld1q_s16(&src[i]);
+    vst1q_f32(&dst[i], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / 32768.0f));
+    vst1q_f32(&dst[i + 4], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), 1.0f / 32768.0f));
+  }
+  edge_in_s16_c(&dst[i], &src[i], frames - i, 1);
+}
+
+#endif // EXA_NEON
+
+static edge_out_s16_fn edge_out_s16 = edge_out_s16_c;
+static edge_in_s16_fn edge_in_s16 = edge_in_s16_c;
+static char *edge_kernels = "c";
+
+void edge_init(void) {
+  #ifdef EXA_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    edge_out_s16 = edge_out_s16_avx2;
+    edge_in_s16 = edge_in_s16_avx2;
+    edge_kernels = "avx2";
+  } else if (__builtin_cpu_supports("sse2")) {
+    edge_out_s16 = edge_out_s16_sse2;
+    edge_in_s16 = edge_in_s16_sse2;
+    edge_kernels = "sse2";
+  }
+  #endif
+  #ifdef EXA_NEON
+  edge_out_s16 = edge_out_s16_neon;
+  edge_in_s16 = edge_in_s16_neon;
+  edge_kernels = "neon";
+  #endif
+  LOG("edge kernels:%s"CR, edge_kernels);
+}
+
+void edge_out_f32(float *dst, const float *src, int frames, int channels) {
+  if (channels == 1) {
+    memcpy(dst, src, frames * sizeof(float));
+    return;
+  }
+  for (int i=0; i<frames; i++) {
+    for (int c=0; c<channels; c++) *dst++ = src[i];
+  }
+}
+
+void edge_in_f32(float *dst, const float *src, int frames, int channels) {
+  if (channels == 1) {
+    memcpy(dst, src, frames * sizeof(float));
+    return;
+  }
+  float scale = 1.0f / channels;
+  for (int i=0; i<frames; i++) {
+    float acc = 0;
+    for (int c=0; c<channels; c++) acc += *src++;
+    dst[i] = acc * scale;
+  }
+}
+
+// mono bus -> device, rng is NULL for no dither
+// returns -1 for a format we don't convert
+int edge_out(void *dst, ma_format format, const float *src, int frames, int channels, uint32_t *rng) {
+  switch (format) {
+    case ma_format_s16:
+      edge_out_s16((int16_t *)dst, src, frames, channels, rng);
+      return 0;
+    case ma_format_f32:
+      edge_out_f32((float *)dst, src, frames, channels);
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+// device -> mono bus
+int edge_in(float *dst, ma_format format, const void *src, int frames, int channels) {
+  switch (format) {
+    case ma_format_s16:
+      edge_in_s16(dst, (const int16_t *)src, frames, channels);
+      return 0;
+    case ma_format_f32:
+      edge_in_f32(dst, (const float *)src, frames, channels);
+      return 0;
+    default:
+      return -1;
+  }
+}
+
 // basic attempt to get a 12-bit value from a device name
 // to use as a semi-predictable ID that is
 // or-ed with 0x1000 for playback or 0x2000 for capture
@@ -551,121 +1035,802 @@ enum {
   audio_state_done,
 };
 
-struct s_audio {
-  uint32_t len; // allocated size
-  int16_t *buffer;
-};
+// -----------------------------------------------------------
 
-int16_t capture_buffer_1[SAMPLERATE * CHANNELS];
-uint32_t capture_len_1 = SAMPLERATE;
-int16_t playback_buffer_1[SAMPLERATE * CHANNELS];
-uint32_t playback_len_1 = SAMPLERATE;
+// sample memory
+//
+// every sample buffer (bank, cache variants, the device buffers) comes
+// from this pool. memory is mapped in 2 MiB aligned regions so that it
+// can be backed by hugepages: with hundreds of megabytes of samples
+// read at random by many voices the callback otherwise spends a lot of
+// its time on TLB misses. a region is either a slab of equal sized
+// power of two blocks (4 KiB up to 1 MiB) or, for anything bigger, a
+// single allocation of its own.
+//
+// pool_normal maps plain pages, pool_thp asks for transparent
+// hugepages with madvise, pool_hugetlb maps MAP_HUGETLB pages from the
+// reserved pool (vm.nr_hugepages) and falls back to thp when there are
+// none. the mode applies to regions mapped after it is set.
+//
+// the loader workers allocate too, so everything happens under a lock.
+// the callback never allocates or frees.
 
-struct s_audio playback_audio = {.len = SAMPLERATE, .buffer = capture_buffer_1};
-struct s_audio capture_audio = {.len = SAMPLERATE, .buffer = playback_buffer_1};
-struct s_audio capture_audio;
+#define POOL_REGION (2u << 20)
+#define POOL_MIN_SHIFT (12)
+#define POOL_MAX_SHIFT (20)
+#define POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
 
-static struct s_device {
-  int ctxid;
-  int type; // distinguish between capture/playback
-  char assigned;
-  ma_device dev;
-  ma_device_config cfg;
-  //
-  char attached;
-  char visited;
-  uint64_t data_cb_count;
-  int id;
-  char name[DEVICE_NAME_SIZE];
-  char isDefault;
-  struct s_audio *audio;
-  uint32_t position; // position used by the callback
-  char state;
+enum {
+  pool_normal = 0,
+  pool_thp,
+  pool_hugetlb,
+};
+
+static char *pool_mode_name[] = {"normal", "thp", "hugetlb"};
+
+struct s_region {
+  uintptr_t base; // 2 MiB aligned, the key
+  size_t bytes;
+  int shift; // block size of a slab, 0 for a single allocation
+  int backing; // pool_normal, pool_thp or pool_hugetlb
   UT_hash_handle hh;
-} *devices = NULL;
+};
 
-void devinfo(void) {
-  struct s_device *dev;
-  for (dev = devices; dev != NULL; dev = dev->hh.next) {
-    char *type = ":capture";
-    if (dev->id & TYPE_PLAYBACK) type = ":playback";
-    char *attached = ":detached";
-    if (dev->attached) attached = ":attached";
-    char *isdefault = "";
-    if (dev->isDefault) isdefault = ":default";
-    char *assigned = "";
-    if (dev->assigned) assigned = ":assigned";
-    char audio_info[1024] = "";
-    if (dev->audio) {
-      sprintf(audio_info, "{%d %d %d}", dev->audio->len, dev->position, dev->state);
+static struct {
+  pthread_mutex_t lock;
+  int mode;
+  struct s_region *regions;
+  void *free_blocks[POOL_CLASSES]; // each free block points to the next
+  uint64_t mapped;
+  uint64_t in_use;
+  uint64_t backed[3]; // bytes mapped per backing
+  uint64_t fallbacks; // hugetlb asked for but not there
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .mode = pool_normal};
+
+static size_t pool_round(size_t bytes) {
+  return (bytes + POOL_REGION - 1) & ~(size_t)(POOL_REGION - 1);
+}
+
+// a 2 MiB aligned mapping of bytes (a multiple of POOL_REGION)
+static void *pool_map(size_t bytes, int *backing) {
+  void *p;
+#ifdef MAP_HUGETLB
+  if (pool.mode == pool_hugetlb) {
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      *backing = pool_hugetlb;
+      return p;
     }
-    LOG("dev:%p id:%d name:<<%s>> [%s %s %s %s] ctx:%d cb:%d %s"CR,
-      dev, dev->id, dev->name,
-      type, attached, isdefault, assigned,
-      dev->ctxid,
-      dev->data_cb_count,
-      audio_info);
+    pool.fallbacks++;
+  }
+#endif
+  // map a region more than needed and trim it to the alignment
+  p = mmap(NULL, bytes + POOL_REGION, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return NULL;
+  uintptr_t start = (uintptr_t)p;
+  uintptr_t aligned = (start + POOL_REGION - 1) & ~(uintptr_t)(POOL_REGION - 1);
+  if (aligned > start) munmap(p, aligned - start);
+  if (aligned + bytes < start + bytes + POOL_REGION) {
+    munmap((void *)(aligned + bytes), start + POOL_REGION - aligned);
+  }
+  *backing = pool_normal;
+#ifdef MADV_HUGEPAGE
+  if (pool.mode != pool_normal && madvise((void *)aligned, bytes, MADV_HUGEPAGE) == 0) {
+    *backing = pool_thp;
   }
+#endif
+  return (void *)aligned;
 }
 
-struct s_device *find_device(int id) {
-  struct s_device *dev;
-  HASH_FIND_INT(devices, &id, dev);
-  return dev;
+static struct s_region *pool_region(size_t bytes, int shift) {
+  int backing;
+  void *p = pool_map(bytes, &backing);
+  if (!p) return NULL;
+  struct s_region *r = malloc(sizeof *r);
+  if (!r) {
+    munmap(p, bytes);
+    return NULL;
+  }
+  r->base = (uintptr_t)p;
+  r->bytes = bytes;
+  r->shift = shift;
+  r->backing = backing;
+  HASH_ADD(hh, pool.regions, base, sizeof(uintptr_t), r);
+  pool.mapped += bytes;
+  pool.backed[backing] += bytes;
+  return r;
 }
 
-#define EXA_INFO_PLAYBACK (0)
-#define EXA_INFO_CAPTURE (1)
-#define EXA_INFO_COUNT (2)
+void *pool_alloc(size_t bytes) {
+  void *p = NULL;
+  pthread_mutex_lock(&pool.lock);
+  if (bytes > (1u << POOL_MAX_SHIFT)) {
+    struct s_region *r = pool_region(pool_round(bytes), 0);
+    if (r) {
+      p = (void *)r->base;
+      pool.in_use += r->bytes;
+    }
+  } else {
+    int shift = POOL_MIN_SHIFT;
+    while (((size_t)1 << shift) < bytes) shift++;
+    int c = shift - POOL_MIN_SHIFT;
+    if (!pool.free_blocks[c]) {
+      struct s_region *r = pool_region(POOL_REGION, shift);
+      if (r) {
+        // thread the new blocks onto the free list, lowest address first
+        size_t size = (size_t)1 << shift;
+        for (size_t off = POOL_REGION; off > 0; off -= size) {
+          void **block = (void **)(r->base + off - size);
+          *block = pool.free_blocks[c];
+          pool.free_blocks[c] = block;
+        }
+      }
+    }
+    if (pool.free_blocks[c]) {
+      p = pool.free_blocks[c];
+      pool.free_blocks[c] = *(void **)p;
+      pool.in_use += (size_t)1 << shift;
+    }
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return p;
+}
 
-struct {
-  ma_device_info *info;
-  ma_uint32 count;
-  int type;
-  int defaultid;
-} exa_info[EXA_INFO_COUNT];
+static struct s_region *pool_find(void *p) {
+  uintptr_t base = (uintptr_t)p & ~(uintptr_t)(POOL_REGION - 1);
+  struct s_region *r;
+  HASH_FIND(hh, pool.regions, &base, sizeof(uintptr_t), r);
+  return r;
+}
 
-void scan(void) {
-  static char first = 1;
-  if (first) {
-    exa_info[EXA_INFO_PLAYBACK].type = TYPE_PLAYBACK;
-    exa_info[EXA_INFO_CAPTURE].type = TYPE_CAPTURE;
-    first = 0;
+static size_t pool_size(struct s_region *r) {
+  return r->shift ? (size_t)1 << r->shift : r->bytes;
+}
+
+void pool_free(void *p) {
+  if (!p) return;
+  pthread_mutex_lock(&pool.lock);
+  struct s_region *r = pool_find(p);
+  if (!r) {
+    pthread_mutex_unlock(&pool.lock);
+    LOG("pool_free of %p, not ours"CR, p);
+    return;
+  }
+  pool.in_use -= pool_size(r);
+  if (r->shift) {
+    // slabs stay mapped for the next sample of that size
+    int c = r->shift - POOL_MIN_SHIFT;
+    *(void **)p = pool.free_blocks[c];
+    pool.free_blocks[c] = p;
+  } else {
+    HASH_DEL(pool.regions, r);
+    munmap(p, r->bytes);
+    pool.mapped -= r->bytes;
+    pool.backed[r->backing] -= r->bytes;
+    free(r);
   }
+  pthread_mutex_unlock(&pool.lock);
+}
 
-  ma_context *ctx = (ma_context *)malloc(sizeof(ma_context));
-  
-  LOG("=> scan"CR);
-  LOG("miniaudio version %s"CR, ma_version_string());
+// like realloc, for the decoder which doesn't know how long a file is
+void *pool_realloc(void *p, size_t bytes) {
+  if (!p) return pool_alloc(bytes);
+  pthread_mutex_lock(&pool.lock);
+  struct s_region *r = pool_find(p);
+  size_t have = r ? pool_size(r) : 0;
+  pthread_mutex_unlock(&pool.lock);
+  if (bytes <= have) return p;
+  void *q = pool_alloc(bytes);
+  if (!q) return NULL;
+  memcpy(q, p, have);
+  pool_free(p);
+  return q;
+}
 
-  LOG("=> ma_context_init"CR);
-  if (ma_context_init(NULL, 0, NULL, ctx) != MA_SUCCESS) {
-    LOG("failed to get ma_context"CR);
+void pool_set_mode(int mode) {
+  if (mode < pool_normal || mode > pool_hugetlb) {
+    LOG("pool mode is 0 (normal), 1 (thp) or 2 (hugetlb)"CR);
     return;
   }
+  pthread_mutex_lock(&pool.lock);
+  pool.mode = mode;
+  pthread_mutex_unlock(&pool.lock);
+}
 
-  int new_or_reattached_devices = 0;
-  int detached_devices = 0;
-
-  if (ma_context_get_devices(ctx,
-    &exa_info[EXA_INFO_PLAYBACK].info, &exa_info[EXA_INFO_PLAYBACK].count,
-    &exa_info[EXA_INFO_CAPTURE].info, &exa_info[EXA_INFO_CAPTURE].count) != MA_SUCCESS) {
-    LOG("failed to get I/O device list"CR);
-    goto clean;
+// unmap everything, only at exit
+void pool_release(void) {
+  struct s_region *r, *tmp;
+  HASH_ITER(hh, pool.regions, r, tmp) {
+    HASH_DEL(pool.regions, r);
+    munmap((void *)r->base, r->bytes);
+    free(r);
   }
+}
 
-  struct s_device *dev;
+// page faults and TLB misses for the whole process, the callback
+// included. the counters are opened before any device thread starts
+// and are inherited by every thread made after that.
+static int perf_fd_faults = -1;
+static int perf_fd_dtlb = -1;
+
+#ifdef __linux__
+static int perf_open(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof attr);
+  attr.size = sizeof attr;
+  attr.type = type;
+  attr.config = config;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
 
-  // clear visited flag so we can detect if a device was removed
-  for (dev = devices; dev != NULL; dev = dev->hh.next) {
-    dev->visited = 0;
+void pool_counters_open(void) {
+#ifdef __linux__
+  perf_fd_faults = perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+  perf_fd_dtlb = perf_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+}
+
+static void perf_show(char *name, int fd) {
+  uint64_t count;
+  if (fd >= 0 && read(fd, &count, sizeof count) == sizeof count) {
+    LOG("%s:%lu"CR, name, count);
+  } else {
+    LOG("%s:unavailable"CR, name);
   }
+}
 
-  // scan and update, adding as necessary
-  for (int which = 0; which < EXA_INFO_COUNT; which++) {
-    exa_info[which].defaultid = -1; // this should be filled in during the scan
-    int type = exa_info[which].type;
-    int count = exa_info[which].count;
+void pool_info(void) {
+  pthread_mutex_lock(&pool.lock);
+  LOG("pool mode:%s mapped:%lu in_use:%lu normal:%lu thp:%lu hugetlb:%lu fallbacks:%lu regions:%u"CR,
+    pool_mode_name[pool.mode], pool.mapped, pool.in_use,
+    pool.backed[pool_normal], pool.backed[pool_thp], pool.backed[pool_hugetlb],
+    pool.fallbacks, HASH_COUNT(pool.regions));
+  pthread_mutex_unlock(&pool.lock);
+#ifdef __linux__
+  // how much thp actually handed out, madvise is only a hint
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  if (f) {
+    char line[128];
+    while (fgets(line, sizeof line, f)) {
+      if (strncmp(line, "AnonHugePages:", 14) == 0) {
+        line[strcspn(line, "\n")] = '\0';
+        LOG("%s"CR, line);
+      }
+    }
+    fclose(f);
+  }
+#endif
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  LOG("minor faults:%ld major faults:%ld"CR, ru.ru_minflt, ru.ru_majflt);
+  perf_show("perf page-faults", perf_fd_faults);
+  perf_show("perf dTLB-load-misses", perf_fd_dtlb);
+}
+
+// bank samples and their cached variants are immutable once made and
+// shared by reference, see audio_ref/audio_unref. the static capture
+// and playback buffers below are the exception, they hold a reference
+// to themselves forever.
+struct s_audio {
+  uint32_t len; // allocated size
+  float *buffer; // mono, same format as the mix bus
+  uint32_t rate; // sample rate of what is in buffer
+  uint32_t id; // bank sample id, 0 for buffers that aren't in the bank
+  int refs; // only ever changed on the control thread
+  char owned; // struct came from malloc and buffer from the pool
+  char codec; // codec_f32 uses buffer, the others packed, see codec_info
+  uint8_t *packed; // CODEC_BLOCK frames per block, from the pool
+  uint32_t serial; // tells decode cursors apart from whatever reuses the address
+  uint64_t retired_at; // epoch it was retired in, see reclaim
+  struct s_audio *retired_next;
+};
+
+// buffers come from the pool at startup, see main
+struct s_audio playback_audio = {.len = SAMPLERATE, .rate = SAMPLERATE, .refs = 1};
+struct s_audio capture_audio = {.len = SAMPLERATE, .rate = SAMPLERATE, .refs = 1};
+
+// -----------------------------------------------------------
+
+// compressed samples
+//
+// a bank slot can keep its samples packed, and playback unpacks them
+// one block of CODEC_BLOCK frames at a time as the voice gets to them.
+// blocks don't depend on each other, so playback can start anywhere.
+//
+// codec_adpcm is IMA-ADPCM, 4 bits a sample plus a 4 byte header
+// holding the predictor and step index at the start of the block:
+// 7.8x smaller than f32. codec_pcm12 packs two 12 bit samples in
+// three bytes: 2.7x smaller and much closer to the original. the
+// control thread does all the encoding, see audio_pack.
+
+#define CODEC_BLOCK (256)
+
+enum {
+  codec_f32 = 0,
+  codec_adpcm,
+  codec_pcm12,
+  codec_count,
+};
+
+static const int8_t adpcm_index[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static const int16_t adpcm_step[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+  19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+  130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+  876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+  5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static inline int16_t to_s16(float x) {
+  if (x > 1.0f) x = 1.0f;
+  if (x < -1.0f) x = -1.0f;
+  return (int16_t)lrintf(x * 32767.0f);
+}
+
+// decode one nibble, updating the predictor and step index
+static inline int adpcm_step_once(int nibble, int *pred, int *index) {
+  int step = adpcm_step[*index];
+  int delta = step >> 3;
+  if (nibble & 4) delta += step;
+  if (nibble & 2) delta += step >> 1;
+  if (nibble & 1) delta += step >> 2;
+  int p = *pred + (nibble & 8 ? -delta : delta);
+  if (p > 32767) p = 32767;
+  if (p < -32768) p = -32768;
+  *pred = p;
+  int i = *index + adpcm_index[nibble];
+  *index = i < 0 ? 0 : i > 88 ? 88 : i;
+  return p;
+}
+
+// index carries the step size from one block to the next, the
+// predictor starts each block on the block's first sample
+void adpcm_encode(const float *in, int n, uint8_t *block, int *index) {
+  int pred = n ? to_s16(in[0]) : 0;
+  block[0] = pred & 0xff;
+  block[1] = (pred >> 8) & 0xff;
+  block[2] = *index;
+  block[3] = 0;
+  uint8_t *nibbles = block + 4;
+  memset(nibbles, 0, CODEC_BLOCK / 2);
+  for (int i = 0; i < n; i++) {
+    int diff = to_s16(in[i]) - pred;
+    int nibble = 0;
+    if (diff < 0) {
+      nibble = 8;
+      diff = -diff;
+    }
+    int step = adpcm_step[*index];
+    if (diff >= step) { nibble |= 4; diff -= step; }
+    if (diff >= step >> 1) { nibble |= 2; diff -= step >> 1; }
+    if (diff >= step >> 2) nibble |= 1;
+    adpcm_step_once(nibble, &pred, index);
+    nibbles[i >> 1] |= nibble << ((i & 1) * 4);
+  }
+}
+
+void adpcm_decode(const uint8_t *block, float *out) {
+  int pred = (int16_t)(block[0] | block[1] << 8);
+  int index = block[2] > 88 ? 88 : block[2];
+  const uint8_t *nibbles = block + 4;
+  for (int i = 0; i < CODEC_BLOCK; i += 2) {
+    uint8_t b = nibbles[i >> 1];
+    out[i] = adpcm_step_once(b & 15, &pred, &index) * (1.0f / 32768.0f);
+    out[i + 1] = adpcm_step_once(b >> 4, &pred, &index) * (1.0f / 32768.0f);
+  }
+}
+
+void pcm12_encode(const float *in, int n, uint8_t *block, int *index) {
+  (void)index;
+  for (int i = 0; i < CODEC_BLOCK; i += 2) {
+    int32_t a = i < n ? to_s16(in[i]) >> 4 : 0;
+    int32_t b = i + 1 < n ? to_s16(in[i + 1]) >> 4 : 0;
+    uint32_t v = (a & 0xfff) | (uint32_t)(b & 0xfff) << 12;
+    uint8_t *d = block + i / 2 * 3;
+    d[0] = v & 0xff;
+    d[1] = (v >> 8) & 0xff;
+    d[2] = (v >> 16) & 0xff;
+  }
+}
+
+void pcm12_decode(const uint8_t *block, float *out) {
+  for (int i = 0; i < CODEC_BLOCK; i += 2) {
+    const uint8_t *d = block + i / 2 * 3;
+    uint32_t v = d[0] | d[1] << 8 | (uint32_t)d[2] << 16;
+    out[i] = ((int32_t)(v << 20) >> 20) * (1.0f / 2048.0f);
+    out[i + 1] = ((int32_t)(v << 8) >> 20) * (1.0f / 2048.0f);
+  }
+}
+
+static const struct {
+  char *name;
+  int block_bytes;
+  void (*encode)(const float *in, int n, uint8_t *block, int *index);
+  void (*decode)(const uint8_t *block, float *out);
+} codec_info[codec_count] = {
+  [codec_f32] = {"f32", CODEC_BLOCK * sizeof(float), NULL, NULL},
+  [codec_adpcm] = {"adpcm", 4 + CODEC_BLOCK / 2, adpcm_encode, adpcm_decode},
+  [codec_pcm12] = {"pcm12", CODEC_BLOCK / 2 * 3, pcm12_encode, pcm12_decode},
+};
+
+// the block a voice is playing from, owned by data_cb
+struct s_unpacked {
+  uint32_t serial; // of the audio it came from, 0 for none
+  uint32_t block;
+  float out[CODEC_BLOCK];
+};
+
+static inline uint32_t codec_blocks(uint32_t len) {
+  return (len + CODEC_BLOCK - 1) / CODEC_BLOCK;
+}
+
+// bytes of sample data, whichever way it is kept
+static inline uint64_t audio_bytes(const struct s_audio *a) {
+  if (a->codec == codec_f32) return (uint64_t)a->len * sizeof(float);
+  return (uint64_t)codec_blocks(a->len) * codec_info[(int)a->codec].block_bytes;
+}
+
+static inline const float *unpack(const struct s_audio *a, struct s_unpacked *u, uint32_t block) {
+  if (u->serial != a->serial || u->block != block) {
+    codec_info[(int)a->codec].decode(a->packed + (size_t)block * codec_info[(int)a->codec].block_bytes, u->out);
+    u->serial = a->serial;
+    u->block = block;
+  }
+  return u->out;
+}
+
+// -----------------------------------------------------------
+
+// control thread -> data_cb handoff
+//
+// the main loop and the device thread share the s_device. anything the
+// callback looks at is either an atomic (state, the source pointers,
+// position) or lives in a triple buffer.
+//
+// state is the command word. the control thread only ever stores
+// idle or go, the callback moves go -> running -> done with a
+// compare-exchange so a "stop" from the control thread always wins.
+//
+// a triple buffer gives the callback a consistent snapshot of a block
+// of parameters without locks: the writer fills the back copy and
+// swaps it with the middle one, the reader swaps the middle copy into
+// front only when the writer flagged it fresh. neither side waits.
+
+#define TRIPLE_FRESH (4)
+
+struct s_triple {
+  atomic_uint mid; // index of the middle copy, | TRIPLE_FRESH after a publish
+  unsigned back; // only touched by the writer
+  unsigned front; // only touched by the reader
+};
+
+void triple_init(struct s_triple *t) {
+  t->front = 0;
+  atomic_init(&t->mid, 1);
+  t->back = 2;
+}
+
+// writer: the back copy is complete, hand it over
+// returns the index of the new back copy
+unsigned triple_publish(struct s_triple *t) {
+  unsigned prev = atomic_exchange_explicit(&t->mid, t->back | TRIPLE_FRESH, memory_order_acq_rel);
+  t->back = prev & ~TRIPLE_FRESH;
+  return t->back;
+}
+
+// reader: returns the index of the newest complete copy
+unsigned triple_acquire(struct s_triple *t) {
+  if (atomic_load_explicit(&t->mid, memory_order_relaxed) & TRIPLE_FRESH) {
+    unsigned prev = atomic_exchange_explicit(&t->mid, t->front, memory_order_acq_rel);
+    t->front = prev & ~TRIPLE_FRESH;
+  }
+  return t->front;
+}
+
+// per device parameters the callback reads once per period
+struct s_params {
+  float gain;
+  char dither; // TPDF dither when the device is s16
+  char loop; // wrap to start instead of going to done
+  uint32_t start; // first frame of the audio buffer to use
+  uint32_t end; // one past the last frame, 0 means the whole buffer
+};
+
+struct s_stream;
+struct s_record;
+struct s_synth;
+
+static struct s_device {
+  int ctxid;
+  int type; // distinguish between capture/playback
+  char assigned;
+  ma_device dev;
+  ma_device_config cfg;
+  //
+  char attached;
+  char visited;
+  uint64_t data_cb_count;
+  int id;
+  char name[DEVICE_NAME_SIZE];
+  char isDefault;
+  _Atomic(struct s_audio *) audio;
+  _Atomic(struct s_stream *) stream; // when set, playback comes from disk instead of audio
+  _Atomic(struct s_record *) record; // when set, capture goes to disk instead of audio
+  _Atomic(struct s_synth *) synth; // when set, oscillators are added to playback
+  _Atomic uint32_t position; // owned by the callback, readable by anyone
+  atomic_uint_fast64_t clock; // frames data_cb has been asked for, see "clock"
+  atomic_int state;
+  atomic_uint_fast64_t cb_seq; // odd while data_cb is running, see device_sync
+  atomic_uint_fast64_t cb_epoch; // epoch data_cb entered in, 0 when outside, see reclaim
+  struct s_params params[3]; // see struct s_triple
+  struct s_params params_edit; // control thread's copy
+  struct s_triple params_tb;
+  uint32_t rng[DITHER_LANES]; // dither state, only used by data_cb
+  float mix[MIX_FRAMES]; // the mono bus for this device
+  struct s_unpacked unpacked; // for packed audio, see render_packed
+  UT_hash_handle hh;
+} *devices = NULL;
+
+void devinfo(void) {
+  struct s_device *dev;
+  for (dev = devices; dev != NULL; dev = dev->hh.next) {
+    char *type = ":capture";
+    if (dev->id & TYPE_PLAYBACK) type = ":playback";
+    char *attached = ":detached";
+    if (dev->attached) attached = ":attached";
+    char *isdefault = "";
+    if (dev->isDefault) isdefault = ":default";
+    char *assigned = "";
+    if (dev->assigned) assigned = ":assigned";
+    char audio_info[1024] = "";
+    struct s_audio *audio = atomic_load(&dev->audio);
+    int state = atomic_load(&dev->state);
+    if (audio) {
+      sprintf(audio_info, "{%d %d %d}", audio->len, atomic_load(&dev->position), state);
+    }
+    if (atomic_load(&dev->stream)) {
+      sprintf(audio_info, "{stream %d}", state);
+    }
+    if (atomic_load(&dev->record)) {
+      sprintf(audio_info, "{record %d}", state);
+    }
+    LOG("dev:%p id:%d name:<<%s>> [%s %s %s %s] ctx:%d cb:%d %s"CR,
+      dev, dev->id, dev->name,
+      type, attached, isdefault, assigned,
+      dev->ctxid,
+      dev->data_cb_count,
+      audio_info);
+  }
+}
+
+struct s_device *find_device(int id) {
+  struct s_device *dev;
+  HASH_FIND_INT(devices, &id, dev);
+  return dev;
+}
+
+// after swapping one of the source pointers out, wait until data_cb
+// can't still be using the old one. if the callback isn't running
+// right now the next one will load the new pointer, otherwise wait
+// for the current one to finish.
+//
+// the swap is a store followed by a load of cb_seq, and data_cb does the
+// mirror image (cb_seq then the pointers). both sides fence between the
+// two, or each could miss the other's store and the old pointer be
+// freed under a callback that just loaded it.
+void device_sync(struct s_device *this) {
+  atomic_thread_fence(memory_order_seq_cst);
+  uint64_t seq = atomic_load(&this->cb_seq);
+  if ((seq & 1) == 0) return;
+  while (atomic_load(&this->cb_seq) == seq) usleep(100);
+}
+
+// copy params_edit to the callback
+void device_params_publish(struct s_device *this) {
+  this->params[this->params_tb.back] = this->params_edit;
+  triple_publish(&this->params_tb);
+}
+
+// -----------------------------------------------------------
+
+// sample lifetime
+//
+// references are counted on the control thread only: a bank slot, a
+// cache entry and a device each hold one on the s_audio they use. the
+// callback never counts, it just loads the device's pointer. so when
+// the last reference goes the audio is retired rather than freed, and
+// reclaim frees it once no callback can still be holding the pointer.
+//
+// every data_cb stores the global epoch it entered in (cb_epoch) and
+// clears it on the way out. retiring bumps the global epoch after the
+// audio has been unlinked, so a callback that entered in a later epoch
+// loaded its pointers after the unlink and can't have seen it. audio
+// retired in epoch e is safe once every device is outside the
+// callback or entered in an epoch after e.
+
+#define RECLAIM_POLL_MS (50)
+
+static atomic_uint_fast64_t global_epoch = 1;
+static struct s_audio *retired = NULL;
+static int retired_count = 0;
+static uint32_t audio_serial = 0;
+
+struct s_audio *audio_new(float *buffer, uint32_t len, uint32_t rate) {
+  struct s_audio *a = malloc(sizeof *a);
+  if (!a) return NULL;
+  memset(a, 0, sizeof *a);
+  a->buffer = buffer;
+  a->len = len;
+  a->rate = rate;
+  a->refs = 1;
+  a->owned = 1;
+  if (++audio_serial == 0) audio_serial = 1; // 0 is no audio, see s_unpacked
+  a->serial = audio_serial;
+  return a;
+}
+
+// like audio_new but keeps the samples with codec, buffer is freed
+// once it has been packed
+struct s_audio *audio_pack(float *buffer, uint32_t len, uint32_t rate, int codec) {
+  uint8_t *packed = NULL;
+  if (codec != codec_f32) {
+    int block_bytes = codec_info[codec].block_bytes;
+    packed = pool_alloc((size_t)codec_blocks(len) * block_bytes);
+    if (!packed) {
+      pool_free(buffer);
+      return NULL;
+    }
+    int index = 0;
+    for (uint32_t b = 0; b < codec_blocks(len); b++) {
+      uint32_t n = len - b * CODEC_BLOCK < CODEC_BLOCK ? len - b * CODEC_BLOCK : CODEC_BLOCK;
+      codec_info[codec].encode(buffer + b * CODEC_BLOCK, n, packed + (size_t)b * block_bytes, &index);
+    }
+    pool_free(buffer);
+    buffer = NULL;
+  }
+  struct s_audio *a = audio_new(buffer, len, rate);
+  if (!a) {
+    pool_free(buffer);
+    pool_free(packed);
+    return NULL;
+  }
+  a->codec = codec;
+  a->packed = packed;
+  return a;
+}
+
+// a plain f32 copy of any audio, for the control thread to work on
+float *audio_floats(const struct s_audio *a) {
+  float *out = pool_alloc((size_t)codec_blocks(a->len) * CODEC_BLOCK * sizeof(float));
+  if (!out) return NULL;
+  if (a->codec == codec_f32) {
+    memcpy(out, a->buffer, a->len * sizeof(float));
+  } else {
+    for (uint32_t b = 0; b < codec_blocks(a->len); b++) {
+      codec_info[(int)a->codec].decode(a->packed + (size_t)b * codec_info[(int)a->codec].block_bytes,
+        out + b * CODEC_BLOCK);
+    }
+  }
+  return out;
+}
+
+struct s_audio *audio_ref(struct s_audio *a) {
+  if (a) a->refs++;
+  return a;
+}
+
+void reclaim(void) {
+  uint64_t oldest = UINT64_MAX;
+  struct s_device *dev;
+  atomic_thread_fence(memory_order_seq_cst); // the unlink before cb_epoch, see device_sync
+  for (dev = devices; dev != NULL; dev = dev->hh.next) {
+    uint64_t e = atomic_load(&dev->cb_epoch);
+    if (e && e < oldest) oldest = e;
+  }
+  struct s_audio **link = &retired;
+  while (*link) {
+    struct s_audio *a = *link;
+    if (a->retired_at < oldest) {
+      *link = a->retired_next;
+      retired_count--;
+      pool_free(a->buffer);
+      pool_free(a->packed);
+      free(a);
+    } else {
+      link = &a->retired_next;
+    }
+  }
+}
+
+void audio_unref(struct s_audio *a) {
+  if (!a) return;
+  if (--a->refs > 0) return;
+  if (!a->owned) return;
+  a->retired_at = atomic_fetch_add(&global_epoch, 1);
+  a->retired_next = retired;
+  retired = a;
+  retired_count++;
+  reclaim();
+}
+
+// the device lets go of what it had, the old audio keeps playing in a
+// callback that already loaded it and is freed later by reclaim
+void device_set_audio(struct s_device *this, struct s_audio *audio) {
+  struct s_audio *old = atomic_exchange(&this->audio, audio_ref(audio));
+  audio_unref(old);
+}
+
+void device_params_init(struct s_device *this) {
+  this->params_edit = (struct s_params){.gain = 1.0, .dither = 1, .loop = 0, .start = 0, .end = 0};
+  for (int i=0; i<3; i++) this->params[i] = this->params_edit;
+  triple_init(&this->params_tb);
+}
+
+#define EXA_INFO_PLAYBACK (0)
+#define EXA_INFO_CAPTURE (1)
+#define EXA_INFO_COUNT (2)
+
+struct {
+  ma_device_info *info;
+  ma_uint32 count;
+  int type;
+  int defaultid;
+} exa_info[EXA_INFO_COUNT];
+
+void scan(void) {
+  static char first = 1;
+  if (first) {
+    exa_info[EXA_INFO_PLAYBACK].type = TYPE_PLAYBACK;
+    exa_info[EXA_INFO_CAPTURE].type = TYPE_CAPTURE;
+    first = 0;
+  }
+
+  ma_context *ctx = (ma_context *)malloc(sizeof(ma_context));
+  
+  LOG("=> scan"CR);
+  LOG("miniaudio version %s"CR, ma_version_string());
+
+  LOG("=> ma_context_init"CR);
+  if (ma_context_init(NULL, 0, NULL, ctx) != MA_SUCCESS) {
+    LOG("failed to get ma_context"CR);
+    return;
+  }
+
+  int new_or_reattached_devices = 0;
+  int detached_devices = 0;
+
+  if (ma_context_get_devices(ctx,
+    &exa_info[EXA_INFO_PLAYBACK].info, &exa_info[EXA_INFO_PLAYBACK].count,
+    &exa_info[EXA_INFO_CAPTURE].info, &exa_info[EXA_INFO_CAPTURE].count) != MA_SUCCESS) {
+    LOG("failed to get I/O device list"CR);
+    goto clean;
+  }
+
+  struct s_device *dev;
+
+  // clear visited flag so we can detect if a device was removed
+  for (dev = devices; dev != NULL; dev = dev->hh.next) {
+    dev->visited = 0;
+  }
+
+  // scan and update, adding as necessary
+  for (int which = 0; which < EXA_INFO_COUNT; which++) {
+    exa_info[which].defaultid = -1; // this should be filled in during the scan
+    int type = exa_info[which].type;
+    int count = exa_info[which].count;
     for (int i=0; i<count; i++) {
       ma_device_info *info = &exa_info[which].info[i];
       char *name = info->name;
@@ -678,15 +1843,25 @@ void scan(void) {
         dev->ctxid = ctx_id_counter;
         dev->assigned = 0;
         dev->data_cb_count = 0;
-        dev->position = 0;
-        dev->state = audio_state_idle;
+        atomic_init(&dev->position, 0);
+        atomic_init(&dev->clock, 0);
+        atomic_init(&dev->state, audio_state_idle);
+        atomic_init(&dev->cb_seq, 0);
+        atomic_init(&dev->stream, NULL);
+        atomic_init(&dev->record, NULL);
+        atomic_init(&dev->synth, NULL);
+        atomic_init(&dev->audio, NULL);
+        atomic_init(&dev->cb_epoch, 0);
+        dev->unpacked.serial = 0; // no block decoded yet, see unpack
+        device_params_init(dev);
+        for (int i=0; i<DITHER_LANES; i++) dev->rng[i] = 0x9e3779b9 * (h12 + i + 1);
         LOG("attach %d"CR, h12);
         strcpy(dev->name, name);
         // hack for audio buffer
         if (type == TYPE_CAPTURE) {
-          dev->audio = &capture_audio;
+          atomic_init(&dev->audio, audio_ref(&capture_audio));
         } else if (type == TYPE_PLAYBACK) {
-          dev->audio = &playback_audio;
+          atomic_init(&dev->audio, audio_ref(&playback_audio));
         }
         //
         new_or_reattached_devices++;
@@ -792,71 +1967,3580 @@ int use(int capture_id, int playback_id) {
   );
 }
 
+// -----------------------------------------------------------
+
+// sample bank and resample cache
+//
+// the bank holds samples at whatever rate they were stored with. a
+// device never plays those directly, it plays a variant from the
+// cache that was resampled to the device's rate once, on the control
+// thread, so the callback only ever steps through frames one at a
+// time. variants are made when a sample is stored (for every assigned
+// playback device) and when a device is assigned (for every sample in
+// the bank), so "play" normally finds one ready.
 //
+// the cache is keyed by (sample id, rate). storing into a slot gives
+// the sample a new id, which leaves the old variants unreachable;
+// bank_drop removes them. a variant at the sample's own rate is just
+// another reference to the bank sample. edits (trim, reverse,
+// normalize) never change a sample, they store a new one, so a device
+// still playing the old version carries on until it is told to play
+// something else.
+//
+// resampling is a windowed sinc (kaiser window, RESAMPLE_ZEROS zero
+// crossings each side) looked up from a table. going down in rate the
+// cutoff moves down with the ratio so nothing above the new nyquist
+// folds back.
+
+#define BANK_SLOTS (64)
+#define RESAMPLE_ZEROS (32)
+#define RESAMPLE_PHASES (512) // table entries per zero crossing
+#define RESAMPLE_BETA (9.0) // kaiser window shape, ~90dB stopband
+#define RESAMPLE_ROLLOFF (0.95) // cutoff as a fraction of the lower nyquist
+
+static struct s_audio *bank[BANK_SLOTS];
+static uint32_t bank_id_counter = 0;
+
+struct s_cache_key {
+  uint32_t id;
+  uint32_t rate;
+};
 
-uint64_t data_cb_count = 0;
-uint64_t data_cb_nodev = 0;
-uint64_t data_cb_fail = 0;
+static struct s_variant {
+  struct s_cache_key key;
+  struct s_audio *audio; // holds a reference
+  UT_hash_handle hh;
+} *variants = NULL;
+
+static float sinc_table[RESAMPLE_ZEROS * RESAMPLE_PHASES + 2];
+
+// zeroth order modified bessel function, for the kaiser window
+double bessel_i0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+  return sum;
+}
 
-void data_cb(ma_device *pDevice, void *playback, const void *capture, ma_uint32 frame_count) {
-  if (pDevice) {
-    struct s_device *this = (struct s_device *)pDevice->pUserData;
-    if (this) {
-      this->data_cb_count++;
-      if (playback && this->audio && this->audio->buffer && this->state == audio_state_go) {
-        this->state = audio_state_running;
-        // this give us a chance to trigger something at start
-      }
-      if (playback && this->audio && this->audio->buffer && this->state == audio_state_running) {
-        // copy from audio buffer into device
-        int16_t *poke = (int16_t *)playback;
-        for(int i=0; i<frame_count; i++) {
-          poke[i] = this->audio->buffer[this->position++];
-          if (this->position >= this->audio->len) {
-            this->state = audio_state_done; // 0 = idle, 1 = go, 2 = inprogress, 3 = done;
-            this->position = 0; // reset position
-            break;
-          }
-        }
-      }
-      if (capture && this->audio && this->audio->buffer && this->state == audio_state_go) {
-        this->state = audio_state_running;
-        // this give us a chance to trigger something at start
-      }
-      if (capture && this->audio && this->audio->buffer && this->state == audio_state_running) {
-        // copy from device to audio buffer
-        int16_t *peek = (int16_t *)capture;
-        for(int i=0; i<frame_count; i++) {
-          this->audio->buffer[this->position++] = peek[i];
-          if (this->position >= this->audio->len) {
-            this->state = audio_state_done; // 0 = idle, 1 = go, 2 = inprogress, 3 = done;
-            this->position = 0; // reset position
-            break;
-          }
-        }
-      }
-    } else {
-      data_cb_fail++;
+void resample_init(void) {
+  int n = RESAMPLE_ZEROS * RESAMPLE_PHASES;
+  double norm = bessel_i0(RESAMPLE_BETA);
+  for (int i = 0; i <= n; i++) {
+    double t = (double)i / RESAMPLE_PHASES;
+    double r = t / RESAMPLE_ZEROS;
+    double w = bessel_i0(RESAMPLE_BETA * sqrt(1.0 - r * r)) / norm;
+    double sinc = i == 0 ? 1.0 : sin(M_PI * t) / (M_PI * t);
+    sinc_table[i] = sinc * w;
+  }
+  sinc_table[n + 1] = 0;
+}
+
+static inline double sinc_at(double t) {
+  t = fabs(t);
+  if (t >= RESAMPLE_ZEROS) return 0;
+  double x = t * RESAMPLE_PHASES;
+  int i = (int)x;
+  double f = x - i;
+  return sinc_table[i] + f * (sinc_table[i + 1] - sinc_table[i]);
+}
+
+// returns the new buffer and its length in out_len, NULL if out of memory
+float *resample(const float *in, uint32_t in_len, uint32_t in_rate, uint32_t out_rate, uint32_t *out_len) {
+  uint32_t n = ((uint64_t)in_len * out_rate + in_rate - 1) / in_rate;
+  float *out = pool_alloc(n * sizeof(float));
+  if (!out) return NULL;
+  double step = (double)in_rate / out_rate;
+  double fc = (out_rate < in_rate ? (double)out_rate / in_rate : 1.0) * RESAMPLE_ROLLOFF;
+  double half = RESAMPLE_ZEROS / fc; // kernel half width in input frames
+  for (uint32_t j = 0; j < n; j++) {
+    double center = j * step;
+    int64_t lo = (int64_t)ceil(center - half);
+    int64_t hi = (int64_t)floor(center + half);
+    if (lo < 0) lo = 0;
+    if (hi >= in_len) hi = in_len - 1;
+    double acc = 0;
+    for (int64_t k = lo; k <= hi; k++) {
+      acc += in[k] * sinc_at((center - k) * fc);
     }
-    data_cb_count++;
-  } else {
-    data_cb_nodev++;
+    out[j] = acc * fc;
   }
+  *out_len = n;
+  return out;
 }
 
-//
+struct s_variant *cache_find(uint32_t id, uint32_t rate) {
+  struct s_variant *v;
+  struct s_cache_key key = {.id = id, .rate = rate};
+  HASH_FIND(hh, variants, &key, sizeof(struct s_cache_key), v);
+  return v;
+}
 
-void notification_cb(const ma_device_notification *pNotification) {
-  if (pNotification) {
-    struct s_device *dev = (struct s_device *)pNotification->pDevice->pUserData;
-    switch (pNotification->type) {
-      case ma_device_notification_type_started:
-        LOG("notify started id:%d"CR, dev->id);
-        break;
-      case ma_device_notification_type_stopped:
-        LOG("notify stopped id:%d"CR, dev->id);
-        break;
-      case ma_device_notification_type_rerouted:
+// add a variant of the sample in bank[slot], takes over the caller's
+// reference to audio
+struct s_variant *cache_put(int slot, uint32_t rate, struct s_audio *audio) {
+  struct s_audio *src = bank[slot];
+  struct s_variant *v = malloc(sizeof *v);
+  if (!v) {
+    audio_unref(audio);
+    return NULL;
+  }
+  memset(v, 0, sizeof *v);
+  v->audio = audio;
+  v->key.id = src->id;
+  v->key.rate = rate;
+  HASH_ADD(hh, variants, key, sizeof(struct s_cache_key), v);
+  LOG("cache slot:%d id:%d %d -> %d hz, %d frames"CR, slot, src->id, src->rate, rate, audio->len);
+  return v;
+}
+
+// wrap a resampled buffer as a variant of bank[slot], packed the same way
+struct s_variant *cache_put_buffer(int slot, uint32_t rate, float *buffer, uint32_t len) {
+  struct s_audio *audio = audio_pack(buffer, len, rate, bank[slot]->codec);
+  if (!audio) return NULL;
+  audio->id = bank[slot]->id;
+  return cache_put(slot, rate, audio);
+}
+
+struct s_variant *cache_get(int slot, uint32_t rate) {
+  if (slot < 0 || slot >= BANK_SLOTS || !bank[slot]) return NULL;
+  struct s_audio *src = bank[slot];
+  struct s_variant *v = cache_find(src->id, rate);
+  if (v) return v;
+  if (src->rate == rate) return cache_put(slot, rate, audio_ref(src));
+  uint32_t len;
+  float *buffer;
+  if (src->codec == codec_f32) {
+    buffer = resample(src->buffer, src->len, src->rate, rate, &len);
+  } else {
+    float *in = audio_floats(src);
+    if (!in) return NULL;
+    buffer = resample(in, src->len, src->rate, rate, &len);
+    pool_free(in);
+  }
+  if (!buffer) return NULL;
+  return cache_put_buffer(slot, rate, buffer, len);
+}
+
+// make variants of this slot for every assigned playback device
+void cache_fill_slot(int slot) {
+  struct s_device *dev;
+  for (dev = devices; dev != NULL; dev = dev->hh.next) {
+    if (dev->assigned && dev->type == TYPE_PLAYBACK) cache_get(slot, dev->dev.sampleRate);
+  }
+}
+
+// make variants of every slot at this rate
+void cache_fill_rate(uint32_t rate) {
+  for (int i = 0; i < BANK_SLOTS; i++) {
+    if (bank[i]) cache_get(i, rate);
+  }
+}
+
+// empty a slot along with every variant made from it
+void bank_drop(int slot) {
+  struct s_audio *old = bank[slot];
+  if (!old) return;
+  struct s_variant *v, *tmp;
+  HASH_ITER(hh, variants, v, tmp) {
+    if (v->key.id == old->id) {
+      HASH_DEL(variants, v);
+      audio_unref(v->audio);
+      free(v);
+    }
+  }
+  bank[slot] = NULL;
+  audio_unref(old);
+}
+
+// how each slot keeps its samples, see "codec"
+static char bank_codec[BANK_SLOTS];
+
+// takes ownership of buffer, leaves the cache empty for this slot
+int bank_put(int slot, float *buffer, uint32_t len, uint32_t rate) {
+  if (slot < 0 || slot >= BANK_SLOTS) {
+    LOG("bad slot %d"CR, slot);
+    pool_free(buffer);
+    return -1;
+  }
+  struct s_audio *a = audio_pack(buffer, len, rate, bank_codec[slot]);
+  if (!a) return -1;
+  bank_drop(slot);
+  a->id = ++bank_id_counter;
+  bank[slot] = a;
+  return 0;
+}
+
+// takes ownership of buffer
+int bank_store(int slot, float *buffer, uint32_t len, uint32_t rate) {
+  if (bank_put(slot, buffer, len, rate) < 0) return -1;
+  cache_fill_slot(slot);
+  return 0;
+}
+
+// raw f32 mono, like the README's ffmpeg line makes
+float *read_raw(char *path, uint32_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    char why[128]; // the loader workers come through here
+    LOG("can't open <%s> <%s>"CR, path, exa_strerror(errno, why, sizeof why));
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long bytes = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  float *buffer = pool_alloc(bytes);
+  if (!buffer) {
+    fclose(f);
+    return NULL;
+  }
+  *len = fread(buffer, sizeof(float), bytes / sizeof(float), f);
+  fclose(f);
+  return buffer;
+}
+
+int bank_load_raw(int slot, char *path, uint32_t rate) {
+  uint32_t len;
+  float *buffer = read_raw(path, &len);
+  if (!buffer) return -1;
+  return bank_store(slot, buffer, len, rate);
+}
+
+struct s_audio *bank_find(uint32_t id) {
+  for (int i = 0; i < BANK_SLOTS; i++) {
+    if (bank[i] && bank[i]->id == id) return bank[i];
+  }
+  return NULL;
+}
+
+// trim, reverse and normalize make a new sample, the old one lives on
+// for as long as something is still playing it
+enum {
+  edit_trim,
+  edit_reverse,
+  edit_normalize,
+};
+
+int bank_edit(int slot, int edit, int32_t a, int32_t b) {
+  if (slot < 0 || slot >= BANK_SLOTS || !bank[slot]) {
+    LOG("empty slot"CR);
+    return -1;
+  }
+  struct s_audio *src = bank[slot];
+  uint32_t start = 0;
+  uint32_t end = src->len;
+  if (edit == edit_trim) {
+    start = a < 0 ? 0 : a;
+    end = b <= 0 || b > src->len ? src->len : b;
+    if (start >= end) {
+      LOG("nothing left to keep"CR);
+      return -1;
+    }
+  }
+  uint32_t len = end - start;
+  float *in = audio_floats(src);
+  float *buffer = pool_alloc(len * sizeof(float));
+  if (!in || !buffer) {
+    pool_free(in);
+    pool_free(buffer);
+    return -1;
+  }
+  switch (edit) {
+    case edit_trim:
+      memcpy(buffer, in + start, len * sizeof(float));
+      break;
+    case edit_reverse:
+      for (uint32_t i = 0; i < len; i++) buffer[i] = in[len - 1 - i];
+      break;
+    case edit_normalize: {
+      // a is the peak to aim for in thousandths, 0 means full scale
+      float peak = 0;
+      for (uint32_t i = 0; i < len; i++) {
+        float m = fabsf(in[i]);
+        if (m > peak) peak = m;
+      }
+      float target = a > 0 ? a / 1000.0 : 1.0;
+      float scale = peak > 0 ? target / peak : 1.0;
+      for (uint32_t i = 0; i < len; i++) buffer[i] = in[i] * scale;
+      break;
+    }
+  }
+  pool_free(in);
+  return bank_store(slot, buffer, len, src->rate);
+}
+
+void bank_info(void) {
+  uint64_t total = 0;
+  for (int i = 0; i < BANK_SLOTS; i++) {
+    struct s_audio *a = bank[i];
+    if (!a) continue;
+    LOG("bank:%d id:%d rate:%d frames:%d refs:%d %s bytes:%lu"CR,
+      i, a->id, a->rate, a->len, a->refs, codec_info[(int)a->codec].name, audio_bytes(a));
+    total += audio_bytes(a);
+  }
+  struct s_variant *v;
+  for (v = variants; v != NULL; v = v->hh.next) {
+    char shared = v->audio == bank_find(v->key.id);
+    uint64_t bytes = shared ? 0 : audio_bytes(v->audio);
+    LOG("variant id:%d rate:%d frames:%d refs:%d bytes:%lu%s"CR,
+      v->key.id, v->key.rate, v->audio->len, v->audio->refs, bytes, shared ? " (shared)" : "");
+    total += bytes;
+  }
+  uint64_t waiting = 0;
+  for (struct s_audio *a = retired; a; a = a->retired_next) waiting += audio_bytes(a);
+  LOG("bank+cache bytes:%lu retired:%d (%lu bytes) epoch:%lu"CR,
+    total, retired_count, waiting, atomic_load(&global_epoch));
+}
+
+// -----------------------------------------------------------
+
+// background sample loading
+//
+// {"load", slot, "path"} hands the file to a pool of decode workers
+// so a whole kit can decode on every core while the command loop keeps
+// going. miniaudio's decoders turn WAV, FLAC and MP3 into f32 mono at
+// the file's own rate, ".raw" files are taken as f32 at SAMPLERATE.
+// the worker then makes the variants for every playback device rate
+// known when the load was asked for, so nothing heavy is left for the
+// control thread.
+//
+// workers never touch the bank. finished jobs go on a done list and a
+// byte down load_pipe wakes the main loop, which installs them and
+// reports {"loaded", slot, frames} or {"load-error", slot, reason}
+// on stdout. two loads of one slot can finish either way round, so
+// each is numbered and one finishing after a later one is dropped.
+
+#define LOAD_WORKERS_MAX (8)
+#define LOAD_RATES_MAX (8)
+#define LOAD_PATH_SIZE (256)
+#define LOAD_CHUNK_FRAMES (65536)
+
+enum {
+  load_okay = 0,
+  load_open_failed,
+  load_decode_failed,
+  load_no_memory,
+  load_stale, // a later load of the slot finished first
+};
+
+struct s_load {
+  int slot;
+  uint32_t seq; // loads of a slot are numbered as they are asked for
+  char path[LOAD_PATH_SIZE];
+  int result; // load_okay or one of the failures
+  float *buffer; // decoded
+  uint32_t len;
+  uint32_t rate;
+  int rate_count; // variants wanted
+  uint32_t rates[LOAD_RATES_MAX];
+  float *variants[LOAD_RATES_MAX];
+  uint32_t variant_lens[LOAD_RATES_MAX];
+  struct s_load *next;
+};
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t threads[LOAD_WORKERS_MAX];
+  int count;
+  char stopping;
+  struct s_load *todo; // fifo, head first
+  struct s_load *todo_tail;
+  struct s_load *done;
+  int pipe[2]; // [0] is polled by the main loop
+  uint32_t asked[BANK_SLOTS]; // control thread only: seq of the last load asked for
+  uint32_t finished[BANK_SLOTS]; // and of the newest one finished
+} loader = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+  .pipe = {-1, -1},
+};
+
+float *decode_file(char *path, uint32_t *len, uint32_t *rate, int *result) {
+  ma_decoder decoder;
+  ma_decoder_config cfg = ma_decoder_config_init(ma_format_f32, 1, 0);
+  if (ma_decoder_init_file(path, &cfg, &decoder) != MA_SUCCESS) {
+    *result = load_open_failed;
+    return NULL;
+  }
+  ma_uint64 known = 0;
+  ma_decoder_get_length_in_pcm_frames(&decoder, &known);
+  uint64_t cap = known ? known : LOAD_CHUNK_FRAMES;
+  uint64_t have = 0;
+  float *buffer = pool_alloc(cap * sizeof(float));
+  *result = load_okay;
+  while (buffer) {
+    if (have == cap) {
+      cap *= 2;
+      float *bigger = pool_realloc(buffer, cap * sizeof(float));
+      if (!bigger) {
+        pool_free(buffer);
+        buffer = NULL;
+        break;
+      }
+      buffer = bigger;
+    }
+    ma_uint64 got = 0;
+    ma_result r = ma_decoder_read_pcm_frames(&decoder, buffer + have, cap - have, &got);
+    have += got;
+    if (r == MA_AT_END || got == 0) break;
+    if (r != MA_SUCCESS) {
+      *result = load_decode_failed;
+      break;
+    }
+  }
+  *rate = decoder.outputSampleRate;
+  ma_decoder_uninit(&decoder);
+  if (!buffer) *result = load_no_memory;
+  if (*result != load_okay) {
+    pool_free(buffer);
+    return NULL;
+  }
+  *len = have;
+  return buffer;
+}
+
+void load_run(struct s_load *job) {
+  int n = strlen(job->path);
+  if (n > 4 && strcmp(job->path + n - 4, ".raw") == 0) {
+    job->buffer = read_raw(job->path, &job->len);
+    job->rate = SAMPLERATE;
+    job->result = job->buffer ? load_okay : load_open_failed;
+  } else {
+    job->buffer = decode_file(job->path, &job->len, &job->rate, &job->result);
+  }
+  if (job->result != load_okay) return;
+  for (int i=0; i<job->rate_count; i++) {
+    // same rate shares the bank sample, see cache_get
+    if (job->rates[i] == job->rate) continue;
+    job->variants[i] = resample(job->buffer, job->len, job->rate, job->rates[i], &job->variant_lens[i]);
+  }
+}
+
+void *load_worker(void *arg) {
+  pthread_mutex_lock(&loader.lock);
+  while (1) {
+    while (!loader.todo && !loader.stopping) pthread_cond_wait(&loader.wake, &loader.lock);
+    if (loader.stopping) break;
+    struct s_load *job = loader.todo;
+    loader.todo = job->next;
+    if (!loader.todo) loader.todo_tail = NULL;
+    pthread_mutex_unlock(&loader.lock);
+
+    load_run(job);
+
+    pthread_mutex_lock(&loader.lock);
+    job->next = loader.done;
+    loader.done = job;
+    uint8_t one = 1;
+    write(loader.pipe[1], &one, 1);
+  }
+  pthread_mutex_unlock(&loader.lock);
+  return NULL;
+}
+
+int load_start(void) {
+  if (loader.count) return 0;
+  if (pipe(loader.pipe) < 0) {
+    LOG("load pipe failed <%s>"CR, strerror(errno));
+    return -1;
+  }
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores < 1) cores = 1;
+  if (cores > LOAD_WORKERS_MAX) cores = LOAD_WORKERS_MAX;
+  for (int i=0; i<cores; i++) {
+    if (pthread_create(&loader.threads[loader.count], NULL, load_worker, NULL) == 0) loader.count++;
+  }
+  LOG("load workers:%d"CR, loader.count);
+  return loader.count ? 0 : -1;
+}
+
+void load_free(struct s_load *job) {
+  pool_free(job->buffer);
+  for (int i=0; i<job->rate_count; i++) pool_free(job->variants[i]);
+  free(job);
+}
+
+void load_stop(void) {
+  if (!loader.count) return;
+  pthread_mutex_lock(&loader.lock);
+  loader.stopping = 1;
+  pthread_cond_broadcast(&loader.wake);
+  pthread_mutex_unlock(&loader.lock);
+  for (int i=0; i<loader.count; i++) pthread_join(loader.threads[i], NULL);
+  loader.count = 0;
+  while (loader.todo) {
+    struct s_load *job = loader.todo;
+    loader.todo = job->next;
+    load_free(job);
+  }
+  while (loader.done) {
+    struct s_load *job = loader.done;
+    loader.done = job->next;
+    load_free(job);
+  }
+  close(loader.pipe[0]);
+  close(loader.pipe[1]);
+  loader.pipe[0] = loader.pipe[1] = -1;
+}
+
+int load_submit(int slot, char *path) {
+  if (slot < 0 || slot >= BANK_SLOTS) return -1;
+  if (load_start() < 0) return -1;
+  struct s_load *job = malloc(sizeof *job);
+  if (!job) return -1;
+  memset(job, 0, sizeof *job);
+  job->slot = slot;
+  job->seq = ++loader.asked[slot];
+  snprintf(job->path, LOAD_PATH_SIZE, "%s", path);
+  // the rates we will want variants at, as of now
+  struct s_device *dev;
+  for (dev = devices; dev != NULL; dev = dev->hh.next) {
+    if (!dev->assigned || dev->type != TYPE_PLAYBACK) continue;
+    uint32_t rate = dev->dev.sampleRate;
+    char seen = 0;
+    for (int i=0; i<job->rate_count; i++) seen |= job->rates[i] == rate;
+    if (!seen && job->rate_count < LOAD_RATES_MAX) job->rates[job->rate_count++] = rate;
+  }
+  pthread_mutex_lock(&loader.lock);
+  if (loader.todo_tail) loader.todo_tail->next = job;
+  else loader.todo = job;
+  loader.todo_tail = job;
+  pthread_cond_signal(&loader.wake);
+  pthread_mutex_unlock(&loader.lock);
+  return 0;
+}
+
+// control thread: install whatever the workers have finished
+void load_finish(int fd) {
+  uint8_t drain[64];
+  read(loader.pipe[0], drain, sizeof(drain));
+  pthread_mutex_lock(&loader.lock);
+  struct s_load *done = loader.done;
+  loader.done = NULL;
+  pthread_mutex_unlock(&loader.lock);
+  while (done) {
+    struct s_load *job = done;
+    done = job->next;
+    // workers finish in any order, an older load mustn't undo a newer one
+    if (job->seq < loader.finished[job->slot]) job->result = load_stale;
+    else loader.finished[job->slot] = job->seq;
+    if (job->result != load_okay || bank_put(job->slot, job->buffer, job->len, job->rate) < 0) {
+      LOG("load %d <%s> failed %d"CR, job->slot, job->path, job->result);
+      exa_event(fd, "load-error", job->slot, job->result);
+      if (job->result == load_okay) job->buffer = NULL; // bank_put freed it
+      load_free(job);
+      continue;
+    }
+    job->buffer = NULL; // the bank has it now
+    for (int i=0; i<job->rate_count; i++) {
+      if (job->rates[i] == job->rate) {
+        cache_put(job->slot, job->rate, audio_ref(bank[job->slot]));
+      } else if (job->variants[i]) {
+        cache_put_buffer(job->slot, job->rates[i], job->variants[i], job->variant_lens[i]);
+        job->variants[i] = NULL;
+      }
+    }
+    // devices assigned since the load was asked for
+    cache_fill_slot(job->slot);
+    LOG("loaded %d <%s> %d frames at %d"CR, job->slot, job->path, job->len, job->rate);
+    exa_event(fd, "loaded", job->slot, job->len);
+    load_free(job);
+  }
+}
+
+// -----------------------------------------------------------
+
+// disk streaming
+//
+// a stream is a playback source that is too big (or too long) to
+// live in an s_audio buffer. the file is raw f32 mono at SAMPLERATE
+// (see the ffmpeg line in the README).
+//
+// each stream owns a ring of STREAM_BLOCKS blocks. the disk thread
+// fills whole blocks from the file, the data_cb drains them. the two
+// sides only share the written/consumed counters, so the callback
+// never waits on the disk. the first blocks are read on the control
+// thread when the stream is opened so "go" starts on the next period.
+//
+// if the callback catches up with the disk thread it counts an
+// underflow and plays silence for the missing frames.
+
+#define STREAM_SLOTS (8)
+#define STREAM_BLOCK_FRAMES (8192) // ~186ms at 44100
+#define STREAM_BLOCKS (3)
+#define STREAM_RING_FRAMES (STREAM_BLOCK_FRAMES * STREAM_BLOCKS)
+#define STREAM_PRELOAD_BLOCKS (2)
+#define STREAM_POLL_US (20000)
+#define STREAM_PATH_SIZE (256)
+
+struct s_stream {
+  int fd; // -1 when the slot is free
+  char path[STREAM_PATH_SIZE];
+  pthread_mutex_t lock; // control thread vs disk thread, never taken by data_cb
+  _Atomic uint64_t written; // frames put into the ring by the disk thread
+  _Atomic uint64_t consumed; // frames taken out of the ring by data_cb
+  atomic_char eof; // disk thread reached the end of the file
+  _Atomic uint64_t underflows; // periods where data_cb ran out of frames
+  float ring[STREAM_RING_FRAMES];
+};
+
+// slots are filled in by the control thread while the disk thread walks
+// them, so each goes in with a release once it is set up
+static _Atomic(struct s_stream *) streams[STREAM_SLOTS];
+
+static pthread_t disk_thread;
+static atomic_char disk_thread_running = 0;
+
+// read up to one block from the file into the ring
+// returns frames read, 0 at end of file, -1 on error
+int stream_fill_block(struct s_stream *s) {
+  uint64_t w = atomic_load_explicit(&s->written, memory_order_relaxed);
+  uint64_t r = atomic_load_explicit(&s->consumed, memory_order_acquire);
+  if (STREAM_RING_FRAMES - (w - r) < STREAM_BLOCK_FRAMES) return 0;
+  float *block = &s->ring[w % STREAM_RING_FRAMES];
+  size_t want = STREAM_BLOCK_FRAMES * sizeof(float);
+  size_t got = 0;
+  while (got < want) {
+    ssize_t n = read(s->fd, (uint8_t *)block + got, want - got);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (n == 0) break;
+    got += n;
+  }
+  int frames = got / sizeof(float);
+  if (got < want) atomic_store_explicit(&s->eof, 1, memory_order_release);
+  // publish the frames only after they are in the ring
+  atomic_store_explicit(&s->written, w + frames, memory_order_release);
+  return frames;
+}
+
+// rewind and preload, caller holds s->lock and data_cb is not reading
+void stream_preload(struct s_stream *s) {
+  lseek(s->fd, 0, SEEK_SET);
+  atomic_store(&s->written, 0);
+  atomic_store(&s->consumed, 0);
+  atomic_store(&s->eof, 0);
+  for (int i=0; i<STREAM_PRELOAD_BLOCKS; i++) {
+    if (stream_fill_block(s) < STREAM_BLOCK_FRAMES) break;
+  }
+}
+
+void records_drain(void);
+
+void *disk_thread_main(void *arg) {
+  char why[128]; // not strerror's buffer, the main loop uses that
+  while (atomic_load(&disk_thread_running)) {
+    records_drain();
+    for (int i=0; i<STREAM_SLOTS; i++) {
+      struct s_stream *s = atomic_load_explicit(&streams[i], memory_order_acquire);
+      if (!s) continue;
+      pthread_mutex_lock(&s->lock);
+      while (s->fd >= 0 && !atomic_load(&s->eof)) {
+        int n = stream_fill_block(s);
+        if (n < 0) {
+          LOG("stream %d read error <%s>"CR, i, exa_strerror(errno, why, sizeof why));
+          atomic_store(&s->eof, 1);
+        }
+        if (n <= 0) break;
+      }
+      pthread_mutex_unlock(&s->lock);
+    }
+    usleep(STREAM_POLL_US);
+  }
+  return NULL;
+}
+
+void disk_thread_start(void) {
+  if (atomic_load(&disk_thread_running)) return;
+  atomic_store(&disk_thread_running, 1);
+  if (pthread_create(&disk_thread, NULL, disk_thread_main, NULL) != 0) {
+    LOG("failed to start disk thread"CR);
+    atomic_store(&disk_thread_running, 0);
+  }
+}
+
+void disk_thread_stop(void) {
+  if (!atomic_load(&disk_thread_running)) return;
+  atomic_store(&disk_thread_running, 0);
+  pthread_join(disk_thread, NULL);
+}
+
+struct s_stream *stream_open(char *path) {
+  struct s_stream *s = NULL;
+  int slot = -1;
+  for (int i=0; i<STREAM_SLOTS; i++) {
+    s = atomic_load_explicit(&streams[i], memory_order_relaxed); // only we store
+    if (!s) {
+      s = malloc(sizeof(struct s_stream));
+      if (!s) return NULL;
+      s->fd = -1;
+      pthread_mutex_init(&s->lock, NULL);
+      atomic_store_explicit(&streams[i], s, memory_order_release);
+    }
+    if (s->fd < 0) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    LOG("no free stream slots"CR);
+    return NULL;
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    LOG("stream open <%s> failed <%s>"CR, path, strerror(errno));
+    return NULL;
+  }
+  pthread_mutex_lock(&s->lock);
+  s->fd = fd;
+  snprintf(s->path, STREAM_PATH_SIZE, "%s", path);
+  atomic_store(&s->underflows, 0);
+  stream_preload(s);
+  pthread_mutex_unlock(&s->lock);
+  LOG("stream %d <%s> preloaded %d frames"CR, slot, path, (int)atomic_load(&s->written));
+  disk_thread_start();
+  return s;
+}
+
+void stream_close(struct s_stream *s) {
+  if (!s) return;
+  pthread_mutex_lock(&s->lock);
+  if (s->fd >= 0) close(s->fd);
+  s->fd = -1;
+  pthread_mutex_unlock(&s->lock);
+}
+
+// data_cb side: copy what is available, silence for the rest
+// returns 1 when the stream has been played to the end
+int stream_consume(struct s_stream *s, float *mix, int frame_count) {
+  uint64_t r = atomic_load_explicit(&s->consumed, memory_order_relaxed);
+  uint64_t w = atomic_load_explicit(&s->written, memory_order_acquire);
+  uint64_t avail = w - r;
+  int n = avail < frame_count ? avail : frame_count;
+  int at = r % STREAM_RING_FRAMES;
+  int first = n < STREAM_RING_FRAMES - at ? n : STREAM_RING_FRAMES - at;
+  memcpy(mix, &s->ring[at], first * sizeof(float));
+  memcpy(mix + first, &s->ring[0], (n - first) * sizeof(float));
+  // hand the frames back to the disk thread
+  atomic_store_explicit(&s->consumed, r + n, memory_order_release);
+  if (n < frame_count) {
+    memset(&mix[n], 0, (frame_count - n) * sizeof(float));
+    if (atomic_load_explicit(&s->eof, memory_order_acquire)) return 1;
+    atomic_fetch_add_explicit(&s->underflows, 1, memory_order_relaxed);
+  }
+  return 0;
+}
+
+void stream_info(void) {
+  for (int i=0; i<STREAM_SLOTS; i++) {
+    struct s_stream *s = atomic_load_explicit(&streams[i], memory_order_relaxed);
+    if (!s || s->fd < 0) continue;
+    LOG("stream:%d <%s> written:%lu consumed:%lu eof:%d underflows:%lu"CR,
+      i, s->path,
+      atomic_load(&s->written), atomic_load(&s->consumed),
+      atomic_load(&s->eof), atomic_load(&s->underflows));
+  }
+}
+
+// -----------------------------------------------------------
+
+// disk recording
+//
+// the capture side of disk streaming. data_cb copies each period into
+// a single producer / single consumer ring and never waits; when the
+// ring is full the rest of the period is dropped and counted as an
+// overrun. the disk thread drains the ring in RECORD_BLOCK_BYTES
+// writes from an aligned staging block, so there is no length limit
+// and the audio thread never allocates or touches the file.
+//
+// the ring holds the f32 mono bus, the disk thread converts to s16 as
+// it copies out. files ending in ".raw" get raw s16 samples, anything
+// else gets a WAV header. the header is padded out to RECORD_ALIGN with a JUNK
+// chunk so sample data starts aligned, which is what O_DIRECT needs.
+// the RIFF sizes are patched when the recording is stopped.
+
+#define RECORD_SLOTS (4)
+#define RECORD_RING_SAMPLES (1 << 18) // ~6s at 44100, must be a power of 2
+#define RECORD_RING_MASK (RECORD_RING_SAMPLES - 1)
+#define RECORD_ALIGN (4096)
+#define RECORD_BLOCK_BYTES (64 * 1024)
+#define RECORD_BLOCK_SAMPLES (RECORD_BLOCK_BYTES / sizeof(int16_t))
+#define RECORD_HEADER_BYTES (RECORD_ALIGN)
+#define RECORD_PATH_SIZE (256)
+#define RECORD_CHANNELS (1) // the mix bus
+
+#define RECORD_OPT_DIRECT (1) // open with O_DIRECT where available
+
+// set by {"record-opts", [direct, prealloc_seconds]}
+static int record_opts = 0;
+static int record_prealloc_seconds = 0;
+
+struct s_record {
+  int fd; // -1 when the slot is free
+  char path[RECORD_PATH_SIZE];
+  char wav; // 0 = raw
+  char direct; // file is open with O_DIRECT
+  pthread_mutex_t lock; // control thread vs disk thread, never taken by data_cb
+  _Atomic uint64_t written; // samples put into the ring by data_cb
+  _Atomic uint64_t drained; // samples taken out of the ring by the disk thread
+  _Atomic uint64_t overruns; // periods where data_cb found the ring full
+  uint64_t bytes; // sample bytes in the file
+  uint8_t *block; // RECORD_ALIGN aligned staging block
+  float ring[RECORD_RING_SAMPLES];
+};
+
+// filled in by the control thread while the disk thread walks them, as
+// streams[] is
+static _Atomic(struct s_record *) records[RECORD_SLOTS];
+
+void put_le32(uint8_t *p, uint32_t n) {
+  p[0] = n; p[1] = n >> 8; p[2] = n >> 16; p[3] = n >> 24;
+}
+
+void put_le16(uint8_t *p, uint16_t n) {
+  p[0] = n; p[1] = n >> 8;
+}
+
+// RIFF sizes saturate at 4GB, the samples keep going
+void record_wav_header(uint8_t *h, uint64_t bytes) {
+  uint64_t riff = RECORD_HEADER_BYTES - 8 + bytes;
+  memset(h, 0, RECORD_HEADER_BYTES);
+  memcpy(h, "RIFF", 4);
+  put_le32(h + 4, riff > UINT32_MAX ? UINT32_MAX : riff);
+  memcpy(h + 8, "WAVE", 4);
+  memcpy(h + 12, "fmt ", 4);
+  put_le32(h + 16, 16);
+  put_le16(h + 20, 1); // PCM
+  put_le16(h + 22, RECORD_CHANNELS);
+  put_le32(h + 24, SAMPLERATE);
+  put_le32(h + 28, SAMPLERATE * RECORD_CHANNELS * sizeof(int16_t));
+  put_le16(h + 32, RECORD_CHANNELS * sizeof(int16_t));
+  put_le16(h + 34, 16);
+  // JUNK pads the header so the data chunk payload starts at RECORD_ALIGN
+  memcpy(h + 36, "JUNK", 4);
+  put_le32(h + 40, RECORD_HEADER_BYTES - 52);
+  memcpy(h + RECORD_HEADER_BYTES - 8, "data", 4);
+  put_le32(h + RECORD_HEADER_BYTES - 4, bytes > UINT32_MAX ? UINT32_MAX : bytes);
+}
+
+int write_all(int fd, uint8_t *p, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// move up to one block from the ring to the file
+// partial blocks are only written when flushing at stop
+// returns samples written, 0 when there is nothing to do, -1 on error
+int record_drain_block(struct s_record *r, char flush) {
+  uint64_t d = atomic_load_explicit(&r->drained, memory_order_relaxed);
+  uint64_t w = atomic_load_explicit(&r->written, memory_order_acquire);
+  uint64_t avail = w - d;
+  if (avail == 0) return 0;
+  if (avail < RECORD_BLOCK_SAMPLES && !flush) return 0;
+  int n = avail < RECORD_BLOCK_SAMPLES ? avail : RECORD_BLOCK_SAMPLES;
+  int16_t *out = (int16_t *)r->block;
+  int at = d & RECORD_RING_MASK;
+  int first = n < RECORD_RING_SAMPLES - at ? n : RECORD_RING_SAMPLES - at;
+  edge_out_s16(out, &r->ring[at], first, 1, NULL);
+  edge_out_s16(out + first, &r->ring[0], n - first, 1, NULL);
+  // the ring space can be reused as soon as it is copied out
+  atomic_store_explicit(&r->drained, d + n, memory_order_release);
+  size_t len = n * sizeof(int16_t);
+  if (r->direct && (len % RECORD_ALIGN)) {
+    // O_DIRECT wants whole aligned blocks, the file is truncated at stop
+    size_t padded = (len + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+    memset(r->block + len, 0, padded - len);
+    if (write_all(r->fd, r->block, padded) < 0) return -1;
+  } else {
+    if (write_all(r->fd, r->block, len) < 0) return -1;
+  }
+  r->bytes += len;
+  return n;
+}
+
+void records_drain(void) {
+  for (int i=0; i<RECORD_SLOTS; i++) {
+    struct s_record *r = atomic_load_explicit(&records[i], memory_order_acquire);
+    if (!r) continue;
+    pthread_mutex_lock(&r->lock);
+    while (r->fd >= 0) {
+      int n = record_drain_block(r, 0);
+      if (n < 0) {
+        char why[128]; // on the disk thread, see disk_thread_main
+        LOG("record %d write error <%s>"CR, i, exa_strerror(errno, why, sizeof why));
+        close(r->fd);
+        r->fd = -1;
+      }
+      if (n <= 0) break;
+    }
+    pthread_mutex_unlock(&r->lock);
+  }
+}
+
+struct s_record *record_open(char *path) {
+  struct s_record *r = NULL;
+  int slot = -1;
+  for (int i=0; i<RECORD_SLOTS; i++) {
+    r = atomic_load_explicit(&records[i], memory_order_relaxed); // only we store
+    if (!r) {
+      r = malloc(sizeof(struct s_record));
+      if (!r) return NULL;
+      r->fd = -1;
+      r->block = NULL;
+      if (posix_memalign((void **)&r->block, RECORD_ALIGN, RECORD_BLOCK_BYTES) != 0) {
+        free(r);
+        return NULL;
+      }
+      pthread_mutex_init(&r->lock, NULL);
+      atomic_store_explicit(&records[i], r, memory_order_release);
+    }
+    if (r->fd < 0) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    LOG("no free record slots"CR);
+    return NULL;
+  }
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  char direct = 0;
+  int fd = -1;
+  #ifdef O_DIRECT
+  if (record_opts & RECORD_OPT_DIRECT) {
+    fd = open(path, flags | O_DIRECT, 0644);
+    if (fd >= 0) direct = 1;
+    else LOG("O_DIRECT refused <%s>, using buffered writes"CR, strerror(errno));
+  }
+  #endif
+  if (fd < 0) fd = open(path, flags, 0644);
+  if (fd < 0) {
+    LOG("record open <%s> failed <%s>"CR, path, strerror(errno));
+    return NULL;
+  }
+  #ifdef __linux__
+  if (record_prealloc_seconds > 0) {
+    off_t len = (off_t)record_prealloc_seconds * SAMPLERATE * RECORD_CHANNELS * sizeof(int16_t);
+    // KEEP_SIZE reserves the blocks without changing what readers see
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, RECORD_HEADER_BYTES + len) < 0) {
+      LOG("fallocate failed <%s>"CR, strerror(errno));
+    }
+  }
+  #endif
+  int len = strlen(path);
+  pthread_mutex_lock(&r->lock);
+  r->fd = fd;
+  r->direct = direct;
+  r->wav = !(len > 4 && strcmp(path + len - 4, ".raw") == 0);
+  snprintf(r->path, RECORD_PATH_SIZE, "%s", path);
+  r->bytes = 0;
+  atomic_store(&r->written, 0);
+  atomic_store(&r->drained, 0);
+  atomic_store(&r->overruns, 0);
+  if (r->wav) {
+    // placeholder sizes, patched in record_close
+    record_wav_header(r->block, 0);
+    if (write_all(fd, r->block, RECORD_HEADER_BYTES) < 0) {
+      LOG("record header write failed <%s>"CR, strerror(errno));
+    }
+  }
+  pthread_mutex_unlock(&r->lock);
+  LOG("record %d <%s> %s%s"CR, slot, path, r->wav ? "wav" : "raw", direct ? " direct" : "");
+  disk_thread_start();
+  return r;
+}
+
+// data_cb must have stopped writing before this is called
+void record_close(struct s_record *r) {
+  if (!r) return;
+  pthread_mutex_lock(&r->lock);
+  if (r->fd >= 0) {
+    while (record_drain_block(r, 1) > 0);
+    #ifdef O_DIRECT
+    if (r->direct) {
+      // header and tail are not aligned writes
+      fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) & ~O_DIRECT);
+    }
+    #endif
+    off_t header = r->wav ? RECORD_HEADER_BYTES : 0;
+    if (ftruncate(r->fd, header + r->bytes) < 0) {
+      LOG("record truncate failed <%s>"CR, strerror(errno));
+    }
+    if (r->wav) {
+      record_wav_header(r->block, r->bytes);
+      if (pwrite(r->fd, r->block, RECORD_HEADER_BYTES, 0) != RECORD_HEADER_BYTES) {
+        LOG("record header update failed <%s>"CR, strerror(errno));
+      }
+    }
+    LOG("record <%s> closed %lu bytes overruns:%lu"CR, r->path, r->bytes, atomic_load(&r->overruns));
+    close(r->fd);
+    r->fd = -1;
+  }
+  pthread_mutex_unlock(&r->lock);
+}
+
+// data_cb side: copy what fits, drop the rest
+void record_produce(struct s_record *r, const float *mix, int samples) {
+  uint64_t w = atomic_load_explicit(&r->written, memory_order_relaxed);
+  uint64_t d = atomic_load_explicit(&r->drained, memory_order_acquire);
+  uint64_t space = RECORD_RING_SAMPLES - (w - d);
+  int n = space < samples ? space : samples;
+  int at = w & RECORD_RING_MASK;
+  int first = n < RECORD_RING_SAMPLES - at ? n : RECORD_RING_SAMPLES - at;
+  memcpy(&r->ring[at], mix, first * sizeof(float));
+  memcpy(&r->ring[0], mix + first, (n - first) * sizeof(float));
+  // publish the samples only after they are in the ring
+  atomic_store_explicit(&r->written, w + n, memory_order_release);
+  if (n < samples) {
+    atomic_fetch_add_explicit(&r->overruns, 1, memory_order_relaxed);
+  }
+}
+
+void record_info(void) {
+  for (int i=0; i<RECORD_SLOTS; i++) {
+    struct s_record *r = atomic_load_explicit(&records[i], memory_order_relaxed);
+    if (!r || r->fd < 0) continue;
+    LOG("record:%d <%s> written:%lu drained:%lu bytes:%lu overruns:%lu"CR,
+      i, r->path,
+      atomic_load(&r->written), atomic_load(&r->drained),
+      r->bytes, atomic_load(&r->overruns));
+  }
+}
+
+// -----------------------------------------------------------
+
+// wavetables
+//
+// single cycle tables played from a uint32 phase accumulator, like the
+// DDS sketch in playground/ideas.c. an uploaded cycle is analysed once
+// and rebuilt at WT_SIZE as WT_MIPS band limited levels, level m
+// keeping the first (WT_SIZE / 2) >> m harmonics, and a voice plays
+// the most detailed level that has nothing above nyquist at its pitch.
+// lookups interpolate linearly or with a 4 point cubic, and every
+// level has guard points around it so neither has to wrap the index.
+//
+// a table lives in an s_audio, so replacing one while voices play it
+// goes through the same retire and reclaim as the bank samples. slot 0
+// is a sine, made at startup.
+
+#define WT_BITS (11)
+#define WT_SIZE (1 << WT_BITS)
+#define WT_MIPS (WT_BITS)
+#define WT_STRIDE (WT_SIZE + 4) // x[-1], x[0..WT_SIZE-1], x[WT_SIZE..WT_SIZE+2]
+#define WT_SLOTS (64)
+#define WT_CYCLE_MAX (8 * WT_SIZE) // longest cycle taken, the analysis runs on the main loop
+#define WT_FRAC_BITS (32 - WT_BITS)
+#define WT_FRAC_SCALE (1.0f / (1 << WT_FRAC_BITS))
+
+enum {
+  interp_linear = 0,
+  interp_cubic,
+  interp_count,
+};
+
+static _Atomic(struct s_audio *) wavetables[WT_SLOTS];
+
+// level m of a table, with x[-1] in front of it
+static inline const float *wt_level(const struct s_audio *t, int m) {
+  return t->buffer + m * WT_STRIDE + 1;
+}
+
+// the level for a voice moving inc a frame
+static inline int wt_mip(uint32_t inc) {
+  int m = 0;
+  while (m < WT_MIPS - 1 && (uint64_t)((WT_SIZE / 2) >> m) * inc > 0x80000000u) m++;
+  return m;
+}
+
+static inline float wt_linear(const float *x, uint32_t ph) {
+  uint32_t i = ph >> WT_FRAC_BITS;
+  float f = (ph & ((1u << WT_FRAC_BITS) - 1)) * WT_FRAC_SCALE;
+  return x[i] + f * (x[i + 1] - x[i]);
+}
+
+// catmull-rom through x[i-1] .. x[i+2]
+static inline float wt_cubic(const float *x, uint32_t ph) {
+  uint32_t i = ph >> WT_FRAC_BITS;
+  float f = (ph & ((1u << WT_FRAC_BITS) - 1)) * WT_FRAC_SCALE;
+  float xm = x[(int)i - 1], x0 = x[i], x1 = x[i + 1], x2 = x[i + 2];
+  float c1 = 0.5f * (x1 - xm);
+  float c2 = xm - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+  float c3 = 0.5f * (x2 - xm) + 1.5f * (x0 - x1);
+  return ((c3 * f + c2) * f + c1) * f + x0;
+}
+
+// analyse n samples of one cycle and make the levels, NULL if out of memory
+struct s_audio *wavetable_build(const float *cycle, int n) {
+  int harmonics = (n - 1) / 2;
+  if (harmonics > WT_SIZE / 2 - 1) harmonics = WT_SIZE / 2 - 1;
+  if (harmonics < 0) harmonics = 0;
+  double *re = calloc(harmonics + 1, sizeof(double));
+  double *im = calloc(harmonics + 1, sizeof(double));
+  double *cosine = malloc(WT_SIZE * sizeof(double));
+  float *buffer = pool_alloc(WT_MIPS * WT_STRIDE * sizeof(float));
+  struct s_audio *t = NULL;
+  if (!re || !im || !cosine || !buffer) goto done;
+  // one DFT bin per harmonic, the dc is left out
+  for (int k = 1; k <= harmonics; k++) {
+    double wr = cos(2 * M_PI * k / n), wi = -sin(2 * M_PI * k / n);
+    double zr = 1, zi = 0, ar = 0, ai = 0;
+    for (int j = 0; j < n; j++) {
+      ar += cycle[j] * zr;
+      ai += cycle[j] * zi;
+      double t = zr * wr - zi * wi;
+      zi = zr * wi + zi * wr;
+      zr = t;
+    }
+    re[k] = 2 * ar / n;
+    im[k] = 2 * ai / n;
+  }
+  for (int j = 0; j < WT_SIZE; j++) cosine[j] = cos(2 * M_PI * j / WT_SIZE);
+  for (int m = 0; m < WT_MIPS; m++) {
+    int top = (WT_SIZE / 2) >> m;
+    if (top > harmonics) top = harmonics;
+    float *x = buffer + m * WT_STRIDE + 1;
+    for (int j = 0; j < WT_SIZE; j++) {
+      double v = 0;
+      for (int k = 1; k <= top; k++) {
+        int at = (k * j) & (WT_SIZE - 1);
+        // re cos - im sin, with sin(a) = cos(a - pi/2)
+        v += re[k] * cosine[at] - im[k] * cosine[(at + 3 * WT_SIZE / 4) & (WT_SIZE - 1)];
+      }
+      x[j] = v;
+    }
+    x[-1] = x[WT_SIZE - 1];
+    x[WT_SIZE] = x[0];
+    x[WT_SIZE + 1] = x[1];
+    x[WT_SIZE + 2] = x[2];
+  }
+  t = audio_new(buffer, WT_MIPS * WT_STRIDE, 0);
+  if (t) buffer = NULL;
+done:
+  free(re);
+  free(im);
+  free(cosine);
+  pool_free(buffer);
+  return t;
+}
+
+// takes over the reference to t, voices on the old table move to the
+// new one at their next block
+void wavetable_put(int slot, struct s_audio *t) {
+  audio_unref(atomic_exchange(&wavetables[slot], t));
+}
+
+int wavetable_load(int slot, const float *cycle, int n) {
+  if (slot < 0 || slot >= WT_SLOTS || n < 1) {
+    LOG("bad table slot %d or empty cycle"CR, slot);
+    return -1;
+  }
+  // the analysis is harmonics times n, a long file would hold up the port
+  if (n > WT_CYCLE_MAX) {
+    LOG("a cycle is at most %d samples, not %d"CR, WT_CYCLE_MAX, n);
+    return -1;
+  }
+  struct s_audio *t = wavetable_build(cycle, n);
+  if (!t) return -1;
+  wavetable_put(slot, t);
+  return 0;
+}
+
+void wavetable_init(void) {
+  float *cycle = malloc(WT_SIZE * sizeof(float));
+  if (!cycle) return;
+  for (int j = 0; j < WT_SIZE; j++) cycle[j] = sin(2 * M_PI * j / WT_SIZE);
+  wavetable_load(0, cycle, WT_SIZE);
+  free(cycle);
+}
+
+void wavetable_info(void) {
+  for (int i = 0; i < WT_SLOTS; i++) {
+    struct s_audio *t = atomic_load(&wavetables[i]);
+    if (t) LOG("table:%d refs:%d bytes:%lu"CR, i, t->refs, audio_bytes(t));
+  }
+}
+
+// -----------------------------------------------------------
+
+// oscillators
+//
+// the playground's OscillatorSystem (sixteen.c, mods.c, fourteen.c)
+// made into a block renderer. voice state is kept as arrays indexed by
+// voice, and voices render SYNTH_BLOCK frames at a time: the envelope
+// moves once a block and is ramped across it, and the waveforms are
+// computed for several voices of the same kind at once, see
+// osc_lanes. only the voices that are sounding are visited.
+//
+// the engine is attached to one playback device ("synth") and only
+// that device's data_cb touches voice state. the control thread sends
+// it commands through a single producer, single consumer queue that
+// the callback drains at the start of each period. a command can carry
+// the device frame it is for ("at"), and the callback cuts the period
+// at that frame so it lands on the sample, see synth_render.
+
+#define SYNTH_VOICES (4096)
+#define SYNTH_BLOCK (64)
+#define SYNTH_QUEUE (4096) // a power of two
+
+#define SYNTH_ALIGN __attribute__((aligned(64)))
+#define SYNTH_BATCH (128) // voices rendered by one thread in one go
+#define SYNTH_BATCHES (SYNTH_VOICES / SYNTH_BATCH)
+#define SYNTH_SLICE (1024) // frames, longer periods are rendered a slice at a time
+
+enum {
+  wave_sine = 0,
+  wave_square,
+  wave_triangle,
+  wave_saw,
+  wave_pulse,
+  wave_table, // see synth_table_voice, the others go through osc_lanes
+  wave_square_bl, // polyblep
+  wave_triangle_bl, // polyblamp
+  wave_saw_bl,
+  wave_pulse_bl,
+  wave_count,
+};
+
+enum {
+  env_idle = 0,
+  env_attack,
+  env_decay,
+  env_sustain,
+  env_release,
+  env_steal, // fading out over one block for the note that took it
+  env_restart, // the fade is done, start that note
+};
+
+enum {
+  synth_osc,
+  synth_adsr,
+  synth_on,
+  synth_off,
+  synth_table,
+  synth_morph,
+  synth_lfo,
+  synth_lfo_depth,
+  synth_bus_lfo,
+  synth_route,
+  synth_poly,
+  synth_key_on,
+  synth_key_off,
+  synth_filter,
+  synth_seq, // start or stop the sequencer
+};
+
+// the polyphonic pool: voices poly_base .. poly_base + poly_count - 1
+// are handed out to keys as they come in, each starting with the patch
+// (osc, adsr, lfo, routes, tables) set on poly_base. free voices are a
+// stack and the ones holding a key a list from oldest to newest, so
+// neither a key on nor a key off looks at more than a couple of
+// voices, unless stealing the quietest, which has to compare them.
+#define SYNTH_KEYS (128)
+
+enum {
+  steal_oldest = 0,
+  steal_quietest,
+  steal_same_key, // a key played again takes back its own voice, else the oldest
+  steal_count,
+};
+
+// the modulation matrix: a voice reads up to MOD_ROUTES sources, each
+// scaled by its own depth into one destination. the bus lfos are
+// shared by every voice and worked out once a block however many
+// routes read them, the voice lfo and envelope once a voice.
+#define MOD_LFOS (8)
+#define MOD_ROUTES (4)
+
+enum {
+  mod_voice_lfo = 0,
+  mod_envelope,
+  mod_bus, // mod_bus + n is bus lfo n
+  mod_sources = mod_bus + MOD_LFOS,
+};
+
+enum {
+  mod_pitch = 0, // octaves
+  mod_amp, // gain times 1 + this
+  mod_width,
+  mod_morph,
+  mod_cutoff, // octaves
+  mod_dests,
+};
+
+struct s_route {
+  uint8_t source;
+  uint8_t dest;
+  float depth;
+};
+
+// the step sequencer: tracks of steps that data_cb plays on the device
+// clock, see seq_run, so the tempo holds however busy the BEAM is. a
+// track plays one voice, which keeps its own patch, and a step is a
+// note, how hard, how long, and parameter locks, values the voice
+// takes for that step alone. each track goes round at its own length.
+// patterns are edited on the control thread and handed over through a
+// triple buffer that the callback only looks at on the first step of
+// a bar, so a new pattern always starts on a bar.
+//
+// steps only play synth voices. bank slots can't be sequenced: their
+// audio is looked up and counted on the control thread (see cache_get)
+// and a device plays one at a time, so nothing here can start one on
+// a step's frame.
+#define SEQ_TRACKS (16)
+#define SEQ_STEPS (64)
+
+enum {
+  lock_cutoff = 0, // Hz
+  lock_resonance, // 0..4
+  lock_morph,
+  lock_width,
+  lock_count,
+};
+
+struct s_seq_step {
+  int8_t note; // midi, -1 for a rest
+  uint8_t locked; // 1 << lock_ for each lock the step has
+  float velocity;
+  float gate; // steps until the note off, 0 holds it to the next note
+  float lock[lock_count];
+};
+
+struct s_seq_track {
+  int16_t voice; // -1 when the track is off
+  int16_t length; // steps before it goes round
+  struct s_seq_step step[SEQ_STEPS];
+};
+
+struct s_pattern {
+  float bpm;
+  float swing; // the odd steps of a bar are late by this much of a step
+  int steps_per_beat;
+  int steps_per_bar;
+  struct s_seq_track track[SEQ_TRACKS];
+};
+
+struct s_seq {
+  struct s_pattern pattern[3]; // see struct s_triple
+  struct s_pattern edit; // control thread's copy
+  struct s_triple tb;
+  // the rest is only data_cb's
+  int playing;
+  struct s_pattern *play; // NULL until the first step
+  unsigned front; // the copy play is
+  uint64_t step; // the next one to play, counted from the start
+  uint64_t next; // frame it goes out on
+  uint64_t first; // step the pattern came in on, the tracks count from it
+  uint64_t bar; // step the bar started on
+  int bar_left; // steps to the next bar
+  double origin; // frame of origin_step, without swing
+  uint64_t origin_step;
+  double step_frames;
+  int16_t held[SEQ_TRACKS]; // voice still playing the track's note, -1 for none
+  uint64_t off[SEQ_TRACKS]; // frame its note off is due, UINT64_MAX held to the next note
+  uint8_t saved[SEQ_TRACKS]; // locks the track has put on its voice, the voice's own values in base
+  float base[SEQ_TRACKS][lock_count];
+  uint64_t swaps; // patterns taken up
+  uint64_t last; // s->now where the last period left off, see seq_clock
+};
+
+struct s_synth_cmd {
+  uint8_t op;
+  uint16_t voice;
+  float v[4];
+  uint64_t at; // device frame it is for, 0 for as soon as it is taken
+};
+
+static struct s_synth {
+  uint32_t phase[SYNTH_VOICES] SYNTH_ALIGN; // a whole cycle is 2^32
+  uint32_t inc[SYNTH_VOICES] SYNTH_ALIGN; // per frame
+  float amp[SYNTH_VOICES] SYNTH_ALIGN;
+  float velocity[SYNTH_VOICES] SYNTH_ALIGN; // of the key that started it
+  float width[SYNTH_VOICES] SYNTH_ALIGN; // of the pulse, 0..1
+  float level[SYNTH_VOICES] SYNTH_ALIGN; // envelope
+  float attack[SYNTH_VOICES] SYNTH_ALIGN; // envelope steps per frame
+  float decay[SYNTH_VOICES] SYNTH_ALIGN;
+  float sustain[SYNTH_VOICES] SYNTH_ALIGN;
+  float release[SYNTH_VOICES] SYNTH_ALIGN; // in frames, made into fall at note off
+  float fall[SYNTH_VOICES] SYNTH_ALIGN;
+  float morph[SYNTH_VOICES] SYNTH_ALIGN; // from table_a to table_b
+  // the ladder filter, see ladder_c
+  float cutoff[SYNTH_VOICES] SYNTH_ALIGN; // Hz, 0 for none
+  float resonance[SYNTH_VOICES] SYNTH_ALIGN; // 0..4
+  float ladder_hz[SYNTH_VOICES] SYNTH_ALIGN; // the cutoff ladder_g was worked out for, 0 to start over
+  float ladder_g[SYNTH_VOICES] SYNTH_ALIGN; // at the end of the last block
+  float ladder[SYNTH_VOICES][4];
+  // one lfo a voice, see synth_control
+  uint32_t lfo_phase[SYNTH_VOICES] SYNTH_ALIGN;
+  uint32_t lfo_inc[SYNTH_VOICES] SYNTH_ALIGN; // per frame
+  float lfo_value[SYNTH_VOICES] SYNTH_ALIGN; // at the end of the last block
+  float lfo_pitch[SYNTH_VOICES] SYNTH_ALIGN; // octaves at full swing
+  float lfo_amp[SYNTH_VOICES] SYNTH_ALIGN; // 0..1
+  float lfo_width[SYNTH_VOICES] SYNTH_ALIGN;
+  uint8_t lfo_wave[SYNTH_VOICES];
+  uint8_t lfo_on[SYNTH_VOICES]; // any of the depths set, or a route from it
+  struct s_route route[SYNTH_VOICES][MOD_ROUTES];
+  uint8_t routes[SYNTH_VOICES];
+  int16_t key_voice[SYNTH_KEYS]; // -1 when none
+  int16_t voice_key[SYNTH_VOICES]; // -1 when not handed out
+  int16_t older[SYNTH_VOICES]; // the age list, -1 at the ends
+  int16_t newer[SYNTH_VOICES];
+  int oldest, newest;
+  uint16_t free_voice[SYNTH_VOICES];
+  int free_count;
+  int poly_base, poly_count, steal;
+  uint32_t next_inc[SYNTH_VOICES]; // the note waiting for a stolen voice
+  float next_amp[SYNTH_VOICES];
+  uint64_t stolen;
+  // the bus, each lfo at the start and end of every block in the slice
+  uint32_t bus_phase[MOD_LFOS];
+  uint32_t bus_inc[MOD_LFOS];
+  uint8_t bus_wave[MOD_LFOS];
+  float bus_from[SYNTH_SLICE / SYNTH_BLOCK][MOD_LFOS];
+  float bus_to[SYNTH_SLICE / SYNTH_BLOCK][MOD_LFOS];
+  float bus_value[MOD_LFOS]; // at the end of the last slice
+  // what each batch of voices made of the slice, see synth_render
+  float batch_mix[SYNTH_BATCHES][SYNTH_SLICE] SYNTH_ALIGN;
+  uint8_t wave[SYNTH_VOICES];
+  uint8_t stage[SYNTH_VOICES];
+  uint8_t table_a[SYNTH_VOICES];
+  uint8_t table_b[SYNTH_VOICES];
+  uint8_t interp[SYNTH_VOICES];
+  // the sounding voices in no particular order, and where each one is
+  uint16_t active[SYNTH_VOICES];
+  int16_t slot[SYNTH_VOICES]; // -1 when silent
+  int active_count;
+  float rate; // of the device it is attached to
+  struct s_synth_cmd queue[SYNTH_QUEUE];
+  atomic_uint head; // only the control thread writes this
+  atomic_uint tail; // only data_cb writes this
+  // what data_cb has taken off the queue, in the order it is due
+  struct s_synth_cmd pending[SYNTH_QUEUE];
+  int pending_first, pending_count;
+  struct s_seq seq;
+  uint64_t now; // device frame the next one rendered goes out on, only data_cb
+  uint64_t stamp; // the "at" synth_send puts on commands, only the control thread
+  atomic_int sounding; // active_count, for dump
+  atomic_uint_fast64_t blocks;
+  atomic_uint_fast64_t late; // commands taken after their frame had gone out
+  uint64_t dropped; // queue was full
+} synth;
+
+void seq_init(struct s_seq *q) {
+  q->edit = (struct s_pattern){.bpm = 120, .steps_per_beat = 4, .steps_per_bar = 16};
+  for (int t = 0; t < SEQ_TRACKS; t++) {
+    q->edit.track[t].voice = -1;
+    q->edit.track[t].length = 16;
+    for (int i = 0; i < SEQ_STEPS; i++) q->edit.track[t].step[i].note = -1;
+    q->held[t] = -1;
+  }
+  for (int i = 0; i < 3; i++) q->pattern[i] = q->edit;
+  triple_init(&q->tb);
+}
+
+// control thread: the edited pattern goes out, and plays from the next bar
+void seq_publish(struct s_seq *q) {
+  q->pattern[q->tb.back] = q->edit;
+  triple_publish(&q->tb);
+}
+
+void synth_init(struct s_synth *s, float rate) {
+  memset(s, 0, sizeof *s);
+  seq_init(&s->seq);
+  s->rate = rate;
+  for (int v = 0; v < SYNTH_VOICES; v++) {
+    s->amp[v] = 1;
+    s->velocity[v] = 1;
+    s->width[v] = 0.5;
+    s->sustain[v] = 1;
+    s->attack[v] = 1;
+    s->decay[v] = 1;
+    s->slot[v] = -1;
+    s->voice_key[v] = -1;
+  }
+  for (int k = 0; k < SYNTH_KEYS; k++) s->key_voice[k] = -1;
+  s->oldest = s->newest = -1;
+}
+
+// a phase increment or a per frame step worked out at one rate, at another
+static uint32_t synth_rescale_inc(uint32_t inc, double by) {
+  double x = inc * by;
+  return x < 2147483647.0 ? (uint32_t)x : 2147483647u; // nyquist, as phase_inc
+}
+
+// control thread, with the synth off every device: move what was worked
+// out at the old rate to a new one, so a voice keeps its pitch, lfos and
+// envelope times on a device that runs at another rate
+void synth_rate(struct s_synth *s, float rate) {
+  if (rate == s->rate) return;
+  double by = s->rate / rate;
+  for (int v = 0; v < SYNTH_VOICES; v++) {
+    s->inc[v] = synth_rescale_inc(s->inc[v], by);
+    s->next_inc[v] = synth_rescale_inc(s->next_inc[v], by);
+    s->lfo_inc[v] = synth_rescale_inc(s->lfo_inc[v], by);
+    // a step of 1 or more is an envelope stage with no time, it stays that way
+    if (s->attack[v] < 1) s->attack[v] *= by;
+    if (s->decay[v] < 1) s->decay[v] *= by;
+    if (s->fall[v] < 1) s->fall[v] *= by;
+    s->release[v] /= by;
+    s->ladder_hz[v] = 0; // ladder_g again at the new rate
+  }
+  for (int l = 0; l < MOD_LFOS; l++) s->bus_inc[l] = synth_rescale_inc(s->bus_inc[l], by);
+  // the steps to come go at the new rate from the next one on
+  s->seq.origin += (double)(s->seq.step - s->seq.origin_step) * s->seq.step_frames;
+  s->seq.origin_step = s->seq.step;
+  s->seq.step_frames /= by;
+  s->rate = rate;
+}
+
+// sin(2 pi p) for p in 0..1 without a call, good to about 4e-6
+#define SIN_C0 (3.14159265f)
+#define SIN_C1 (-5.16771278f)
+#define SIN_C2 (2.55016404f)
+#define SIN_C3 (-0.59926453f)
+#define SIN_C4 (0.08214589f)
+
+static inline float sin_turn(float p) {
+  float x = 1.0f - 2.0f * p; // sin(2 pi p) = sin(pi x)
+  float a = fabsf(x);
+  float y = 0.5f - fabsf(0.5f - a); // sin(pi a) = sin(pi y), y in 0..0.5
+  float y2 = y * y;
+  float r = y * (SIN_C0 + y2 * (SIN_C1 + y2 * (SIN_C2 + y2 * (SIN_C3 + y2 * SIN_C4))));
+  return copysignf(r, x);
+}
+
+// phases are uint32 accumulators that wrap by themselves. the top 24
+// bits make an exact float in 0..1 for the waveform.
+#define PHASE_SCALE (1.0f / 16777216.0f)
+
+static inline uint32_t phase_inc(float hz, float rate) {
+  double x = hz / rate;
+  if (x > 0.5) x = 0.5; // nyquist
+  return (uint32_t)(x * 4294967295.0);
+}
+
+// voices are rendered OSC_LANES at a time, all with the same waveform,
+// one voice to a SIMD lane. the kernels add lane k of frame i to
+// acc[i * OSC_LANES + k] and synth_render sums the lanes once at the
+// end of the block. unused lanes have no gain. gain, pitch and width
+// are linear ramps across the block, see synth_control. every kernel does the
+// same float operations in the same order as osc_lanes_c, so they all
+// make the same bits; there is no FMA on purpose, and the compiler
+// mustn't contract one in either (FP_CONTRACT at the top).
+
+#define OSC_LANES (8)
+
+struct s_lanes {
+  uint32_t phase[OSC_LANES];
+  uint32_t inc[OSC_LANES]; // at the first frame
+  int32_t dinc[OSC_LANES]; // and how much it changes each frame
+  float width[OSC_LANES];
+  float dwidth[OSC_LANES];
+  float g[OSC_LANES]; // gain at the first frame
+  float dg[OSC_LANES]; // and how much it changes each frame
+  uint16_t voice[OSC_LANES];
+  int count;
+  // lanes of filtered voices render at unit gain and the ladder applies
+  // g and dg after it, see ladder_c
+  float cut[OSC_LANES]; // the ladder's G at the first frame
+  float dcut[OSC_LANES]; // and how much it changes each frame
+  float res[OSC_LANES]; // feedback, 0..4
+  float z[4][OSC_LANES]; // the state of each stage
+};
+
+typedef void (*osc_lanes_fn)(int wave, const struct s_lanes *l, float *acc, int n);
+typedef void (*ladder_fn)(struct s_lanes *l, const float *in, float *acc, int n);
+
+// the _bl waves take the naive shape and smooth each edge over the
+// sample either side of it: a polynomial step residual (polyblep) where
+// the wave jumps and its integral (polyblamp) where only the slope
+// does. t is the phase since the edge, dt the phase a frame moves and
+// inv its reciprocal, 0 for a voice that doesn't move.
+
+static inline float blep_c(float t, float dt, float inv) {
+  if (t < dt) {
+    float x = t * inv;
+    return x + x - x * x - 1.0f;
+  }
+  if (t > 1.0f - dt) {
+    float x = (t - 1.0f) * inv;
+    return x * x + x + x + 1.0f;
+  }
+  return 0;
+}
+
+static inline float blamp_c(float t, float dt, float inv) {
+  if (t < dt) {
+    float r = 1.0f - t * inv;
+    return r * r * r * (1.0f / 6);
+  }
+  if (t > 1.0f - dt) {
+    float r = 1.0f + (t - 1.0f) * inv;
+    return r * r * r * (1.0f / 6);
+  }
+  return 0;
+}
+
+static inline float frac_c(float x) {
+  return x - (int)x;
+}
+
+static inline float osc_c(int wave, float p, float width, float dt, float inv) {
+  switch (wave) {
+    case wave_sine:
+      return sin_turn(p);
+    case wave_square:
+      return p < 0.5f ? 1.0f : -1.0f;
+    case wave_triangle:
+      return 4.0f * fabsf(p - 0.5f) - 1.0f;
+    case wave_saw: {
+      float q = frac_c(p + 0.5f); // 2 (p - floor(p + 0.5))
+      return 2.0f * q - 1.0f;
+    }
+    case wave_pulse:
+      return p < width ? 1.0f : -1.0f;
+    case wave_square_bl: {
+      // up at 0, down at 0.5
+      float q = frac_c(p + 0.5f);
+      return (p < 0.5f ? 1.0f : -1.0f) + blep_c(p, dt, inv) - blep_c(q, dt, inv);
+    }
+    case wave_triangle_bl: {
+      // the slope goes from 4 to -4 at 0 and back at 0.5
+      float q = frac_c(p + 0.5f);
+      return 4.0f * fabsf(p - 0.5f) - 1.0f + (blamp_c(q, dt, inv) - blamp_c(p, dt, inv)) * (8.0f * dt);
+    }
+    case wave_saw_bl: {
+      float q = frac_c(p + 0.5f);
+      return 2.0f * q - 1.0f - blep_c(q, dt, inv);
+    }
+    case wave_pulse_bl: {
+      float q = frac_c(p + (1.0f - width));
+      return (p < width ? 1.0f : -1.0f) + blep_c(p, dt, inv) - blep_c(q, dt, inv);
+    }
+  }
+  return 0;
+}
+
+// the edges are smoothed for the pitch at the start of the block
+static void osc_lanes_c(int wave, const struct s_lanes *l, float *acc, int n) {
+  uint32_t phase[OSC_LANES], inc[OSC_LANES];
+  float dt[OSC_LANES], inv[OSC_LANES];
+  for (int k = 0; k < OSC_LANES; k++) {
+    phase[k] = l->phase[k];
+    inc[k] = l->inc[k];
+    dt[k] = (l->inc[k] >> 8) * PHASE_SCALE;
+    inv[k] = dt[k] > 0 ? 1.0f / dt[k] : 0;
+  }
+  for (int i = 0; i < n; i++) {
+    float fi = i;
+    for (int k = 0; k < OSC_LANES; k++) {
+      float p = (phase[k] >> 8) * PHASE_SCALE;
+      float width = l->width[k] + l->dwidth[k] * fi;
+      acc[i * OSC_LANES + k] += osc_c(wave, p, width, dt[k], inv[k]) * (l->g[k] + l->dg[k] * fi);
+      phase[k] += inc[k];
+      inc[k] += (uint32_t)l->dinc[k];
+    }
+  }
+}
+
+#ifdef EXA_X86
+
+static inline __m128 frac_sse2(__m128 x) {
+  return _mm_sub_ps(x, _mm_cvtepi32_ps(_mm_cvttps_epi32(x)));
+}
+
+static inline __m128 sin_turn_sse2(__m128 p) {
+  __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128 x = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(2.0f), p));
+  __m128 a = _mm_andnot_ps(sign, x);
+  __m128 y = _mm_sub_ps(half, _mm_andnot_ps(sign, _mm_sub_ps(half, a)));
+  __m128 y2 = _mm_mul_ps(y, y);
+  __m128 r = _mm_add_ps(_mm_set1_ps(SIN_C3), _mm_mul_ps(y2, _mm_set1_ps(SIN_C4)));
+  r = _mm_add_ps(_mm_set1_ps(SIN_C2), _mm_mul_ps(y2, r));
+  r = _mm_add_ps(_mm_set1_ps(SIN_C1), _mm_mul_ps(y2, r));
+  r = _mm_add_ps(_mm_set1_ps(SIN_C0), _mm_mul_ps(y2, r));
+  r = _mm_mul_ps(y, r);
+  return _mm_or_ps(r, _mm_and_ps(sign, x));
+}
+
+// 1 where mask is set, -1 where it isn't
+static inline __m128 sign_of_sse2(__m128 mask) {
+  __m128 one = _mm_set1_ps(1.0f);
+  return _mm_or_ps(_mm_and_ps(mask, one), _mm_andnot_ps(mask, _mm_set1_ps(-1.0f)));
+}
+
+// a where m1, else b where m2, else 0
+static inline __m128 pick_sse2(__m128 m1, __m128 a, __m128 m2, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(m1, a), _mm_andnot_ps(m1, _mm_and_ps(m2, b)));
+}
+
+static inline __m128 blep_sse2(__m128 t, __m128 dt, __m128 inv) {
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 x = _mm_mul_ps(t, inv);
+  __m128 a = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(x, x), _mm_mul_ps(x, x)), one);
+  __m128 y = _mm_mul_ps(_mm_sub_ps(t, one), inv);
+  __m128 b = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(y, y), y), y), one);
+  return pick_sse2(_mm_cmplt_ps(t, dt), a, _mm_cmpgt_ps(t, _mm_sub_ps(one, dt)), b);
+}
+
+static inline __m128 blamp_sse2(__m128 t, __m128 dt, __m128 inv) {
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 sixth = _mm_set1_ps(1.0f / 6);
+  __m128 r = _mm_sub_ps(one, _mm_mul_ps(t, inv));
+  __m128 a = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(r, r), r), sixth);
+  __m128 s = _mm_add_ps(one, _mm_mul_ps(_mm_sub_ps(t, one), inv));
+  __m128 b = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(s, s), s), sixth);
+  return pick_sse2(_mm_cmplt_ps(t, dt), a, _mm_cmpgt_ps(t, _mm_sub_ps(one, dt)), b);
+}
+
+static inline __m128 osc_sse2(int wave, __m128 p, __m128 width, __m128 dt, __m128 inv) {
+  switch (wave) {
+    case wave_sine:
+      return sin_turn_sse2(p);
+    case wave_square:
+      return sign_of_sse2(_mm_cmplt_ps(p, _mm_set1_ps(0.5f)));
+    case wave_triangle: {
+      __m128 d = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(p, _mm_set1_ps(0.5f)));
+      return _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(4.0f), d), _mm_set1_ps(1.0f));
+    }
+    case wave_saw: {
+      __m128 q = frac_sse2(_mm_add_ps(p, _mm_set1_ps(0.5f)));
+      return _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), q), _mm_set1_ps(1.0f));
+    }
+    case wave_pulse:
+      return sign_of_sse2(_mm_cmplt_ps(p, width));
+    case wave_square_bl: {
+      __m128 q = frac_sse2(_mm_add_ps(p, _mm_set1_ps(0.5f)));
+      __m128 x = sign_of_sse2(_mm_cmplt_ps(p, _mm_set1_ps(0.5f)));
+      return _mm_sub_ps(_mm_add_ps(x, blep_sse2(p, dt, inv)), blep_sse2(q, dt, inv));
+    }
+    case wave_triangle_bl: {
+      __m128 q = frac_sse2(_mm_add_ps(p, _mm_set1_ps(0.5f)));
+      __m128 d = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(p, _mm_set1_ps(0.5f)));
+      __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(4.0f), d), _mm_set1_ps(1.0f));
+      __m128 c = _mm_sub_ps(blamp_sse2(q, dt, inv), blamp_sse2(p, dt, inv));
+      return _mm_add_ps(x, _mm_mul_ps(c, _mm_mul_ps(_mm_set1_ps(8.0f), dt)));
+    }
+    case wave_saw_bl: {
+      __m128 q = frac_sse2(_mm_add_ps(p, _mm_set1_ps(0.5f)));
+      __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), q), _mm_set1_ps(1.0f));
+      return _mm_sub_ps(x, blep_sse2(q, dt, inv));
+    }
+    case wave_pulse_bl: {
+      __m128 q = frac_sse2(_mm_add_ps(p, _mm_sub_ps(_mm_set1_ps(1.0f), width)));
+      __m128 x = sign_of_sse2(_mm_cmplt_ps(p, width));
+      return _mm_sub_ps(_mm_add_ps(x, blep_sse2(p, dt, inv)), blep_sse2(q, dt, inv));
+    }
+  }
+  return _mm_setzero_ps();
+}
+
+// two halves of four lanes
+static void osc_lanes_sse2(int wave, const struct s_lanes *l, float *acc, int n) {
+  for (int h = 0; h < OSC_LANES; h += 4) {
+    __m128i phase = _mm_loadu_si128((const __m128i *)&l->phase[h]);
+    __m128i inc = _mm_loadu_si128((const __m128i *)&l->inc[h]);
+    __m128i dinc = _mm_loadu_si128((const __m128i *)&l->dinc[h]);
+    __m128 width = _mm_loadu_ps(&l->width[h]);
+    __m128 dwidth = _mm_loadu_ps(&l->dwidth[h]);
+    __m128 g = _mm_loadu_ps(&l->g[h]);
+    __m128 dg = _mm_loadu_ps(&l->dg[h]);
+    __m128 dt = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(inc, 8)), _mm_set1_ps(PHASE_SCALE));
+    __m128 inv = _mm_and_ps(_mm_cmpgt_ps(dt, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), dt));
+    __m128 fi = _mm_setzero_ps();
+    for (int i = 0; i < n; i++) {
+      __m128 p = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(phase, 8)), _mm_set1_ps(PHASE_SCALE));
+      __m128 w = _mm_add_ps(width, _mm_mul_ps(dwidth, fi));
+      __m128 y = _mm_mul_ps(osc_sse2(wave, p, w, dt, inv), _mm_add_ps(g, _mm_mul_ps(dg, fi)));
+      float *out = &acc[i * OSC_LANES + h];
+      _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), y));
+      phase = _mm_add_epi32(phase, inc);
+      inc = _mm_add_epi32(inc, dinc);
+      fi = _mm_add_ps(fi, _mm_set1_ps(1.0f));
+    }
+  }
+}
+
+AVX2 static inline __m256 frac_avx2(__m256 x) {
+  return _mm256_sub_ps(x, _mm256_cvtepi32_ps(_mm256_cvttps_epi32(x)));
+}
+
+AVX2 static inline __m256 sin_turn_avx2(__m256 p) {
+  __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 x = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), p));
+  __m256 a = _mm256_andnot_ps(sign, x);
+  __m256 y = _mm256_sub_ps(half, _mm256_andnot_ps(sign, _mm256_sub_ps(half, a)));
+  __m256 y2 = _mm256_mul_ps(y, y);
+  __m256 r = _mm256_add_ps(_mm256_set1_ps(SIN_C3), _mm256_mul_ps(y2, _mm256_set1_ps(SIN_C4)));
+  r = _mm256_add_ps(_mm256_set1_ps(SIN_C2), _mm256_mul_ps(y2, r));
+  r = _mm256_add_ps(_mm256_set1_ps(SIN_C1), _mm256_mul_ps(y2, r));
+  r = _mm256_add_ps(_mm256_set1_ps(SIN_C0), _mm256_mul_ps(y2, r));
+  r = _mm256_mul_ps(y, r);
+  return _mm256_or_ps(r, _mm256_and_ps(sign, x));
+}
+
+AVX2 static inline __m256 sign_of_avx2(__m256 mask) {
+  return _mm256_blendv_ps(_mm256_set1_ps(-1.0f), _mm256_set1_ps(1.0f), mask);
+}
+
+AVX2 static inline __m256 pick_avx2(__m256 m1, __m256 a, __m256 m2, __m256 b) {
+  return _mm256_blendv_ps(_mm256_and_ps(m2, b), a, m1);
+}
+
+AVX2 static inline __m256 blep_avx2(__m256 t, __m256 dt, __m256 inv) {
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 x = _mm256_mul_ps(t, inv);
+  __m256 a = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(x, x), _mm256_mul_ps(x, x)), one);
+  __m256 y = _mm256_mul_ps(_mm256_sub_ps(t, one), inv);
+  __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, y), y), y), one);
+  return pick_avx2(_mm256_cmp_ps(t, dt, _CMP_LT_OQ), a,
+    _mm256_cmp_ps(t, _mm256_sub_ps(one, dt), _CMP_GT_OQ), b);
+}
+
+AVX2 static inline __m256 blamp_avx2(__m256 t, __m256 dt, __m256 inv) {
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 sixth = _mm256_set1_ps(1.0f / 6);
+  __m256 r = _mm256_sub_ps(one, _mm256_mul_ps(t, inv));
+  __m256 a = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(r, r), r), sixth);
+  __m256 s = _mm256_add_ps(one, _mm256_mul_ps(_mm256_sub_ps(t, one), inv));
+  __m256 b = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(s, s), s), sixth);
+  return pick_avx2(_mm256_cmp_ps(t, dt, _CMP_LT_OQ), a,
+    _mm256_cmp_ps(t, _mm256_sub_ps(one, dt), _CMP_GT_OQ), b);
+}
+
+AVX2 static inline __m256 osc_avx2(int wave, __m256 p, __m256 width, __m256 dt, __m256 inv) {
+  switch (wave) {
+    case wave_sine:
+      return sin_turn_avx2(p);
+    case wave_square:
+      return sign_of_avx2(_mm256_cmp_ps(p, _mm256_set1_ps(0.5f), _CMP_LT_OQ));
+    case wave_triangle: {
+      __m256 d = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(p, _mm256_set1_ps(0.5f)));
+      return _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f), d), _mm256_set1_ps(1.0f));
+    }
+    case wave_saw: {
+      __m256 q = frac_avx2(_mm256_add_ps(p, _mm256_set1_ps(0.5f)));
+      return _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), q), _mm256_set1_ps(1.0f));
+    }
+    case wave_pulse:
+      return sign_of_avx2(_mm256_cmp_ps(p, width, _CMP_LT_OQ));
+    case wave_square_bl: {
+      __m256 q = frac_avx2(_mm256_add_ps(p, _mm256_set1_ps(0.5f)));
+      __m256 x = sign_of_avx2(_mm256_cmp_ps(p, _mm256_set1_ps(0.5f), _CMP_LT_OQ));
+      return _mm256_sub_ps(_mm256_add_ps(x, blep_avx2(p, dt, inv)), blep_avx2(q, dt, inv));
+    }
+    case wave_triangle_bl: {
+      __m256 q = frac_avx2(_mm256_add_ps(p, _mm256_set1_ps(0.5f)));
+      __m256 d = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(p, _mm256_set1_ps(0.5f)));
+      __m256 x = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f), d), _mm256_set1_ps(1.0f));
+      __m256 c = _mm256_sub_ps(blamp_avx2(q, dt, inv), blamp_avx2(p, dt, inv));
+      return _mm256_add_ps(x, _mm256_mul_ps(c, _mm256_mul_ps(_mm256_set1_ps(8.0f), dt)));
+    }
+    case wave_saw_bl: {
+      __m256 q = frac_avx2(_mm256_add_ps(p, _mm256_set1_ps(0.5f)));
+      __m256 x = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), q), _mm256_set1_ps(1.0f));
+      return _mm256_sub_ps(x, blep_avx2(q, dt, inv));
+    }
+    case wave_pulse_bl: {
+      __m256 q = frac_avx2(_mm256_add_ps(p, _mm256_sub_ps(_mm256_set1_ps(1.0f), width)));
+      __m256 x = sign_of_avx2(_mm256_cmp_ps(p, width, _CMP_LT_OQ));
+      return _mm256_sub_ps(_mm256_add_ps(x, blep_avx2(p, dt, inv)), blep_avx2(q, dt, inv));
+    }
+  }
+  return _mm256_setzero_ps();
+}
+
+AVX2 static void osc_lanes_avx2(int wave, const struct s_lanes *l, float *acc, int n) {
+  __m256i phase = _mm256_loadu_si256((const __m256i *)l->phase);
+  __m256i inc = _mm256_loadu_si256((const __m256i *)l->inc);
+  __m256i dinc = _mm256_loadu_si256((const __m256i *)l->dinc);
+  __m256 width = _mm256_loadu_ps(l->width);
+  __m256 dwidth = _mm256_loadu_ps(l->dwidth);
+  __m256 g = _mm256_loadu_ps(l->g);
+  __m256 dg = _mm256_loadu_ps(l->dg);
+  __m256 dt = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(inc, 8)), _mm256_set1_ps(PHASE_SCALE));
+  __m256 inv = _mm256_and_ps(_mm256_cmp_ps(dt, _mm256_setzero_ps(), _CMP_GT_OQ),
+    _mm256_div_ps(_mm256_set1_ps(1.0f), dt));
+  __m256 fi = _mm256_setzero_ps();
+  for (int i = 0; i < n; i++) {
+    __m256 p = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(phase, 8)), _mm256_set1_ps(PHASE_SCALE));
+    __m256 w = _mm256_add_ps(width, _mm256_mul_ps(dwidth, fi));
+    __m256 y = _mm256_mul_ps(osc_avx2(wave, p, w, dt, inv), _mm256_add_ps(g, _mm256_mul_ps(dg, fi)));
+    float *out = &acc[i * OSC_LANES];
+    _mm256_storeu_ps(out, _mm256_add_ps(_mm256_loadu_ps(out), y));
+    phase = _mm256_add_epi32(phase, inc);
+    inc = _mm256_add_epi32(inc, dinc);
+    fi = _mm256_add_ps(fi, _mm256_set1_ps(1.0f));
+  }
+}
+
+#endif // EXA_X86
+
+#ifdef EXA_NEON
+
+static inline float32x4_t frac_neon(float32x4_t x) {
+  return vsubq_f32(x, vcvtq_f32_s32(vcvtq_s32_f32(x)));
+}
+
+static inline float32x4_t sin_turn_neon(float32x4_t p) {
+  float32x4_t half = vdupq_n_f32(0.5f);
+  float32x4_t x = vsubq_f32(vdupq_n_f32(1.0f), vmulq_n_f32(p, 2.0f));
+  float32x4_t y = vsubq_f32(half, vabsq_f32(vsubq_f32(half, vabsq_f32(x))));
+  float32x4_t y2 = vmulq_f32(y, y);
+  float32x4_t r = vaddq_f32(vdupq_n_f32(SIN_C3), vmulq_n_f32(y2, SIN_C4));
+  r = vaddq_f32(vdupq_n_f32(SIN_C2), vmulq_f32(y2, r));
+  r = vaddq_f32(vdupq_n_f32(SIN_C1), vmulq_f32(y2, r));
+  r = vaddq_f32(vdupq_n_f32(SIN_C0), vmulq_f32(y2, r));
+  r = vmulq_f32(y, r);
+  uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000));
+  return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(r), sign));
+}
+
+static inline float32x4_t pick_neon(uint32x4_t m1, float32x4_t a, uint32x4_t m2, float32x4_t b) {
+  return vbslq_f32(m1, a, vbslq_f32(m2, b, vdupq_n_f32(0)));
+}
+
+static inline float32x4_t blep_neon(float32x4_t t, float32x4_t dt, float32x4_t inv) {
+  float32x4_t one = vdupq_n_f32(1.0f);
+  float32x4_t x = vmulq_f32(t, inv);
+  float32x4_t a = vsubq_f32(vsubq_f32(vaddq_f32(x, x), vmulq_f32(x, x)), one);
+  float32x4_t y = vmulq_f32(vsubq_f32(t, one), inv);
+  float32x4_t b = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(y, y), y), y), one);
+  return pick_neon(vcltq_f32(t, dt), a, vcgtq_f32(t, vsubq_f32(one, dt)), b);
+}
+
+static inline float32x4_t blamp_neon(float32x4_t t, float32x4_t dt, float32x4_t inv) {
+  float32x4_t one = vdupq_n_f32(1.0f);
+  float32x4_t r = vsubq_f32(one, vmulq_f32(t, inv));
+  float32x4_t a = vmulq_n_f32(vmulq_f32(vmulq_f32(r, r), r), 1.0f / 6);
+  float32x4_t s = vaddq_f32(one, vmulq_f32(vsubq_f32(t, one), inv));
+  float32x4_t b = vmulq_n_f32(vmulq_f32(vmulq_f32(s, s), s), 1.0f / 6);
+  return pick_neon(vcltq_f32(t, dt), a, vcgtq_f32(t, vsubq_f32(one, dt)), b);
+}
+
+static inline float32x4_t osc_neon(int wave, float32x4_t p, float32x4_t width, float32x4_t dt, float32x4_t inv) {
+  float32x4_t one = vdupq_n_f32(1.0f);
+  float32x4_t minus_one = vdupq_n_f32(-1.0f);
+  switch (wave) {
+    case wave_sine:
+      return sin_turn_neon(p);
+    case wave_square:
+      return vbslq_f32(vcltq_f32(p, vdupq_n_f32(0.5f)), one, minus_one);
+    case wave_triangle:
+      return vsubq_f32(vmulq_n_f32(vabsq_f32(vsubq_f32(p, vdupq_n_f32(0.5f))), 4.0f), one);
+    case wave_saw:
+      return vsubq_f32(vmulq_n_f32(frac_neon(vaddq_f32(p, vdupq_n_f32(0.5f))), 2.0f), one);
+    case wave_pulse:
+      return vbslq_f32(vcltq_f32(p, width), one, minus_one);
+    case wave_square_bl: {
+      float32x4_t q = frac_neon(vaddq_f32(p, vdupq_n_f32(0.5f)));
+      float32x4_t x = vbslq_f32(vcltq_f32(p, vdupq_n_f32(0.5f)), one, minus_one);
+      return vsubq_f32(vaddq_f32(x, blep_neon(p, dt, inv)), blep_neon(q, dt, inv));
+    }
+    case wave_triangle_bl: {
+      float32x4_t q = frac_neon(vaddq_f32(p, vdupq_n_f32(0.5f)));
+      float32x4_t x = vsubq_f32(vmulq_n_f32(vabsq_f32(vsubq_f32(p, vdupq_n_f32(0.5f))), 4.0f), one);
+      float32x4_t c = vsubq_f32(blamp_neon(q, dt, inv), blamp_neon(p, dt, inv));
+      return vaddq_f32(x, vmulq_f32(c, vmulq_n_f32(dt, 8.0f)));
+    }
+    case wave_saw_bl: {
+      float32x4_t q = frac_neon(vaddq_f32(p, vdupq_n_f32(0.5f)));
+      return vsubq_f32(vsubq_f32(vmulq_n_f32(q, 2.0f), one), blep_neon(q, dt, inv));
+    }
+    case wave_pulse_bl: {
+      float32x4_t q = frac_neon(vaddq_f32(p, vsubq_f32(one, width)));
+      float32x4_t x = vbslq_f32(vcltq_f32(p, width), one, minus_one);
+      return vsubq_f32(vaddq_f32(x, blep_neon(p, dt, inv)), blep_neon(q, dt, inv));
+    }
+  }
+  return vdupq_n_f32(0);
+}
+
+static void osc_lanes_neon(int wave, const struct s_lanes *l, float *acc, int n) {
+  for (int h = 0; h < OSC_LANES; h += 4) {
+    uint32x4_t phase = vld1q_u32(&l->phase[h]);
+    uint32x4_t inc = vld1q_u32(&l->inc[h]);
+    uint32x4_t dinc = vreinterpretq_u32_s32(vld1q_s32(&l->dinc[h]));
+    float32x4_t width = vld1q_f32(&l->width[h]);
+    float32x4_t dwidth = vld1q_f32(&l->dwidth[h]);
+    float32x4_t g = vld1q_f32(&l->g[h]);
+    float32x4_t dg = vld1q_f32(&l->dg[h]);
+    float32x4_t dt = vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(inc, 8)), PHASE_SCALE);
+    float32x4_t inv = vbslq_f32(vcgtq_f32(dt, vdupq_n_f32(0)), vdivq_f32(vdupq_n_f32(1.0f), dt), vdupq_n_f32(0));
+    float32x4_t fi = vdupq_n_f32(0);
+    for (int i = 0; i < n; i++) {
+      float32x4_t p = vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(phase, 8)), PHASE_SCALE);
+      float32x4_t w = vaddq_f32(width, vmulq_f32(dwidth, fi));
+      float32x4_t y = vmulq_f32(osc_neon(wave, p, w, dt, inv), vaddq_f32(g, vmulq_f32(dg, fi)));
+      float *out = &acc[i * OSC_LANES + h];
+      vst1q_f32(out, vaddq_f32(vld1q_f32(out), y));
+      phase = vaddq_u32(phase, inc);
+      inc = vaddq_u32(inc, dinc);
+      fi = vaddq_f32(fi, vdupq_n_f32(1.0f));
+    }
+  }
+}
+
+#endif // EXA_NEON
+
+// -----------------------------------------------------------
+
+// the ladder
+//
+// four one pole lowpass stages with the output fed back to the input,
+// the moog ladder. each stage is a trapezoidal integrator, so the
+// feedback loop can be solved for the frame it's in instead of using
+// the last frame's output: with G = g / (1 + g), g = tan(pi fc / rate),
+// a stage is y = G x + (1 - G) z and the whole ladder is
+// y4 = G^4 u + S, where S is what the states add up to. the input is
+// then u = (x - k S) / (1 + k G^4), soft clipped like the transistors
+// at the bottom of the ladder. k is 0..4 and the ladder rings on its
+// own at 4, the clipper keeps that in bounds.
+//
+// G is worked out once a block (synth_control), the kernels ramp it
+// linearly across the block, so the cutoff moves every frame for the
+// price of a tan a block. eight voices run in the SIMD lanes at once,
+// in the same lane layout as osc_lanes. as with the oscillators every
+// kernel makes the same bits as ladder_c.
+
+// tanh, close enough for a clipper: exact at 0, 1 at +-3
+static inline float ladder_clip(float x) {
+  x = fminf(fmaxf(x, -3.0f), 3.0f);
+  float x2 = x * x;
+  return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+}
+
+static inline float ladder_g(float hz, float rate) {
+  float x = hz / rate;
+  x = fminf(fmaxf(x, 0.0001f), 0.45f);
+  float g = tanf((float)M_PI * x);
+  return g / (1.0f + g);
+}
+
+static void ladder_c(struct s_lanes *l, const float *in, float *acc, int n) {
+  for (int k = 0; k < OSC_LANES; k++) {
+    float z1 = l->z[0][k], z2 = l->z[1][k], z3 = l->z[2][k], z4 = l->z[3][k];
+    float res = l->res[k];
+    for (int i = 0; i < n; i++) {
+      float fi = i;
+      float G = l->cut[k] + l->dcut[k] * fi;
+      float e = 1.0f - G;
+      float G2 = G * G;
+      float S = e * (G * (G * (G * z1 + z2) + z3) + z4);
+      float u = ladder_clip((in[i * OSC_LANES + k] - res * S) / (1.0f + res * (G2 * G2)));
+      float y1 = G * u + e * z1;
+      z1 = y1 + y1 - z1;
+      float y2 = G * y1 + e * z2;
+      z2 = y2 + y2 - z2;
+      float y3 = G * y2 + e * z3;
+      z3 = y3 + y3 - z3;
+      float y4 = G * y3 + e * z4;
+      z4 = y4 + y4 - z4;
+      acc[i * OSC_LANES + k] += y4 * (l->g[k] + l->dg[k] * fi);
+    }
+    l->z[0][k] = z1;
+    l->z[1][k] = z2;
+    l->z[2][k] = z3;
+    l->z[3][k] = z4;
+  }
+}
+
+#ifdef EXA_X86
+
+static inline __m128 ladder_clip_sse2(__m128 x) {
+  x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-3.0f)), _mm_set1_ps(3.0f));
+  __m128 x2 = _mm_mul_ps(x, x);
+  __m128 a = _mm_mul_ps(x, _mm_add_ps(_mm_set1_ps(27.0f), x2));
+  return _mm_div_ps(a, _mm_add_ps(_mm_set1_ps(27.0f), _mm_mul_ps(_mm_set1_ps(9.0f), x2)));
+}
+
+// two halves of four lanes
+static void ladder_sse2(struct s_lanes *l, const float *in, float *acc, int n) {
+  __m128 one = _mm_set1_ps(1.0f);
+  for (int h = 0; h < OSC_LANES; h += 4) {
+    __m128 z1 = _mm_loadu_ps(&l->z[0][h]), z2 = _mm_loadu_ps(&l->z[1][h]);
+    __m128 z3 = _mm_loadu_ps(&l->z[2][h]), z4 = _mm_loadu_ps(&l->z[3][h]);
+    __m128 cut = _mm_loadu_ps(&l->cut[h]), dcut = _mm_loadu_ps(&l->dcut[h]);
+    __m128 g = _mm_loadu_ps(&l->g[h]), dg = _mm_loadu_ps(&l->dg[h]);
+    __m128 res = _mm_loadu_ps(&l->res[h]);
+    __m128 fi = _mm_setzero_ps();
+    for (int i = 0; i < n; i++) {
+      __m128 G = _mm_add_ps(cut, _mm_mul_ps(dcut, fi));
+      __m128 e = _mm_sub_ps(one, G);
+      __m128 G2 = _mm_mul_ps(G, G);
+      __m128 S = _mm_add_ps(_mm_mul_ps(G, z1), z2);
+      S = _mm_add_ps(_mm_mul_ps(G, S), z3);
+      S = _mm_mul_ps(e, _mm_add_ps(_mm_mul_ps(G, S), z4));
+      __m128 x = _mm_sub_ps(_mm_loadu_ps(&in[i * OSC_LANES + h]), _mm_mul_ps(res, S));
+      __m128 u = ladder_clip_sse2(_mm_div_ps(x, _mm_add_ps(one, _mm_mul_ps(res, _mm_mul_ps(G2, G2)))));
+      __m128 y1 = _mm_add_ps(_mm_mul_ps(G, u), _mm_mul_ps(e, z1));
+      z1 = _mm_sub_ps(_mm_add_ps(y1, y1), z1);
+      __m128 y2 = _mm_add_ps(_mm_mul_ps(G, y1), _mm_mul_ps(e, z2));
+      z2 = _mm_sub_ps(_mm_add_ps(y2, y2), z2);
+      __m128 y3 = _mm_add_ps(_mm_mul_ps(G, y2), _mm_mul_ps(e, z3));
+      z3 = _mm_sub_ps(_mm_add_ps(y3, y3), z3);
+      __m128 y4 = _mm_add_ps(_mm_mul_ps(G, y3), _mm_mul_ps(e, z4));
+      z4 = _mm_sub_ps(_mm_add_ps(y4, y4), z4);
+      float *out = &acc[i * OSC_LANES + h];
+      __m128 y = _mm_mul_ps(y4, _mm_add_ps(g, _mm_mul_ps(dg, fi)));
+      _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), y));
+      fi = _mm_add_ps(fi, one);
+    }
+    _mm_storeu_ps(&l->z[0][h], z1);
+    _mm_storeu_ps(&l->z[1][h], z2);
+    _mm_storeu_ps(&l->z[2][h], z3);
+    _mm_storeu_ps(&l->z[3][h], z4);
+  }
+}
+
+AVX2 static inline __m256 ladder_clip_avx2(__m256 x) {
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-3.0f)), _mm256_set1_ps(3.0f));
+  __m256 x2 = _mm256_mul_ps(x, x);
+  __m256 a = _mm256_mul_ps(x, _mm256_add_ps(_mm256_set1_ps(27.0f), x2));
+  return _mm256_div_ps(a, _mm256_add_ps(_mm256_set1_ps(27.0f), _mm256_mul_ps(_mm256_set1_ps(9.0f), x2)));
+}
+
+AVX2 static void ladder_avx2(struct s_lanes *l, const float *in, float *acc, int n) {
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 z1 = _mm256_loadu_ps(l->z[0]), z2 = _mm256_loadu_ps(l->z[1]);
+  __m256 z3 = _mm256_loadu_ps(l->z[2]), z4 = _mm256_loadu_ps(l->z[3]);
+  __m256 cut = _mm256_loadu_ps(l->cut), dcut = _mm256_loadu_ps(l->dcut);
+  __m256 g = _mm256_loadu_ps(l->g), dg = _mm256_loadu_ps(l->dg);
+  __m256 res = _mm256_loadu_ps(l->res);
+  __m256 fi = _mm256_setzero_ps();
+  for (int i = 0; i < n; i++) {
+    __m256 G = _mm256_add_ps(cut, _mm256_mul_ps(dcut, fi));
+    __m256 e = _mm256_sub_ps(one, G);
+    __m256 G2 = _mm256_mul_ps(G, G);
+    __m256 S = _mm256_add_ps(_mm256_mul_ps(G, z1), z2);
+    S = _mm256_add_ps(_mm256_mul_ps(G, S), z3);
+    S = _mm256_mul_ps(e, _mm256_add_ps(_mm256_mul_ps(G, S), z4));
+    __m256 x = _mm256_sub_ps(_mm256_loadu_ps(&in[i * OSC_LANES]), _mm256_mul_ps(res, S));
+    __m256 u = ladder_clip_avx2(_mm256_div_ps(x, _mm256_add_ps(one, _mm256_mul_ps(res, _mm256_mul_ps(G2, G2)))));
+    __m256 y1 = _mm256_add_ps(_mm256_mul_ps(G, u), _mm256_mul_ps(e, z1));
+    z1 = _mm256_sub_ps(_mm256_add_ps(y1, y1), z1);
+    __m256 y2 = _mm256_add_ps(_mm256_mul_ps(G, y1), _mm256_mul_ps(e, z2));
+    z2 = _mm256_sub_ps(_mm256_add_ps(y2, y2), z2);
+    __m256 y3 = _mm256_add_ps(_mm256_mul_ps(G, y2), _mm256_mul_ps(e, z3));
+    z3 = _mm256_sub_ps(_mm256_add_ps(y3, y3), z3);
+    __m256 y4 = _mm256_add_ps(_mm256_mul_ps(G, y3), _mm256_mul_ps(e, z4));
+    z4 = _mm256_sub_ps(_mm256_add_ps(y4, y4), z4);
+    float *out = &acc[i * OSC_LANES];
+    __m256 y = _mm256_mul_ps(y4, _mm256_add_ps(g, _mm256_mul_ps(dg, fi)));
+    _mm256_storeu_ps(out, _mm256_add_ps(_mm256_loadu_ps(out), y));
+    fi = _mm256_add_ps(fi, one);
+  }
+  _mm256_storeu_ps(l->z[0], z1);
+  _mm256_storeu_ps(l->z[1], z2);
+  _mm256_storeu_ps(l->z[2], z3);
+  _mm256_storeu_ps(l->z[3], z4);
+}
+
+#endif // EXA_X86
+
+#ifdef EXA_NEON
+
+static inline float32x4_t ladder_clip_neon(float32x4_t x) {
+  x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-3.0f)), vdupq_n_f32(3.0f));
+  float32x4_t x2 = vmulq_f32(x, x);
+  float32x4_t a = vmulq_f32(x, vaddq_f32(vdupq_n_f32(27.0f), x2));
+  return vdivq_f32(a, vaddq_f32(vdupq_n_f32(27.0f), vmulq_n_f32(x2, 9.0f)));
+}
+
+static void ladder_neon(struct s_lanes *l, const float *in, float *acc, int n) {
+  float32x4_t one = vdupq_n_f32(1.0f);
+  for (int h = 0; h < OSC_LANES; h += 4) {
+    float32x4_t z1 = vld1q_f32(&l->z[0][h]), z2 = vld1q_f32(&l->z[1][h]);
+    float32x4_t z3 = vld1q_f32(&l->z[2][h]), z4 = vld1q_f32(&l->z[3][h]);
+    float32x4_t cut = vld1q_f32(&l->cut[h]), dcut = vld1q_f32(&l->dcut[h]);
+    float32x4_t g = vld1q_f32(&l->g[h]), dg = vld1q_f32(&l->dg[h]);
+    float32x4_t res = vld1q_f32(&l->res[h]);
+    float32x4_t fi = vdupq_n_f32(0);
+    for (int i = 0; i < n; i++) {
+      float32x4_t G = vaddq_f32(cut, vmulq_f32(dcut, fi));
+      float32x4_t e = vsubq_f32(one, G);
+      float32x4_t G2 = vmulq_f32(G, G);
+      float32x4_t S = vaddq_f32(vmulq_f32(G, z1), z2);
+      S = vaddq_f32(vmulq_f32(G, S), z3);
+      S = vmulq_f32(e, vaddq_f32(vmulq_f32(G, S), z4));
+      float32x4_t x = vsubq_f32(vld1q_f32(&in[i * OSC_LANES + h]), vmulq_f32(res, S));
+      float32x4_t u = ladder_clip_neon(vdivq_f32(x, vaddq_f32(one, vmulq_f32(res, vmulq_f32(G2, G2)))));
+      float32x4_t y1 = vaddq_f32(vmulq_f32(G, u), vmulq_f32(e, z1));
+      z1 = vsubq_f32(vaddq_f32(y1, y1), z1);
+      float32x4_t y2 = vaddq_f32(vmulq_f32(G, y1), vmulq_f32(e, z2));
+      z2 = vsubq_f32(vaddq_f32(y2, y2), z2);
+      float32x4_t y3 = vaddq_f32(vmulq_f32(G, y2), vmulq_f32(e, z3));
+      z3 = vsubq_f32(vaddq_f32(y3, y3), z3);
+      float32x4_t y4 = vaddq_f32(vmulq_f32(G, y3), vmulq_f32(e, z4));
+      z4 = vsubq_f32(vaddq_f32(y4, y4), z4);
+      float *out = &acc[i * OSC_LANES + h];
+      float32x4_t y = vmulq_f32(y4, vaddq_f32(g, vmulq_f32(dg, fi)));
+      vst1q_f32(out, vaddq_f32(vld1q_f32(out), y));
+      fi = vaddq_f32(fi, one);
+    }
+    vst1q_f32(&l->z[0][h], z1);
+    vst1q_f32(&l->z[1][h], z2);
+    vst1q_f32(&l->z[2][h], z3);
+    vst1q_f32(&l->z[3][h], z4);
+  }
+}
+
+#endif // EXA_NEON
+
+static osc_lanes_fn osc_lanes = osc_lanes_c;
+static ladder_fn ladder_lanes = ladder_c;
+static char *osc_kernels = "c";
+
+void osc_init(void) {
+  #ifdef EXA_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    osc_lanes = osc_lanes_avx2;
+    ladder_lanes = ladder_avx2;
+    osc_kernels = "avx2";
+  } else if (__builtin_cpu_supports("sse2")) {
+    osc_lanes = osc_lanes_sse2;
+    ladder_lanes = ladder_sse2;
+    osc_kernels = "sse2";
+  }
+  #endif
+  #ifdef EXA_NEON
+  osc_lanes = osc_lanes_neon;
+  ladder_lanes = ladder_neon;
+  osc_kernels = "neon";
+  #endif
+  LOG("osc kernels:%s"CR, osc_kernels);
+}
+
+#ifdef EXA_BENCH
+static char *wave_name[wave_count] = {"sine", "square", "triangle", "saw", "pulse", "table",
+  "square-bl", "triangle-bl", "saw-bl", "pulse-bl"};
+#endif
+
+static char *steal_name[steal_count] = {"oldest", "quietest", "same-key"};
+
+static void synth_activate(struct s_synth *s, int v) {
+  if (s->slot[v] >= 0) return;
+  s->slot[v] = s->active_count;
+  s->active[s->active_count++] = v;
+}
+
+static void synth_age_remove(struct s_synth *s, int v) {
+  if (s->older[v] >= 0) s->newer[s->older[v]] = s->newer[v];
+  else s->oldest = s->newer[v];
+  if (s->newer[v] >= 0) s->older[s->newer[v]] = s->older[v];
+  else s->newest = s->older[v];
+}
+
+static void synth_age_append(struct s_synth *s, int v) {
+  s->older[v] = s->newest;
+  s->newer[v] = -1;
+  if (s->newest >= 0) s->newer[s->newest] = v;
+  else s->oldest = v;
+  s->newest = v;
+}
+
+static void synth_deactivate(struct s_synth *s, int v) {
+  int k = s->slot[v];
+  int last = s->active[--s->active_count];
+  s->active[k] = last;
+  s->slot[last] = k;
+  s->slot[v] = -1;
+  // a pool voice goes back on the stack
+  int key = s->voice_key[v];
+  if (key >= 0) {
+    if (s->key_voice[key] == v) s->key_voice[key] = -1;
+    s->voice_key[v] = -1;
+    synth_age_remove(s, v);
+    s->free_voice[s->free_count++] = v;
+  }
+}
+
+// envelope steps per frame to cover distance in seconds
+static inline float synth_step(float distance, float seconds, float rate) {
+  return seconds > 0 ? distance / (seconds * rate) : 1.0f;
+}
+
+// the voice lfo runs while anything reads it
+static void synth_lfo_check(struct s_synth *s, int v) {
+  int on = s->lfo_pitch[v] != 0 || s->lfo_amp[v] != 0 || s->lfo_width[v] != 0;
+  for (int r = 0; r < s->routes[v]; r++) {
+    if (s->route[v][r].source == mod_voice_lfo) on = 1;
+  }
+  s->lfo_on[v] = on;
+}
+
+// a voice starting from silence
+static void synth_ladder_reset(struct s_synth *s, int v) {
+  s->ladder_hz[v] = 0;
+  memset(s->ladder[v], 0, sizeof s->ladder[v]);
+}
+
+// the patch is everything but where the voice is in its cycle and envelope
+static void synth_patch(struct s_synth *s, int v, int from) {
+  if (v == from) return;
+  s->wave[v] = s->wave[from];
+  s->amp[v] = s->amp[from];
+  s->width[v] = s->width[from];
+  s->attack[v] = s->attack[from];
+  s->decay[v] = s->decay[from];
+  s->sustain[v] = s->sustain[from];
+  s->release[v] = s->release[from];
+  s->morph[v] = s->morph[from];
+  s->cutoff[v] = s->cutoff[from];
+  s->resonance[v] = s->resonance[from];
+  s->table_a[v] = s->table_a[from];
+  s->table_b[v] = s->table_b[from];
+  s->interp[v] = s->interp[from];
+  s->lfo_inc[v] = s->lfo_inc[from];
+  s->lfo_wave[v] = s->lfo_wave[from];
+  s->lfo_pitch[v] = s->lfo_pitch[from];
+  s->lfo_amp[v] = s->lfo_amp[from];
+  s->lfo_width[v] = s->lfo_width[from];
+  s->lfo_on[v] = s->lfo_on[from];
+  memcpy(s->route[v], s->route[from], sizeof s->route[v]);
+  s->routes[v] = s->routes[from];
+}
+
+static void synth_start(struct s_synth *s, int v) {
+  synth_patch(s, v, s->poly_base);
+  s->inc[v] = s->next_inc[v];
+  s->velocity[v] = s->next_amp[v];
+  s->phase[v] = 0;
+  s->level[v] = 0;
+  s->lfo_phase[v] = 0;
+  s->lfo_value[v] = osc_c(s->lfo_wave[v], 0, 0.5f, 0, 0);
+  s->stage[v] = env_attack;
+  synth_ladder_reset(s, v);
+  synth_activate(s, v);
+}
+
+// the voice to take when none are free
+static int synth_victim(struct s_synth *s) {
+  if (s->steal == steal_quietest) {
+    int quietest = s->oldest;
+    for (int v = s->oldest; v >= 0; v = s->newer[v]) {
+      if (s->level[v] < s->level[quietest]) quietest = v;
+    }
+    return quietest;
+  }
+  return s->oldest;
+}
+
+static void synth_key_stop(struct s_synth *s, int key) {
+  int v = s->key_voice[key];
+  if (v < 0) return;
+  if (s->stage[v] == env_steal || s->stage[v] == env_restart) {
+    s->next_inc[v] = 0; // never mind the note it was waiting for
+    s->next_amp[v] = 0;
+    s->stage[v] = env_steal;
+  } else if (s->stage[v] != env_idle) {
+    s->stage[v] = env_release;
+    s->fall[v] = s->release[v] >= 1 ? s->level[v] / s->release[v] : 1.0f;
+  }
+}
+
+static void synth_key_start(struct s_synth *s, int key, float hz, float velocity) {
+  if (s->poly_count == 0) return;
+  int v = s->key_voice[key];
+  if (v < 0 || s->steal != steal_same_key) {
+    // the key's last voice lets go, or nothing would ever release it
+    if (v >= 0) synth_key_stop(s, key);
+    if (s->free_count) {
+      v = s->free_voice[--s->free_count];
+    } else {
+      v = synth_victim(s);
+      if (v < 0) return;
+    }
+  }
+  int sounding = s->voice_key[v] >= 0;
+  if (sounding) {
+    if (s->key_voice[s->voice_key[v]] == v) s->key_voice[s->voice_key[v]] = -1;
+    synth_age_remove(s, v);
+  }
+  s->voice_key[v] = key;
+  s->key_voice[key] = v;
+  synth_age_append(s, v);
+  s->next_inc[v] = phase_inc(hz, s->rate);
+  s->next_amp[v] = velocity;
+  if (sounding && s->stage[v] != env_idle) {
+    // fade what it was playing first, so it doesn't click
+    s->stage[v] = env_steal;
+    s->stolen++;
+  } else {
+    synth_start(s, v);
+  }
+}
+
+// takes back every voice in the old pool, then stacks the new one so
+// that poly_base comes off first
+static void synth_poly_set(struct s_synth *s, int base, int count, int steal) {
+  for (int v = s->poly_base; v < s->poly_base + s->poly_count; v++) {
+    if (s->voice_key[v] >= 0) {
+      s->stage[v] = env_idle;
+      if (s->slot[v] >= 0) synth_deactivate(s, v);
+    }
+  }
+  for (int k = 0; k < SYNTH_KEYS; k++) s->key_voice[k] = -1;
+  s->oldest = s->newest = -1;
+  s->free_count = 0;
+  s->poly_base = base;
+  s->poly_count = count;
+  s->steal = steal;
+  for (int v = base + count - 1; v >= base; v--) s->free_voice[s->free_count++] = v;
+}
+
+// one route for each source and destination, a depth of 0 takes it out
+static void synth_route_set(struct s_synth *s, int v, int source, int dest, float depth) {
+  struct s_route *route = s->route[v];
+  int r = 0;
+  while (r < s->routes[v] && !(route[r].source == source && route[r].dest == dest)) r++;
+  if (depth == 0) {
+    if (r < s->routes[v]) route[r] = route[--s->routes[v]];
+  } else if (r < s->routes[v] || s->routes[v] < MOD_ROUTES) {
+    if (r == s->routes[v]) s->routes[v]++;
+    route[r] = (struct s_route){.source = source, .dest = dest, .depth = depth};
+  }
+}
+
+static void seq_transport(struct s_synth *s, int on);
+
+static void synth_apply(struct s_synth *s, struct s_synth_cmd *c) {
+  int v = c->voice;
+  switch (c->op) {
+    case synth_osc:
+      s->wave[v] = c->v[0];
+      s->inc[v] = phase_inc(c->v[1], s->rate);
+      s->amp[v] = c->v[2];
+      s->width[v] = c->v[3];
+      break;
+    case synth_adsr:
+      s->attack[v] = synth_step(1, c->v[0], s->rate);
+      s->decay[v] = synth_step(1 - c->v[2], c->v[1], s->rate);
+      s->sustain[v] = c->v[2];
+      s->release[v] = c->v[3] * s->rate;
+      break;
+    case synth_on:
+      if (c->v[0] > 0) s->inc[v] = phase_inc(c->v[0], s->rate);
+      s->velocity[v] = 1;
+      s->lfo_phase[v] = 0;
+      s->lfo_value[v] = osc_c(s->lfo_wave[v], 0, 0.5f, 0, 0);
+      s->stage[v] = env_attack;
+      if (s->slot[v] < 0) synth_ladder_reset(s, v);
+      synth_activate(s, v);
+      break;
+    case synth_off:
+      if (s->stage[v] != env_idle) {
+        s->stage[v] = env_release;
+        s->fall[v] = s->release[v] >= 1 ? s->level[v] / s->release[v] : 1.0f;
+      }
+      break;
+    case synth_table:
+      s->table_a[v] = c->v[0];
+      s->table_b[v] = c->v[1];
+      s->morph[v] = c->v[2];
+      s->interp[v] = c->v[3];
+      break;
+    case synth_morph:
+      s->morph[v] = c->v[0];
+      break;
+    case synth_lfo:
+      s->lfo_wave[v] = c->v[0];
+      s->lfo_inc[v] = phase_inc(c->v[1], s->rate);
+      break;
+    case synth_lfo_depth:
+      s->lfo_pitch[v] = c->v[0];
+      s->lfo_amp[v] = c->v[1];
+      s->lfo_width[v] = c->v[2];
+      synth_lfo_check(s, v);
+      break;
+    case synth_bus_lfo:
+      // voice is the bus lfo here
+      s->bus_wave[v] = c->v[0];
+      s->bus_inc[v] = phase_inc(c->v[1], s->rate);
+      break;
+    case synth_route:
+      synth_route_set(s, v, c->v[0], c->v[1], c->v[2]);
+      synth_lfo_check(s, v);
+      break;
+    case synth_poly:
+      synth_poly_set(s, v, c->v[0], c->v[1]);
+      break;
+    case synth_key_on:
+      // voice is the key for these two
+      synth_key_start(s, v, c->v[0], c->v[1]);
+      break;
+    case synth_key_off:
+      synth_key_stop(s, v);
+      break;
+    case synth_filter:
+      s->cutoff[v] = c->v[0];
+      s->resonance[v] = c->v[1];
+      break;
+    case synth_seq:
+      seq_transport(s, c->v[0] != 0);
+      break;
+  }
+}
+
+// -----------------------------------------------------------
+
+// the step sequencer, all of it data_cb's
+
+static float *seq_param(struct s_synth *s, int v, int lock) {
+  switch (lock) {
+    case lock_cutoff: return &s->cutoff[v];
+    case lock_resonance: return &s->resonance[v];
+    case lock_morph: return &s->morph[v];
+    default: return &s->width[v];
+  }
+}
+
+// the voice gets back the values the track's locks took over
+static void seq_unlock(struct s_synth *s, int t, int v) {
+  struct s_seq *q = &s->seq;
+  for (int l = 0; l < lock_count; l++) {
+    if (q->saved[t] & 1 << l) *seq_param(s, v, l) = q->base[t][l];
+  }
+  q->saved[t] = 0;
+}
+
+static void seq_off(struct s_synth *s, int t) {
+  struct s_synth_cmd c = {.op = synth_off, .voice = s->seq.held[t]};
+  synth_apply(s, &c);
+  s->seq.held[t] = -1;
+}
+
+// frame step n goes out on, the odd steps of a bar swung late
+static uint64_t seq_frame(struct s_seq *q, uint64_t n) {
+  double at = q->origin + (double)(n - q->origin_step) * q->step_frames;
+  if (q->bar_left > 0 && (n - q->bar) & 1) at += q->play->swing * q->step_frames;
+  return (uint64_t)(at + 0.5);
+}
+
+// the first step of a bar: a fresh pattern if there is one, and its tempo
+static void seq_bar(struct s_synth *s) {
+  struct s_seq *q = &s->seq;
+  // once acquired the old copy is the writer's again, so its voices are read first
+  int16_t was[SEQ_TRACKS];
+  for (int t = 0; t < SEQ_TRACKS; t++) was[t] = q->play ? q->play->track[t].voice : -1;
+  unsigned front = triple_acquire(&q->tb);
+  if (!q->play || front != q->front) {
+    // the old pattern's locks don't carry over, the tracks start again
+    for (int t = 0; t < SEQ_TRACKS; t++) {
+      if (q->saved[t] && was[t] >= 0) seq_unlock(s, t, was[t]);
+    }
+    q->front = front;
+    q->play = &q->pattern[front];
+    q->first = q->step;
+    q->swaps++;
+    // a note held on a track that moved voice or went off has nothing to end it
+    for (int t = 0; t < SEQ_TRACKS; t++) {
+      struct s_seq_track *track = &q->play->track[t];
+      if (q->held[t] >= 0 && (q->held[t] != track->voice || track->length < 1)) seq_off(s, t);
+    }
+  }
+  q->origin += (double)(q->step - q->origin_step) * q->step_frames;
+  q->origin_step = q->step;
+  q->step_frames = s->rate * 60.0 / (q->play->bpm * q->play->steps_per_beat);
+  q->bar = q->step;
+  q->bar_left = q->play->steps_per_bar;
+}
+
+static void seq_note(struct s_synth *s, int t, int v, struct s_seq_step *step, uint64_t at) {
+  struct s_seq *q = &s->seq;
+  if (q->held[t] >= 0 && q->held[t] != v) seq_off(s, t);
+  for (int l = 0; l < lock_count; l++) {
+    int bit = 1 << l;
+    if (step->locked & bit) {
+      if (!(q->saved[t] & bit)) {
+        q->base[t][l] = *seq_param(s, v, l);
+        q->saved[t] |= bit;
+      }
+      *seq_param(s, v, l) = step->lock[l];
+    } else if (q->saved[t] & bit) {
+      *seq_param(s, v, l) = q->base[t][l];
+      q->saved[t] &= ~bit;
+    }
+  }
+  struct s_synth_cmd c = {.op = synth_on, .voice = v, .v = {440 * exp2f((step->note - 69) / 12.0f)}};
+  synth_apply(s, &c);
+  s->velocity[v] = step->velocity;
+  q->held[t] = v;
+  q->off[t] = UINT64_MAX;
+  if (step->gate > 0) {
+    uint64_t len = step->gate * q->step_frames + 0.5;
+    q->off[t] = at + (len ? len : 1);
+  }
+}
+
+// every track's note for step q->step, then on to the next
+static void seq_play(struct s_synth *s) {
+  struct s_seq *q = &s->seq;
+  uint64_t at = q->next;
+  if (q->bar_left == 0) seq_bar(s);
+  for (int t = 0; t < SEQ_TRACKS; t++) {
+    struct s_seq_track *track = &q->play->track[t];
+    if (track->voice < 0 || track->length < 1) continue;
+    struct s_seq_step *step = &track->step[(q->step - q->first) % track->length];
+    if (step->note >= 0) seq_note(s, t, track->voice, step, at);
+  }
+  q->step++;
+  q->bar_left--;
+  q->next = seq_frame(q, q->step);
+}
+
+// once a period, before anything is due: the engine keeps the time of
+// whichever device has it, so moving to another makes the clock jump,
+// back as easily as on. the next step and the note offs move with it,
+// so the sequencer goes on where it was. a short gap forward is only
+// periods that weren't rendered and stays on the device's time.
+static void seq_clock(struct s_synth *s) {
+  struct s_seq *q = &s->seq;
+  if (s->now < q->last || s->now > q->last + (uint64_t)s->rate) {
+    uint64_t by = s->now - q->last; // wraps going back, and so do the sums
+    q->next += by;
+    q->origin += (double)(int64_t)by;
+    for (int t = 0; t < SEQ_TRACKS; t++) {
+      if (q->off[t] != UINT64_MAX) q->off[t] += by;
+    }
+  }
+  q->last = s->now;
+}
+
+// everything the sequencer has due by s->now
+static void seq_run(struct s_synth *s) {
+  struct s_seq *q = &s->seq;
+  for (;;) {
+    for (int t = 0; t < SEQ_TRACKS; t++) {
+      if (q->held[t] >= 0 && q->off[t] <= s->now) seq_off(s, t);
+    }
+    if (!q->playing || q->next > s->now) break;
+    seq_play(s);
+  }
+}
+
+// the next frame the sequencer has something for, UINT64_MAX for none
+static uint64_t seq_due(struct s_synth *s) {
+  struct s_seq *q = &s->seq;
+  uint64_t due = q->playing ? q->next : UINT64_MAX;
+  for (int t = 0; t < SEQ_TRACKS; t++) {
+    if (q->held[t] >= 0 && q->off[t] < due) due = q->off[t];
+  }
+  return due;
+}
+
+// start from the first step of the newest pattern on this frame, or stop
+// and let go of every note
+static void seq_transport(struct s_synth *s, int on) {
+  struct s_seq *q = &s->seq;
+  for (int t = 0; t < SEQ_TRACKS; t++) {
+    if (q->held[t] >= 0) seq_off(s, t);
+    if (q->saved[t]) seq_unlock(s, t, q->play->track[t].voice);
+  }
+  q->play = NULL;
+  q->playing = on;
+  if (!on) return;
+  q->step = 0;
+  q->next = s->now;
+  q->origin = s->now;
+  q->origin_step = 0;
+  q->bar_left = 0;
+}
+
+// move the envelope on by n frames, once a block
+static inline float synth_envelope(struct s_synth *s, int v, int n) {
+  float l = s->level[v];
+  switch (s->stage[v]) {
+    case env_attack:
+      l += s->attack[v] * n;
+      if (l >= 1) {
+        l = 1;
+        s->stage[v] = env_decay;
+      }
+      break;
+    case env_decay:
+      l -= s->decay[v] * n;
+      if (l <= s->sustain[v]) {
+        l = s->sustain[v];
+        s->stage[v] = env_sustain;
+      }
+      break;
+    case env_sustain:
+      l = s->sustain[v];
+      break;
+    case env_release:
+      l -= s->fall[v] * n;
+      if (l <= 0) {
+        l = 0;
+        s->stage[v] = env_idle;
+      }
+      break;
+    case env_steal:
+      l = 0;
+      s->stage[v] = env_restart;
+      break;
+  }
+  return l;
+}
+
+// a voice's gain, pitch and width for one block, as a value at the
+// first frame and a step per frame
+struct s_control {
+  float g, dg;
+  uint32_t inc;
+  int32_t dinc;
+  float width, dwidth;
+  float morph, dmorph;
+  float cut, dcut; // the ladder's G, when the voice has a filter
+};
+
+// pitch moved by octaves, kept under nyquist
+static inline uint32_t synth_bend(uint32_t inc, float octaves) {
+  double x = inc * (double)exp2f(octaves);
+  return x < 2147483648.0 ? (uint32_t)x : 2147483648u;
+}
+
+// width and morph stay in 0..1 whatever the routes add
+static inline float synth_clamp(float x) {
+  return fminf(fmaxf(x, 0), 1);
+}
+
+// the ladder's G to the cutoff moved by octaves. the tan is only
+// worked out again when the cutoff has moved.
+static inline void synth_cutoff(struct s_synth *s, int v, int n, float octaves, struct s_control *c) {
+  float hz = s->cutoff[v];
+  if (octaves != 0) hz *= exp2f(octaves);
+  float g0 = s->ladder_g[v], g1 = g0;
+  if (hz != s->ladder_hz[v]) {
+    g1 = ladder_g(hz, s->rate);
+    if (s->ladder_hz[v] == 0) g0 = g1;
+    s->ladder_hz[v] = hz;
+    s->ladder_g[v] = g1;
+  }
+  c->cut = g0;
+  c->dcut = (g1 - g0) / n;
+}
+
+// control rate: the envelope, the lfos and the routes are worked out
+// once a block, for its last frame, and the kernels ramp linearly to
+// there from where the last block left off. ramps are continuous, so this needs
+// no smoothing, and a block is short enough that a ramp is close to
+// the curve it stands for ("make bench" control).
+static inline void synth_control(struct s_synth *s, int v, int n, int block, float gain, struct s_control *c) {
+  float from = s->level[v];
+  float to = synth_envelope(s, v, n);
+  s->level[v] = to;
+  float g0 = from * gain, g1 = to * gain;
+  c->inc = s->inc[v];
+  c->dinc = 0;
+  c->width = s->width[v];
+  c->dwidth = 0;
+  c->morph = s->morph[v];
+  c->dmorph = 0;
+  if (!s->lfo_on[v] && !s->routes[v]) {
+    c->g = g0;
+    c->dg = (g1 - g0) / n;
+    if (s->cutoff[v] > 0) synth_cutoff(s, v, n, 0, c);
+    return;
+  }
+  // every destination at the start (a) and end (b) of the block
+  float a[mod_dests] = {0}, b[mod_dests] = {0};
+  float la = s->lfo_value[v], lb = la;
+  if (s->lfo_on[v]) {
+    s->lfo_phase[v] += s->lfo_inc[v] * (uint32_t)n;
+    lb = osc_c(s->lfo_wave[v], (s->lfo_phase[v] >> 8) * PHASE_SCALE, 0.5f, 0, 0);
+    s->lfo_value[v] = lb;
+    a[mod_pitch] = s->lfo_pitch[v] * la;
+    b[mod_pitch] = s->lfo_pitch[v] * lb;
+    // from 1 - depth at the bottom of the swing to 1 at the top
+    a[mod_amp] = -s->lfo_amp[v] * (0.5f - 0.5f * la);
+    b[mod_amp] = -s->lfo_amp[v] * (0.5f - 0.5f * lb);
+    a[mod_width] = s->lfo_width[v] * la;
+    b[mod_width] = s->lfo_width[v] * lb;
+  }
+  for (int r = 0; r < s->routes[v]; r++) {
+    const struct s_route *route = &s->route[v][r];
+    float sa, sb;
+    switch (route->source) {
+      case mod_voice_lfo:
+        sa = la;
+        sb = lb;
+        break;
+      case mod_envelope:
+        sa = from;
+        sb = to;
+        break;
+      default:
+        sa = s->bus_from[block][route->source - mod_bus];
+        sb = s->bus_to[block][route->source - mod_bus];
+        break;
+    }
+    a[route->dest] += route->depth * sa;
+    b[route->dest] += route->depth * sb;
+  }
+  if (a[mod_pitch] != 0 || b[mod_pitch] != 0) {
+    uint32_t i0 = synth_bend(c->inc, a[mod_pitch]);
+    uint32_t i1 = synth_bend(c->inc, b[mod_pitch]);
+    c->inc = i0;
+    c->dinc = ((int64_t)i1 - i0) / n;
+  }
+  g0 *= fmaxf(1 + a[mod_amp], 0);
+  g1 *= fmaxf(1 + b[mod_amp], 0);
+  float w0 = synth_clamp(c->width + a[mod_width]);
+  float w1 = synth_clamp(c->width + b[mod_width]);
+  c->width = w0;
+  c->dwidth = (w1 - w0) / n;
+  float m0 = synth_clamp(c->morph + a[mod_morph]);
+  float m1 = synth_clamp(c->morph + b[mod_morph]);
+  c->morph = m0;
+  c->dmorph = (m1 - m0) / n;
+  c->g = g0;
+  c->dg = (g1 - g0) / n;
+  if (s->cutoff[v] > 0) synth_cutoff(s, v, n, b[mod_cutoff], c);
+}
+
+// one table voice, with the constant arguments picked out by
+// synth_table_voice. returns the phase after the block.
+static inline uint32_t wt_run(const float *xa, const float *xb, int cubic, int two,
+    uint32_t ph, const struct s_control *c, float *acc, int n) {
+  uint32_t inc = c->inc;
+  for (int i = 0; i < n; i++) {
+    float y = cubic ? wt_cubic(xa, ph) : wt_linear(xa, ph);
+    if (two) y += (c->morph + c->dmorph * i) * ((cubic ? wt_cubic(xb, ph) : wt_linear(xb, ph)) - y);
+    acc[i * OSC_LANES] += y * (c->g + c->dg * i);
+    ph += inc;
+    inc += (uint32_t)c->dinc;
+  }
+  return ph;
+}
+
+// add n frames of wavetable voice v to the first lane of acc and move it on
+static void synth_table_voice(struct s_synth *s, int v, float *acc, int n, const struct s_control *c) {
+  const struct s_audio *ta = atomic_load_explicit(&wavetables[s->table_a[v]], memory_order_acquire);
+  const struct s_audio *tb = atomic_load_explicit(&wavetables[s->table_b[v]], memory_order_acquire);
+  uint32_t ph = s->phase[v];
+  if (!ta) {
+    s->phase[v] = ph + c->inc * (uint32_t)n + (uint32_t)c->dinc * (uint32_t)(n * (n - 1) / 2);
+    return;
+  }
+  // the level for the higher end of the ramp
+  uint32_t top = c->inc + (c->dinc > 0 ? (uint32_t)c->dinc * (uint32_t)n : 0);
+  int m = wt_mip(top);
+  const float *xa = wt_level(ta, m);
+  const float *xb = tb ? wt_level(tb, m) : xa;
+  int two = xb != xa && (c->morph != 0 || c->dmorph != 0);
+  if (s->interp[v] == interp_cubic) {
+    if (two) ph = wt_run(xa, xb, 1, 1, ph, c, acc, n);
+    else ph = wt_run(xa, xa, 1, 0, ph, c, acc, n);
+  } else {
+    if (two) ph = wt_run(xa, xb, 0, 1, ph, c, acc, n);
+    else ph = wt_run(xa, xa, 0, 0, ph, c, acc, n);
+  }
+  s->phase[v] = ph;
+}
+
+// run a full (or last, partly full) set of lanes and move their voices
+// on. filtered lanes are rendered into in first and go through the
+// ladder, table voices are already there.
+static void synth_flush(struct s_synth *s, int wave, struct s_lanes *l, float *in, float *acc, int n) {
+  for (int k = l->count; k < OSC_LANES; k++) {
+    l->phase[k] = l->inc[k] = 0;
+    l->dinc[k] = 0;
+    l->width[k] = l->dwidth[k] = l->g[k] = l->dg[k] = 0;
+    if (in) l->cut[k] = l->dcut[k] = l->res[k] = l->z[0][k] = l->z[1][k] = l->z[2][k] = l->z[3][k] = 0;
+  }
+  if (in) {
+    for (int k = 0; k < l->count; k++) {
+      const float *z = s->ladder[l->voice[k]];
+      l->z[0][k] = z[0];
+      l->z[1][k] = z[1];
+      l->z[2][k] = z[2];
+      l->z[3][k] = z[3];
+    }
+    if (wave != wave_table) {
+      // the oscillators at unit gain, the ladder has the real one
+      float g[OSC_LANES], dg[OSC_LANES];
+      memcpy(g, l->g, sizeof g);
+      memcpy(dg, l->dg, sizeof dg);
+      for (int k = 0; k < OSC_LANES; k++) {
+        l->g[k] = 1;
+        l->dg[k] = 0;
+      }
+      memset(in, 0, n * OSC_LANES * sizeof(float));
+      osc_lanes(wave, l, in, n);
+      memcpy(l->g, g, sizeof g);
+      memcpy(l->dg, dg, sizeof dg);
+    }
+    ladder_lanes(l, in, acc, n);
+    for (int k = 0; k < l->count; k++) {
+      float *z = s->ladder[l->voice[k]];
+      // no denormals from a ladder left to ring down
+      for (int j = 0; j < 4; j++) z[j] = fabsf(l->z[j][k]) > 1e-20f ? l->z[j][k] : 0;
+    }
+    if (wave == wave_table) {
+      memset(in, 0, n * OSC_LANES * sizeof(float));
+      l->count = 0;
+      return;
+    }
+  } else {
+    osc_lanes(wave, l, acc, n);
+  }
+  for (int k = 0; k < l->count; k++) {
+    int v = l->voice[k];
+    // the sum of a ramp, in the same wrapping arithmetic as the kernels
+    s->phase[v] = l->phase[k] + l->inc[k] * (uint32_t)n + (uint32_t)l->dinc[k] * (uint32_t)(n * (n - 1) / 2);
+  }
+  l->count = 0;
+}
+
+// the voices from active[batch * SYNTH_BATCH] on, for a whole slice,
+// into batch_mix[batch]. a batch only touches its own voices, so
+// batches can be rendered on any thread in any order. voices that go
+// idle stay on the active list until the slice is done.
+static void synth_batch(struct s_synth *s, int batch, int frames, float gain) {
+  float *out = s->batch_mix[batch];
+  int first = batch * SYNTH_BATCH;
+  int last = first + SYNTH_BATCH < s->active_count ? first + SYNTH_BATCH : s->active_count;
+  float acc[SYNTH_BLOCK * OSC_LANES] SYNTH_ALIGN;
+  float in[SYNTH_BLOCK * OSC_LANES] SYNTH_ALIGN; // before the ladder
+  float table_in[SYNTH_BLOCK * OSC_LANES] SYNTH_ALIGN; // filtered table voices so far
+  struct s_lanes lanes[wave_count]; // lanes[wave_table] stays empty
+  struct s_lanes ladders[wave_count]; // filtered voices
+  for (int w = 0; w < wave_count; w++) lanes[w].count = ladders[w].count = 0;
+  memset(table_in, 0, sizeof table_in);
+  for (int b = 0; b < frames; b += SYNTH_BLOCK) {
+    int n = frames - b < SYNTH_BLOCK ? frames - b : SYNTH_BLOCK;
+    memset(acc, 0, n * OSC_LANES * sizeof(float));
+    for (int k = first; k < last; k++) {
+      int v = s->active[k];
+      if (s->stage[v] == env_idle) continue;
+      if (s->stage[v] == env_restart) {
+        if (s->next_inc[v]) synth_start(s, v);
+        else s->stage[v] = env_idle;
+      }
+      struct s_control c;
+      synth_control(s, v, n, b / SYNTH_BLOCK, s->amp[v] * s->velocity[v] * gain, &c);
+      int w = s->wave[v];
+      if (s->cutoff[v] > 0) {
+        struct s_lanes *l = &ladders[w];
+        int j = l->count++;
+        l->voice[j] = v;
+        l->cut[j] = c.cut;
+        l->dcut[j] = c.dcut;
+        l->res[j] = s->resonance[v];
+        l->g[j] = c.g;
+        l->dg[j] = c.dg;
+        if (w == wave_table) {
+          struct s_control unit = c;
+          unit.g = 1;
+          unit.dg = 0;
+          synth_table_voice(s, v, table_in + j, n, &unit);
+          if (l->count == OSC_LANES) synth_flush(s, w, l, table_in, acc, n);
+          continue;
+        }
+        l->phase[j] = s->phase[v];
+        l->inc[j] = c.inc;
+        l->dinc[j] = c.dinc;
+        l->width[j] = c.width;
+        l->dwidth[j] = c.dwidth;
+        if (l->count == OSC_LANES) synth_flush(s, w, l, in, acc, n);
+      } else if (w == wave_table) {
+        synth_table_voice(s, v, acc, n, &c);
+      } else {
+        struct s_lanes *l = &lanes[w];
+        int j = l->count++;
+        l->phase[j] = s->phase[v];
+        l->inc[j] = c.inc;
+        l->dinc[j] = c.dinc;
+        l->width[j] = c.width;
+        l->dwidth[j] = c.dwidth;
+        l->g[j] = c.g;
+        l->dg[j] = c.dg;
+        l->voice[j] = v;
+        if (l->count == OSC_LANES) synth_flush(s, w, l, NULL, acc, n);
+      }
+    }
+    for (int w = 0; w < wave_count; w++) {
+      if (lanes[w].count) synth_flush(s, w, &lanes[w], NULL, acc, n);
+      if (ladders[w].count) synth_flush(s, w, &ladders[w], w == wave_table ? table_in : in, acc, n);
+    }
+    for (int i = 0; i < n; i++) {
+      float sum = 0;
+      for (int k = 0; k < OSC_LANES; k++) sum += acc[i * OSC_LANES + k];
+      out[b + i] = sum;
+    }
+  }
+}
+
+// -----------------------------------------------------------
+
+// synth workers
+//
+// threads started ahead of time that render batches alongside data_cb.
+// for each slice data_cb splits the batches into one range per thread,
+// itself included, and everyone takes batches off the front of their
+// own range, then off the back of whoever has most left. a range is a
+// single word, tagged with the slice it belongs to, so a take is one
+// compare and swap and a late worker can't take from the next slice.
+// data_cb then waits for the batches others took and adds up
+// batch_mix in batch order: the batches, and so the sum, don't depend
+// on how many threads there are, and the output is the same bits with
+// or without workers.
+//
+// data_cb never blocks on a worker to start, and takes back whatever
+// nobody has started on. a batch a worker is in the middle of can't be
+// taken back though, the voices are half moved on, so if the workers
+// are still busy past half the slice's time data_cb gives up on the
+// slice: it goes out without the synth, and the synth sits out every
+// period after it until the late batches are in (crew_behind), so
+// nothing touches voice state under a worker. then data_cb renders on
+// its own for the next CREW_FALLBACK slices.
+
+#define CREW_MAX (8)
+#define CREW_SPIN (20000) // polls before a worker goes to sleep
+#define CREW_NAP_NS (1000000) // and how long it sleeps between looks
+#define CREW_FALLBACK (256)
+
+#define CREW_TAG(x) ((unsigned)((x) >> 48))
+#define CREW_LO(x) ((unsigned)((x) >> 24) & 0xffffff)
+#define CREW_HI(x) ((unsigned)(x) & 0xffffff)
+
+static inline uint64_t crew_range(unsigned tag, unsigned lo, unsigned hi) {
+  return (uint64_t)(tag & 0xffff) << 48 | (uint64_t)lo << 24 | hi;
+}
+
+static struct {
+  pthread_t threads[CREW_MAX];
+  atomic_int count;
+  atomic_int stopping;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  atomic_uint slice; // moves on once everything below is set for it
+  struct s_synth *synth;
+  int frames;
+  float gain;
+  _Atomic uint64_t ranges[CREW_MAX + 1]; // [0] is data_cb's
+  atomic_int done; // batches finished by workers
+  atomic_int sleeping; // workers that might be in the timed wait
+  int owed; // done still to come from a slice data_cb gave up on
+  int fallback; // slices left to render alone
+  uint64_t slices, shared, missed; // data_cb only
+  char rt;
+  char started; // by hand or by the first "synth"
+  char patient; // wait out late workers however long, for the bench's bit check
+} crew = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+};
+
+// a batch of the slice tagged tag, or -1 when there are none left
+static int crew_take(int self, unsigned tag) {
+  tag &= 0xffff;
+  _Atomic uint64_t *own = &crew.ranges[self];
+  uint64_t x = atomic_load_explicit(own, memory_order_acquire);
+  while (CREW_TAG(x) == tag && CREW_LO(x) < CREW_HI(x)) {
+    if (atomic_compare_exchange_weak_explicit(own, &x, crew_range(tag, CREW_LO(x) + 1, CREW_HI(x)),
+        memory_order_acq_rel, memory_order_acquire)) {
+      return CREW_LO(x);
+    }
+  }
+  while (1) {
+    int victim = -1;
+    unsigned most = 0;
+    for (int i = 0; i <= CREW_MAX; i++) {
+      uint64_t y = atomic_load_explicit(&crew.ranges[i], memory_order_acquire);
+      if (CREW_TAG(y) == tag && CREW_HI(y) > CREW_LO(y) && CREW_HI(y) - CREW_LO(y) > most) {
+        most = CREW_HI(y) - CREW_LO(y);
+        victim = i;
+      }
+    }
+    if (victim < 0) return -1;
+    x = atomic_load_explicit(&crew.ranges[victim], memory_order_acquire);
+    if (CREW_TAG(x) != tag || CREW_LO(x) >= CREW_HI(x)) continue;
+    if (atomic_compare_exchange_weak_explicit(&crew.ranges[victim], &x,
+        crew_range(tag, CREW_LO(x), CREW_HI(x) - 1), memory_order_acq_rel, memory_order_acquire)) {
+      return CREW_HI(x) - 1;
+    }
+  }
+}
+
+static void *crew_worker(void *arg) {
+  int self = (intptr_t)arg;
+  unsigned seen = atomic_load(&crew.slice);
+  int idle = 0;
+  while (!atomic_load_explicit(&crew.stopping, memory_order_relaxed)) {
+    unsigned slice = atomic_load_explicit(&crew.slice, memory_order_acquire);
+    if (slice == seen) {
+      if (++idle < CREW_SPIN) continue;
+      // asleep until data_cb wakes us or a while has passed, a
+      // missed wake only costs one slice without this worker
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_nsec += CREW_NAP_NS;
+      if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+      }
+      pthread_mutex_lock(&crew.lock);
+      atomic_fetch_add(&crew.sleeping, 1); // before looking at slice, see crew_render
+      if (atomic_load(&crew.slice) == seen && !atomic_load(&crew.stopping)) {
+        pthread_cond_timedwait(&crew.wake, &crew.lock, &until);
+      }
+      atomic_fetch_sub(&crew.sleeping, 1);
+      pthread_mutex_unlock(&crew.lock);
+      continue;
+    }
+    seen = slice;
+    idle = 0;
+    int batch;
+    while ((batch = crew_take(self, slice)) >= 0) {
+      // the slice can't move on while we hold one of its batches
+      synth_batch(crew.synth, batch, crew.frames, crew.gain);
+      atomic_fetch_add_explicit(&crew.done, 1, memory_order_release);
+    }
+  }
+  return NULL;
+}
+
+void crew_stop(void) {
+  int count = atomic_load(&crew.count);
+  if (!count) return;
+  atomic_store(&crew.count, 0);
+  atomic_store(&crew.stopping, 1);
+  pthread_mutex_lock(&crew.lock);
+  pthread_cond_broadcast(&crew.wake);
+  pthread_mutex_unlock(&crew.lock);
+  for (int i = 0; i < count; i++) pthread_join(crew.threads[i], NULL);
+  atomic_store(&crew.stopping, 0);
+}
+
+// n workers, or one for each core but data_cb's when n is -1
+int crew_start(int n) {
+  crew_stop();
+  if (n < 0) n = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  if (n > CREW_MAX) n = CREW_MAX;
+  int count = 0;
+  crew.rt = 1;
+  crew.started = 1;
+  for (int i = 0; i < n; i++) {
+    if (pthread_create(&crew.threads[count], NULL, crew_worker, (void *)(intptr_t)(count + 1)) != 0) break;
+    // the same kind of priority as the device thread, where we're allowed
+    struct sched_param param = {.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1};
+    if (pthread_setschedparam(crew.threads[count], SCHED_FIFO, &param) != 0) crew.rt = 0;
+    count++;
+  }
+  atomic_store(&crew.count, count);
+  LOG("synth workers:%d rt:%s"CR, count, count && crew.rt ? "yes" : "no");
+  return count;
+}
+
+void crew_info(void) {
+  int count = atomic_load(&crew.count);
+  LOG("synth workers:%d rt:%s slices:%lu shared:%lu missed:%lu"CR, count,
+    count && crew.rt ? "yes" : "no", crew.slices, crew.shared, crew.missed);
+}
+
+static double crew_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// data_cb: still waiting on a worker from a slice it gave up on
+static int crew_behind(void) {
+  if (!crew.owed) return 0;
+  if (atomic_load_explicit(&crew.done, memory_order_acquire) < crew.owed) return 1;
+  crew.owed = 0;
+  return 0;
+}
+
+// data_cb: every batch of the slice into batch_mix, 0 if the workers
+// ran past the deadline and it gave up, see crew_behind
+static int crew_render(struct s_synth *s, int batches, int frames, float gain) {
+  int workers = atomic_load_explicit(&crew.count, memory_order_relaxed);
+  crew.slices++;
+  if (batches < 2 || workers == 0 || crew.fallback) {
+    if (crew.fallback) crew.fallback--;
+    for (int b = 0; b < batches; b++) synth_batch(s, b, frames, gain);
+    return 1;
+  }
+  crew.shared++;
+  crew.synth = s;
+  crew.frames = frames;
+  crew.gain = gain;
+  atomic_store_explicit(&crew.done, 0, memory_order_relaxed);
+  unsigned slice = atomic_load_explicit(&crew.slice, memory_order_relaxed) + 1;
+  int ways = workers + 1;
+  for (int i = 0; i <= CREW_MAX; i++) {
+    unsigned lo = i < ways ? i * batches / ways : 0, hi = i < ways ? (i + 1) * batches / ways : 0;
+    atomic_store_explicit(&crew.ranges[i], crew_range(slice, lo, hi), memory_order_relaxed);
+  }
+  // seq_cst against the worker's sleeping then slice, so one of us sees
+  // the other. spinning workers don't need the wake, and a missed one
+  // only costs a nap
+  atomic_store(&crew.slice, slice);
+  if (atomic_load(&crew.sleeping)) pthread_cond_broadcast(&crew.wake);
+  int mine = 0, batch;
+  // our own range, then anything the workers haven't got to
+  while ((batch = crew_take(0, slice)) >= 0) {
+    synth_batch(s, batch, frames, gain);
+    mine++;
+  }
+  double deadline = 0;
+  while (atomic_load_explicit(&crew.done, memory_order_acquire) < batches - mine) {
+    if (deadline == 0) {
+      deadline = crew_now() + 0.5 * frames / s->rate;
+    } else if (!crew.fallback && crew_now() > deadline) {
+      crew.missed++;
+      crew.fallback = CREW_FALLBACK;
+      if (crew.patient) continue;
+      crew.owed = batches - mine;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// data_cb: move the queued commands into pending, sorted by frame. one
+// for a frame already gone, or for none, is due now, and ones due on
+// the same frame stay in the order they were sent. when pending is
+// full the rest wait on the queue for the next period
+static void synth_take(struct s_synth *s) {
+  unsigned head = atomic_load_explicit(&s->head, memory_order_acquire);
+  unsigned tail = atomic_load_explicit(&s->tail, memory_order_relaxed);
+  for (; tail != head; tail++) {
+    if (s->pending_first + s->pending_count == SYNTH_QUEUE) {
+      if (s->pending_first == 0) break;
+      memmove(s->pending, s->pending + s->pending_first, s->pending_count * sizeof *s->pending);
+      s->pending_first = 0;
+    }
+    struct s_synth_cmd c = s->queue[tail & (SYNTH_QUEUE - 1)];
+    if (c.at < s->now) {
+      if (c.at) atomic_fetch_add_explicit(&s->late, 1, memory_order_relaxed);
+      c.at = s->now;
+    }
+    // a sequencer sends in order, so this is nearly always the end
+    struct s_synth_cmd *p = s->pending + s->pending_first;
+    int k = s->pending_count;
+    for (; k > 0 && p[k - 1].at > c.at; k--) p[k] = p[k - 1];
+    p[k] = c;
+    s->pending_count++;
+  }
+  atomic_store_explicit(&s->tail, tail, memory_order_release);
+}
+
+// data_cb: frames with no commands falling inside them, 0 if the
+// workers were too slow and the rest was left out
+static int synth_frames(struct s_synth *s, float *mix, int frames, float gain) {
+  for (int from = 0; from < frames; from += SYNTH_SLICE) {
+    int n = frames - from < SYNTH_SLICE ? frames - from : SYNTH_SLICE;
+    // the bus once for every block, before anyone reads it
+    for (int b = 0; b * SYNTH_BLOCK < n; b++) {
+      int len = n - b * SYNTH_BLOCK < SYNTH_BLOCK ? n - b * SYNTH_BLOCK : SYNTH_BLOCK;
+      for (int m = 0; m < MOD_LFOS; m++) {
+        s->bus_from[b][m] = s->bus_value[m];
+        s->bus_phase[m] += s->bus_inc[m] * (uint32_t)len;
+        s->bus_value[m] = osc_c(s->bus_wave[m], (s->bus_phase[m] >> 8) * PHASE_SCALE, 0.5f, 0, 0);
+        s->bus_to[b][m] = s->bus_value[m];
+      }
+    }
+    int batches = (s->active_count + SYNTH_BATCH - 1) / SYNTH_BATCH;
+    if (!crew_render(s, batches, n, gain)) return 0;
+    for (int b = 0; b < batches; b++) {
+      const float *x = s->batch_mix[b];
+      for (int i = 0; i < n; i++) mix[from + i] += x[i];
+    }
+    for (int k = 0; k < s->active_count; ) {
+      int v = s->active[k];
+      if (s->stage[v] == env_idle) {
+        synth_deactivate(s, v);
+      } else {
+        k++;
+      }
+    }
+  }
+  return 1;
+}
+
+// data_cb: take the queued commands, then add every sounding voice to
+// mix, clearing it first if nothing else has been put there. the
+// frames are rendered in runs that end where the next command or
+// sequencer step is due, so a note starts on its frame whatever the
+// period
+void synth_render(struct s_synth *s, float *mix, int frames, int clear, float gain) {
+  synth_take(s);
+  seq_clock(s);
+  if (clear) memset(mix, 0, frames * sizeof(float));
+  if (crew_behind()) return;
+  for (int from = 0; ; ) {
+    while (s->pending_count && s->pending[s->pending_first].at <= s->now) {
+      synth_apply(s, &s->pending[s->pending_first++]);
+      s->pending_count--;
+    }
+    if (!s->pending_count) s->pending_first = 0;
+    seq_run(s);
+    if (from == frames) break;
+    int n = frames - from;
+    uint64_t due = seq_due(s);
+    if (s->pending_count && s->pending[s->pending_first].at < due) due = s->pending[s->pending_first].at;
+    if (due - s->now < (uint64_t)n) n = due - s->now;
+    if (!synth_frames(s, mix + from, n, gain)) break;
+    from += n;
+    s->now += n;
+  }
+  s->seq.last = s->now;
+  atomic_store_explicit(&s->sounding, s->active_count, memory_order_relaxed);
+  atomic_fetch_add_explicit(&s->blocks, (frames + SYNTH_BLOCK - 1) / SYNTH_BLOCK, memory_order_relaxed);
+}
+
+// control thread
+int synth_send(struct s_synth *s, int op, int voice, float a, float b, float c, float d) {
+  if (voice < 0 || voice >= SYNTH_VOICES) {
+    LOG("voice %d out of range"CR, voice);
+    return -1;
+  }
+  unsigned head = atomic_load_explicit(&s->head, memory_order_relaxed);
+  unsigned tail = atomic_load_explicit(&s->tail, memory_order_acquire);
+  if (head - tail == SYNTH_QUEUE) {
+    s->dropped++;
+    LOG("synth queue full"CR);
+    return -1;
+  }
+  struct s_synth_cmd *cmd = &s->queue[head & (SYNTH_QUEUE - 1)];
+  cmd->op = op;
+  cmd->voice = voice;
+  cmd->v[0] = a;
+  cmd->v[1] = b;
+  cmd->v[2] = c;
+  cmd->v[3] = d;
+  cmd->at = s->stamp;
+  atomic_store_explicit(&s->head, head + 1, memory_order_release);
+  return 0;
+}
+
+void synth_info(struct s_synth *s) {
+  LOG("synth rate:%g sounding:%d blocks:%lu queued:%u dropped:%lu late:%lu at:%lu"CR,
+    s->rate, atomic_load(&s->sounding), atomic_load(&s->blocks),
+    atomic_load(&s->head) - atomic_load(&s->tail), s->dropped, atomic_load(&s->late), s->stamp);
+  if (s->poly_count) {
+    LOG("poly voices:%d..%d steal:%s stolen:%lu"CR, s->poly_base, s->poly_base + s->poly_count - 1,
+      steal_name[s->steal], s->stolen);
+  }
+  crew_info();
+}
+
+//
+
+uint64_t data_cb_count = 0;
+uint64_t data_cb_nodev = 0;
+uint64_t data_cb_fail = 0;
+
+// the callback moves go -> running and running -> done, unless the
+// control thread got there first
+int state_advance(struct s_device *this, int from, int to) {
+  return atomic_compare_exchange_strong_explicit(&this->state, &from, to,
+    memory_order_acq_rel, memory_order_acquire);
+}
+
+// everything data_cb loaded for this period
+struct s_period {
+  struct s_params *params;
+  struct s_audio *audio;
+  struct s_stream *stream;
+  struct s_record *record;
+  struct s_synth *synth;
+  uint32_t position;
+  uint32_t start;
+  uint32_t end;
+  char running;
+};
+
+// same as below for compressed audio, a block at a time
+int render_packed(struct s_device *this, struct s_period *p, float *mix, int frames) {
+  float gain = p->params->gain;
+  for (int i=0; i<frames; ) {
+    if (p->position >= p->end) {
+      p->position = p->start;
+      if (!p->params->loop) {
+        state_advance(this, audio_state_running, audio_state_done);
+        p->running = 0;
+        memset(&mix[i], 0, (frames - i) * sizeof(float));
+        break;
+      }
+    }
+    uint32_t off = p->position % CODEC_BLOCK;
+    const float *block = unpack(p->audio, &this->unpacked, p->position / CODEC_BLOCK);
+    int run = CODEC_BLOCK - off;
+    if (run > frames - i) run = frames - i;
+    if (run > p->end - p->position) run = p->end - p->position;
+    for (int k=0; k<run; k++) mix[i + k] = block[off + k] * gain;
+    i += run;
+    p->position += run;
+  }
+  return 1;
+}
+
+// fill the mix bus from the playback source, returns 0 if it stayed silent
+int render_playback(struct s_device *this, struct s_period *p, float *mix, int frames) {
+  if (!p->running) return 0;
+  if (p->stream) {
+    // stream from the disk thread's ring
+    int end = stream_consume(p->stream, mix, frames);
+    float gain = p->params->gain;
+    if (gain != 1.0f) {
+      for (int i=0; i<frames; i++) mix[i] *= gain;
+    }
+    if (end) {
+      state_advance(this, audio_state_running, audio_state_done);
+      p->running = 0;
+    }
+    return 1;
+  }
+  if (!p->audio) return 0;
+  if (p->audio->codec != codec_f32) return render_packed(this, p, mix, frames);
+  if (!p->audio->buffer) return 0;
+  float gain = p->params->gain;
+  for (int i=0; i<frames; i++) {
+    if (p->position >= p->end) {
+      p->position = p->start;
+      if (!p->params->loop) {
+        state_advance(this, audio_state_running, audio_state_done);
+        p->running = 0;
+        memset(&mix[i], 0, (frames - i) * sizeof(float));
+        break;
+      }
+    }
+    mix[i] = p->audio->buffer[p->position++] * gain;
+  }
+  return 1;
+}
+
+// take the mix bus to the capture destination
+void render_capture(struct s_device *this, struct s_period *p, const float *mix, int frames) {
+  if (!p->running) return;
+  if (p->record) {
+    // hand the period to the disk thread, no length limit
+    record_produce(p->record, mix, frames);
+    return;
+  }
+  if (!p->audio || !p->audio->buffer) return;
+  float gain = p->params->gain;
+  for (int i=0; i<frames; i++) {
+    if (p->position >= p->end) {
+      p->position = p->start;
+      if (!p->params->loop) {
+        state_advance(this, audio_state_running, audio_state_done);
+        p->running = 0;
+        break;
+      }
+    }
+    p->audio->buffer[p->position++] = mix[i] * gain;
+  }
+}
+
+void data_cb(ma_device *pDevice, void *playback, const void *capture, ma_uint32 frame_count) {
+  if (pDevice) {
+    struct s_device *this = (struct s_device *)pDevice->pUserData;
+    if (this) {
+      atomic_fetch_add(&this->cb_seq, 1); // odd, see device_sync
+      atomic_store(&this->cb_epoch, atomic_load(&global_epoch)); // see reclaim
+      atomic_thread_fence(memory_order_seq_cst); // cb_seq and cb_epoch before the pointers
+      this->data_cb_count++;
+      // take one snapshot of everything for this period
+      struct s_period p;
+      p.params = &this->params[triple_acquire(&this->params_tb)];
+      p.audio = atomic_load_explicit(&this->audio, memory_order_acquire);
+      p.stream = atomic_load_explicit(&this->stream, memory_order_acquire);
+      p.record = atomic_load_explicit(&this->record, memory_order_acquire);
+      p.synth = atomic_load_explicit(&this->synth, memory_order_acquire);
+      p.position = atomic_load_explicit(&this->position, memory_order_relaxed);
+      uint64_t clock = atomic_load_explicit(&this->clock, memory_order_relaxed);
+      p.start = p.params->start;
+      p.end = 0;
+      if (p.audio) {
+        p.end = p.params->end ? p.params->end : p.audio->len;
+        if (p.end > p.audio->len) p.end = p.audio->len;
+        // the renderers wrap to start, so it has to be inside the buffer
+        if (p.start >= p.end) p.start = p.end ? p.end - 1 : 0;
+        if (p.end == 0) p.audio = NULL; // nothing to play or fill
+      }
+      if (state_advance(this, audio_state_go, audio_state_running)) {
+        // this give us a chance to trigger something at start
+        p.position = p.start;
+        p.running = 1;
+      } else {
+        p.running = atomic_load_explicit(&this->state, memory_order_acquire) == audio_state_running;
+      }
+      uint32_t *rng = p.params->dither ? this->rng : NULL;
+      ma_uint32 out_bpf = ma_get_bytes_per_frame(pDevice->playback.format, pDevice->playback.channels);
+      ma_uint32 in_bpf = ma_get_bytes_per_frame(pDevice->capture.format, pDevice->capture.channels);
+      // the period goes through the mix bus in MIX_FRAMES chunks,
+      // converted once at the edge on the way in or out
+      for (ma_uint32 done = 0; done < frame_count; ) {
+        int n = frame_count - done < MIX_FRAMES ? frame_count - done : MIX_FRAMES;
+        if (capture) {
+          if (edge_in(this->mix, pDevice->capture.format,
+              (const uint8_t *)capture + done * in_bpf, n, pDevice->capture.channels) == 0) {
+            render_capture(this, &p, this->mix, n);
+          }
+        }
+        if (playback) {
+          // miniaudio hands us a silent buffer, only convert if we made sound
+          int made = render_playback(this, &p, this->mix, n);
+          if (p.synth) {
+            p.synth->now = clock + done; // the engine keeps time by this device
+            synth_render(p.synth, this->mix, n, !made, p.params->gain);
+            made = 1;
+          }
+          if (made) {
+            edge_out((uint8_t *)playback + done * out_bpf, pDevice->playback.format,
+              this->mix, n, pDevice->playback.channels, rng);
+          }
+        }
+        done += n;
+      }
+      atomic_store_explicit(&this->position, p.position, memory_order_relaxed);
+      atomic_store_explicit(&this->clock, clock + frame_count, memory_order_relaxed);
+      atomic_store(&this->cb_epoch, 0);
+      atomic_fetch_add(&this->cb_seq, 1); // even, we are done with the pointers
+    } else {
+      data_cb_fail++;
+    }
+    data_cb_count++;
+  } else {
+    data_cb_nodev++;
+  }
+}
+
+//
+
+void notification_cb(const ma_device_notification *pNotification) {
+  if (pNotification) {
+    struct s_device *dev = (struct s_device *)pNotification->pDevice->pUserData;
+    switch (pNotification->type) {
+      case ma_device_notification_type_started:
+        LOG("notify started id:%d"CR, dev->id);
+        break;
+      case ma_device_notification_type_stopped:
+        LOG("notify stopped id:%d"CR, dev->id);
+        break;
+      case ma_device_notification_type_rerouted:
         LOG("notify rerouted id:%d"CR, dev->id);
         break;
       case ma_device_notification_type_interruption_began:
@@ -911,7 +5595,7 @@ int assign(struct s_device *this) {
       #else
       this->cfg.periodSizeInMilliseconds = PERIOD_IN_MS;
       #endif
-      this->cfg.sampleRate = 44100;
+      this->cfg.sampleRate = SAMPLERATE;
       this->cfg.dataCallback = data_cb;
       this->cfg.notificationCallback = notification_cb;
       this->cfg.pUserData = this; // should point to something useful, trying struct s_device
@@ -925,6 +5609,7 @@ int assign(struct s_device *this) {
           ma_device_uninit(&this->dev);
         } else {
           this->assigned = 1;
+          if (this->type == TYPE_PLAYBACK) cache_fill_rate(this->dev.sampleRate);
           LOG("OKAY"CR);
           return 0;
         }
@@ -942,22 +5627,17 @@ void mkwave(struct s_audio *audio, int wave, float hz, float gain, char find) {
   if (audio->len == 0) return;
 
   int duration = audio->len;
-  float att = gain;
-  float acc = gain;
-
-  LOG("att=%g"CR, att);
-  LOG("acc=%g"CR, acc);
-
-  float *b = (float *)malloc(duration * sizeof(float));
-  float y, gy;
-
+  float *b = audio->buffer;
+
+  // DDS off the sine table instead of a sin() a sample
+  const struct s_audio *sine = atomic_load(&wavetables[0]);
+  if (!sine) return;
+  uint32_t phase = 0;
+  uint32_t inc = phase_inc(hz, SAMPLERATE);
+  const float *x = wt_level(sine, wt_mip(inc));
   for (int i = 0; i < duration; i++) {
-    y = sin(hz * (2 * M_PI) * i / SAMPLERATE);
-    gy = y * att;
-    int16_t iy = (int16_t)(gy * 32767);
-    b[i] = gy;
-    audio->buffer[i] = iy;
-    //att -= acc; // attenuate during length of wave
+    b[i] = wt_linear(x, phase) * gain;
+    phase += inc;
   }
   char found = 0;
   int found_index = 0;
@@ -989,13 +5669,27 @@ void mkwave(struct s_audio *audio, int wave, float hz, float gain, char find) {
     LOG("didn't find zero-crossing downgoing"CR);
   }
   LOG("hz:%g gain:%g"CR, hz, gain);
-  free(b);
 }
 
+#ifndef EXA_BENCH
 int main(int argc, char *argv[]) {
   LOG("exaudio"CR);
   atexit(cleaner);
 
+  edge_init();
+  osc_init();
+  resample_init();
+  pool_counters_open();
+  synth_init(&synth, SAMPLERATE);
+  wavetable_init();
+
+  playback_audio.buffer = pool_alloc(SAMPLERATE * sizeof(float));
+  capture_audio.buffer = pool_alloc(SAMPLERATE * sizeof(float));
+  if (!playback_audio.buffer || !capture_audio.buffer) {
+    LOG("no memory for device buffers"CR);
+    return 1;
+  }
+
   mkwave(&playback_audio, 0, 220, 1, 0); // hack to test playback sine wave
   
   struct exa_tuple tuple;
@@ -1021,6 +5715,20 @@ int main(int argc, char *argv[]) {
       LOG("parent changed!"CR);
       break;
     }
+    // wait for a command or for the decode workers to finish something
+    struct pollfd fds[2] = {
+      {.fd = fdin, .events = POLLIN},
+      {.fd = loader.pipe[0], .events = POLLIN},
+    };
+    // retired audio gets another look every so often even when idle
+    if (poll(fds, 2, retired ? RECLAIM_POLL_MS : -1) < 0) {
+      if (errno == EINTR) continue;
+      LOG("poll error <%s>"CR, strerror(errno));
+      break;
+    }
+    if (retired) reclaim();
+    if (fds[1].revents & POLLIN) load_finish(fdout);
+    if (!fds[0].revents) continue;
     int n = exa_parse(fdin, &tuple);
     if (n == read_okay) {
       LOG("read_okay"CR);
@@ -1049,38 +5757,479 @@ int main(int argc, char *argv[]) {
         if (tuple.count < 2) {
           LOG("need a device id"CR);
         } else {
-          struct s_device *dev = find_device(tuple.val);
-          if (!dev) {
-            LOG("invalid id"CR);
-          } else {
-            assign(dev);
+          struct s_device *dev = find_device(tuple.val);
+          if (!dev) {
+            LOG("invalid id"CR);
+          } else {
+            assign(dev);
+          }
+        }
+      } else if (strcmp(tuple.key, "go") == 0) {
+        // either start capture or playback with buffer assigned to device
+        if (tuple.count < 2) {
+          LOG("need a device id"CR);
+        } else {
+          struct s_device *this = find_device(tuple.val);
+          if (!this) {
+            LOG("unknown device"CR);
+          } else {
+            LOG("go dev:%p"CR, this);
+            struct s_stream *stream = atomic_load(&this->stream);
+            struct s_audio *audio = atomic_load(&this->audio);
+            if (stream) {
+              if (atomic_load(&this->state) != audio_state_idle) {
+                // played before, start over from the preload
+                atomic_store(&this->state, audio_state_idle);
+                device_sync(this);
+                pthread_mutex_lock(&stream->lock);
+                stream_preload(stream);
+                pthread_mutex_unlock(&stream->lock);
+              }
+              atomic_store_explicit(&this->state, audio_state_go, memory_order_release);
+            } else if (atomic_load(&this->record) || (audio && (audio->buffer || audio->packed))) {
+              atomic_store_explicit(&this->state, audio_state_go, memory_order_release);
+            } else {
+              LOG("no audio buffer in this device"CR);
+            }
+          }
+        }
+      } else if (strcmp(tuple.key, "stop") == 0) {
+        // {"stop", devid} goes back to idle at the next period
+        struct s_device *this = NULL;
+        if (tuple.count < 2) {
+          LOG("need a device id"CR);
+        } else if (!(this = find_device(tuple.val))) {
+          LOG("unknown device"CR);
+        } else {
+          atomic_store_explicit(&this->state, audio_state_idle, memory_order_release);
+        }
+      } else if (strcmp(tuple.key, "gain") == 0 ||
+                 strcmp(tuple.key, "loop") == 0 ||
+                 strcmp(tuple.key, "dither") == 0 ||
+                 strcmp(tuple.key, "range") == 0) {
+        // {"gain", devid, milli} {"loop", devid, 0|1} {"range", devid, [start, end]}
+        // {"dither", devid, 0|1}
+        struct s_device *this = NULL;
+        if (tuple.count < 3) {
+          LOG("need a device id and a value"CR);
+        } else if (!(this = find_device(tuple.val))) {
+          LOG("unknown device"CR);
+        } else if (tuple.key[0] == 'g' && tuple.type == exa_int) {
+          this->params_edit.gain = tuple.arg / 1000.0;
+          device_params_publish(this);
+        } else if (tuple.key[0] == 'd' && tuple.type == exa_int) {
+          this->params_edit.dither = tuple.arg != 0;
+          device_params_publish(this);
+        } else if (tuple.key[0] == 'l' && tuple.type == exa_int) {
+          this->params_edit.loop = tuple.arg != 0;
+          device_params_publish(this);
+        } else if (tuple.key[0] == 'r' && tuple.type == exa_list && tuple.len >= 2 &&
+            tuple.list[1] > 0 && tuple.list[0] >= tuple.list[1]) {
+          LOG("start has to be before end"CR);
+        } else if (tuple.key[0] == 'r' && tuple.type == exa_list && tuple.len >= 2) {
+          this->params_edit.start = tuple.list[0] < 0 ? 0 : tuple.list[0];
+          this->params_edit.end = tuple.list[1] < 0 ? 0 : tuple.list[1];
+          device_params_publish(this);
+        } else {
+          LOG("bad value"CR);
+        }
+      } else if (strcmp(tuple.key, "synth") == 0) {
+        // {"synth", devid} adds the oscillators to a playback device,
+        // {"synth", devid, 0} takes them off again
+        struct s_device *this = NULL;
+        if (tuple.count < 2) {
+          LOG("need a device id"CR);
+        } else if (!(this = find_device(tuple.val)) || this->type != TYPE_PLAYBACK || !this->assigned) {
+          LOG("need an assigned playback device"CR);
+        } else {
+          // only one callback may run the engine at a time
+          struct s_device *dev;
+          for (dev = devices; dev != NULL; dev = dev->hh.next) {
+            if (atomic_exchange(&dev->synth, NULL)) device_sync(dev);
+          }
+          if (tuple.count < 3 || tuple.type != exa_int || tuple.arg) {
+            synth_rate(&synth, this->dev.sampleRate);
+            if (!crew.started) crew_start(-1);
+            atomic_store(&this->synth, &synth);
+          }
+        }
+      } else if (strcmp(tuple.key, "workers") == 0) {
+        // {"workers", n} threads to help render the synth, -1 for one per spare core
+        if (tuple.count < 2 || tuple.val < -1 || tuple.val > CREW_MAX) {
+          LOG("workers are -1..%d"CR, CREW_MAX);
+        } else {
+          crew_start(tuple.val);
+        }
+      } else if (strcmp(tuple.key, "clock") == 0) {
+        // {"clock", devid} replies {"clock", devid, [high, low]}, the frame
+        // the device is up to as high * 2^31 + low
+        struct s_device *this = NULL;
+        if (tuple.count < 2 || !(this = find_device(tuple.val))) {
+          LOG("need a device id"CR);
+        } else {
+          uint64_t frame = atomic_load(&this->clock);
+          int32_t parts[2] = {frame >> 31, frame & 0x7fffffff};
+          struct exa_tuple reply = {.type = exa_list, .val = tuple.val, .count = 3, .list = parts, .len = 2};
+          snprintf(reply.key, KEY_STORE, "clock");
+          exa_send(fdout, &reply);
+        }
+      } else if (strcmp(tuple.key, "at") == 0) {
+        // {"at", [high, low]} synth commands after this are for that frame of
+        // the synth's device, {"at"} or {"at", 0} goes back to straight away
+        if (tuple.count < 2 || tuple.type != exa_list) {
+          synth.stamp = 0;
+        } else if (tuple.len < 2 || tuple.list[0] < 0 || tuple.list[1] < 0) {
+          LOG("need [high, low] from \"clock\""CR);
+        } else {
+          synth.stamp = (uint64_t)tuple.list[0] << 31 | tuple.list[1];
+        }
+      } else if (strcmp(tuple.key, "seq-tempo") == 0) {
+        // {"seq-tempo", [bpm_milli, steps_per_beat, steps_per_bar, swing_milli]}
+        if (tuple.count < 2 || tuple.type != exa_list || tuple.len < 4 || tuple.list[0] <= 0 ||
+            tuple.list[1] <= 0 || tuple.list[2] <= 0 || tuple.list[3] < 0 || tuple.list[3] > 900) {
+          LOG("need [bpm_milli, steps_per_beat, steps_per_bar, swing_milli 0..900]"CR);
+        } else {
+          synth.seq.edit.bpm = tuple.list[0] / 1000.0;
+          synth.seq.edit.steps_per_beat = tuple.list[1];
+          synth.seq.edit.steps_per_bar = tuple.list[2];
+          synth.seq.edit.swing = tuple.list[3] / 1000.0;
+        }
+      } else if (strcmp(tuple.key, "seq-track") == 0) {
+        // {"seq-track", track, [voice, length]} empties the track, voice -1 turns it off
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 2) {
+          LOG("need a track and [voice, length]"CR);
+        } else if (tuple.val < 0 || tuple.val >= SEQ_TRACKS || tuple.list[0] < -1 ||
+            tuple.list[0] >= SYNTH_VOICES || tuple.list[1] < 1 || tuple.list[1] > SEQ_STEPS) {
+          LOG("tracks are 0..%d, lengths 1..%d"CR, SEQ_TRACKS - 1, SEQ_STEPS);
+        } else {
+          struct s_seq_track *track = &synth.seq.edit.track[tuple.val];
+          track->voice = tuple.list[0];
+          track->length = tuple.list[1];
+          for (int i = 0; i < SEQ_STEPS; i++) track->step[i] = (struct s_seq_step){.note = -1};
+        }
+      } else if (strcmp(tuple.key, "seq-step") == 0) {
+        // {"seq-step", track, [step, note, velocity_milli, gate_milli, lock, value, ...]}
+        // note -1 rests, gate 0 holds to the next note
+        // a lock takes the same values as "filter", "morph" and "osc" width
+        static const float lock_scale[lock_count] = {1 / 1000.0, 1 / 250.0, 1 / 1000.0, 1 / 1000.0};
+        static const int32_t lock_max[lock_count] = {INT32_MAX, 1000, 1000, 1000};
+        int bad = 0;
+        for (int i = 4; tuple.type == exa_list && i + 1 < tuple.len; i += 2) {
+          int lock = tuple.list[i];
+          if (lock < 0 || lock >= lock_count || tuple.list[i + 1] < 0 || tuple.list[i + 1] > lock_max[lock]) bad = 1;
+        }
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 4 || tuple.len % 2) {
+          LOG("need a track and [step, note, velocity_milli, gate_milli, lock, value, ...]"CR);
+        } else if (tuple.val < 0 || tuple.val >= SEQ_TRACKS || tuple.list[0] < 0 ||
+            tuple.list[0] >= SEQ_STEPS || tuple.list[1] < -1 || tuple.list[1] > 127 ||
+            tuple.list[2] < 0 || tuple.list[2] > 1000 || tuple.list[3] < 0) {
+          LOG("tracks are 0..%d, steps 0..%d, notes -1..127, velocity 0..1000"CR, SEQ_TRACKS - 1, SEQ_STEPS - 1);
+        } else if (bad) {
+          LOG("locks: 0 cutoff millihertz, 1 resonance_milli 0..1000, 2 morph_milli 0..1000, 3 width_milli 0..1000"CR);
+        } else {
+          struct s_seq_step step = {.note = tuple.list[1], .velocity = tuple.list[2] / 1000.0,
+            .gate = tuple.list[3] / 1000.0};
+          for (int i = 4; i < tuple.len; i += 2) {
+            int lock = tuple.list[i];
+            step.locked |= 1 << lock;
+            step.lock[lock] = tuple.list[i + 1] * lock_scale[lock];
+          }
+          synth.seq.edit.track[tuple.val].step[tuple.list[0]] = step;
+        }
+      } else if (strcmp(tuple.key, "seq-commit") == 0) {
+        // {"seq-commit"} the edited pattern plays from the next bar
+        seq_publish(&synth.seq);
+      } else if (strcmp(tuple.key, "seq-start") == 0) {
+        // {"seq-start"} from the first step of the newest pattern, on the "at" frame if set
+        synth_send(&synth, synth_seq, 0, 1, 0, 0, 0);
+      } else if (strcmp(tuple.key, "seq-stop") == 0) {
+        synth_send(&synth, synth_seq, 0, 0, 0, 0, 0);
+      } else if (strcmp(tuple.key, "osc") == 0) {
+        // {"osc", voice, [wave, millihertz, amp_milli, width_milli]}
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 3) {
+          LOG("need a voice and [wave, millihertz, amp_milli]"CR);
+        } else if (tuple.list[0] < 0 || tuple.list[0] >= wave_count) {
+          LOG("wave is 0..%d"CR, wave_count - 1);
+        } else {
+          float width = tuple.len > 3 ? tuple.list[3] / 1000.0 : 0.5;
+          synth_send(&synth, synth_osc, tuple.val, tuple.list[0],
+            fabs(tuple.list[1] / 1000.0), tuple.list[2] / 1000.0, width);
+        }
+      } else if (strcmp(tuple.key, "table") == 0) {
+        // {"table", slot, [s16 samples]} or {"table", slot, "cycle.raw"}, one cycle of up to WT_CYCLE_MAX
+        if (tuple.count < 3) {
+          LOG("need a slot and a cycle"CR);
+        } else if (tuple.type == exa_list && tuple.len < 1) {
+          LOG("the cycle is empty"CR);
+        } else if (tuple.type == exa_list) {
+          float *cycle = malloc(tuple.len * sizeof(float));
+          if (cycle) {
+            for (int i=0; i<tuple.len; i++) cycle[i] = tuple.list[i] / 32768.0;
+            wavetable_load(tuple.val, cycle, tuple.len);
+            free(cycle);
+          }
+        } else if (tuple.type == exa_binary) {
+          uint32_t len;
+          float *cycle = read_raw((char *)tuple.blob, &len);
+          if (cycle) {
+            wavetable_load(tuple.val, cycle, len);
+            pool_free(cycle);
+          }
+        } else {
+          LOG("need samples or a file name"CR);
+        }
+      } else if (strcmp(tuple.key, "wavetable") == 0) {
+        // {"wavetable", voice, [table_a, table_b, morph_milli, interp]} for voices on wave 5
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 1) {
+          LOG("need a voice and [table_a, table_b, morph_milli, interp]"CR);
+        } else {
+          int a = tuple.list[0];
+          int b = tuple.len > 1 ? tuple.list[1] : a;
+          int interp = tuple.len > 3 ? tuple.list[3] : interp_linear;
+          if (a < 0 || a >= WT_SLOTS || b < 0 || b >= WT_SLOTS || interp < 0 || interp >= interp_count) {
+            LOG("tables are 0..%d, interp 0 linear or 1 cubic"CR, WT_SLOTS - 1);
+          } else {
+            float morph = tuple.len > 2 ? tuple.list[2] / 1000.0 : 0;
+            synth_send(&synth, synth_table, tuple.val, a, b, morph, interp);
+          }
+        }
+      } else if (strcmp(tuple.key, "morph") == 0) {
+        // {"morph", voice, morph_milli}
+        if (tuple.count < 3 || tuple.type != exa_int) {
+          LOG("need a voice and a morph"CR);
+        } else {
+          synth_send(&synth, synth_morph, tuple.val, tuple.arg / 1000.0, 0, 0, 0);
+        }
+      } else if (strcmp(tuple.key, "lfo") == 0) {
+        // {"lfo", voice, [wave, millihertz, pitch_cents, amp_milli, width_milli]}, 0 depths for none
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 5) {
+          LOG("need a voice and [wave, millihertz, pitch_cents, amp_milli, width_milli]"CR);
+        } else if (tuple.list[0] < 0 || tuple.list[0] > wave_saw) {
+          LOG("lfo wave is 0..%d"CR, wave_saw);
+        } else {
+          synth_send(&synth, synth_lfo, tuple.val, tuple.list[0], fabs(tuple.list[1] / 1000.0), 0, 0);
+          synth_send(&synth, synth_lfo_depth, tuple.val, tuple.list[2] / 1200.0,
+            tuple.list[3] / 1000.0, tuple.list[4] / 1000.0, 0);
+        }
+      } else if (strcmp(tuple.key, "bus-lfo") == 0) {
+        // {"bus-lfo", n, [wave, millihertz]}, shared by every voice that routes from it
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 2) {
+          LOG("need an lfo and [wave, millihertz]"CR);
+        } else if (tuple.val < 0 || tuple.val >= MOD_LFOS || tuple.list[0] < 0 || tuple.list[0] > wave_saw) {
+          LOG("bus lfos are 0..%d, waves 0..%d"CR, MOD_LFOS - 1, wave_saw);
+        } else {
+          synth_send(&synth, synth_bus_lfo, tuple.val, tuple.list[0], fabs(tuple.list[1] / 1000.0), 0, 0);
+        }
+      } else if (strcmp(tuple.key, "route") == 0) {
+        // {"route", voice, [source, dest, depth]}, depth in cents for pitch and cutoff, else milli, 0 removes
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 3) {
+          LOG("need a voice and [source, dest, depth]"CR);
+        } else if (tuple.list[0] < 0 || tuple.list[0] >= mod_sources || tuple.list[1] < 0 || tuple.list[1] >= mod_dests) {
+          LOG("sources: 0 voice lfo, 1 envelope, %d.. bus lfos; dests: 0 pitch, 1 amp, 2 width, 3 morph, 4 cutoff"CR,
+            mod_bus);
+        } else {
+          int cents = tuple.list[1] == mod_pitch || tuple.list[1] == mod_cutoff;
+          float depth = tuple.list[2] / (cents ? 1200.0 : 1000.0);
+          synth_send(&synth, synth_route, tuple.val, tuple.list[0], tuple.list[1], depth, 0);
+        }
+      } else if (strcmp(tuple.key, "filter") == 0) {
+        // {"filter", voice, [millihertz, resonance_milli]}, a moog ladder, 0 Hz takes it off
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 2) {
+          LOG("need a voice and [millihertz, resonance_milli]"CR);
+        } else if (tuple.list[0] < 0 || tuple.list[1] < 0 || tuple.list[1] > 1000) {
+          LOG("resonance is 0..1000, it rings at 1000"CR);
+        } else {
+          synth_send(&synth, synth_filter, tuple.val, tuple.list[0] / 1000.0, tuple.list[1] / 250.0, 0, 0);
+        }
+      } else if (strcmp(tuple.key, "poly") == 0) {
+        // {"poly", base, [count, steal]}, the patch is whatever voice base is set to
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 2) {
+          LOG("need a first voice and [count, steal]"CR);
+        } else if (tuple.val < 0 || tuple.list[0] < 0 || tuple.val + tuple.list[0] > SYNTH_VOICES ||
+            tuple.list[1] < 0 || tuple.list[1] >= steal_count) {
+          LOG("voices are 0..%d, steal 0 oldest, 1 quietest, 2 same key"CR, SYNTH_VOICES - 1);
+        } else {
+          synth_send(&synth, synth_poly, tuple.val, tuple.list[0], tuple.list[1], 0, 0);
+        }
+      } else if (strcmp(tuple.key, "key-on") == 0) {
+        // {"key-on", key, [millihertz, velocity_milli]}
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 1 || tuple.list[0] <= 0) {
+          LOG("need a key and [millihertz, velocity_milli]"CR);
+        } else if (tuple.val < 0 || tuple.val >= SYNTH_KEYS) {
+          LOG("keys are 0..%d"CR, SYNTH_KEYS - 1);
+        } else {
+          float velocity = tuple.len > 1 ? tuple.list[1] / 1000.0 : 1;
+          synth_send(&synth, synth_key_on, tuple.val, fabs(tuple.list[0] / 1000.0), velocity, 0, 0);
+        }
+      } else if (strcmp(tuple.key, "key-off") == 0) {
+        // {"key-off", key}
+        if (tuple.count < 2 || tuple.val < 0 || tuple.val >= SYNTH_KEYS) {
+          LOG("need a key 0..%d"CR, SYNTH_KEYS - 1);
+        } else {
+          synth_send(&synth, synth_key_off, tuple.val, 0, 0, 0, 0);
+        }
+      } else if (strcmp(tuple.key, "adsr") == 0) {
+        // {"adsr", voice, [attack_ms, decay_ms, sustain_milli, release_ms]}
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 4) {
+          LOG("need a voice and [attack_ms, decay_ms, sustain_milli, release_ms]"CR);
+        } else {
+          synth_send(&synth, synth_adsr, tuple.val, tuple.list[0] / 1000.0,
+            tuple.list[1] / 1000.0, tuple.list[2] / 1000.0, tuple.list[3] / 1000.0);
+        }
+      } else if (strcmp(tuple.key, "note-on") == 0) {
+        // {"note-on", voice} or {"note-on", voice, millihertz}
+        if (tuple.count < 2) {
+          LOG("need a voice"CR);
+        } else {
+          float hz = tuple.count > 2 && tuple.type == exa_int ? fabs(tuple.arg / 1000.0) : 0;
+          synth_send(&synth, synth_on, tuple.val, hz, 0, 0, 0);
+        }
+      } else if (strcmp(tuple.key, "note-off") == 0) {
+        // {"note-off", voice}
+        if (tuple.count < 2) {
+          LOG("need a voice"CR);
+        } else {
+          synth_send(&synth, synth_off, tuple.val, 0, 0, 0, 0);
+        }
+      } else if (strcmp(tuple.key, "stream") == 0) {
+        // {"stream", devid, "path"} plays a raw f32 file from disk on "go"
+        // {"stream", devid} goes back to the device's audio buffer
+        struct s_device *this = NULL;
+        if (tuple.count < 2) {
+          LOG("need a device id"CR);
+        } else if (!(this = find_device(tuple.val)) || this->type != TYPE_PLAYBACK) {
+          LOG("unknown playback device"CR);
+        } else {
+          atomic_store(&this->state, audio_state_idle);
+          struct s_stream *old = atomic_exchange(&this->stream, NULL);
+          device_sync(this);
+          stream_close(old);
+          if (tuple.count > 2 && tuple.type == exa_binary) {
+            atomic_store(&this->stream, stream_open((char *)tuple.blob));
           }
         }
-      } else if (strcmp(tuple.key, "go") == 0) {
-        // either start capture or playback with buffer assigned to device
+      } else if (strcmp(tuple.key, "record") == 0) {
+        // {"record", devid, "path"} records to a WAV (or .raw) file on "go"
+        // {"record", devid} stops and finishes the file
+        struct s_device *this = NULL;
         if (tuple.count < 2) {
           LOG("need a device id"CR);
+        } else if (!(this = find_device(tuple.val)) || this->type != TYPE_CAPTURE) {
+          LOG("unknown capture device"CR);
         } else {
-          struct s_device *this = find_device(tuple.val);
-          if (!this) {
-            LOG("unknown device"CR);
-          } else {
-            LOG("go dev:%p"CR, this);
-            if (this->audio && this->audio->buffer) {
-              this->state = audio_state_go;
-            } else {
-              LOG("no audio buffer in this device"CR);
-            }
+          atomic_store(&this->state, audio_state_idle);
+          struct s_record *old = atomic_exchange(&this->record, NULL);
+          device_sync(this);
+          record_close(old);
+          if (tuple.count > 2 && tuple.type == exa_binary) {
+            atomic_store(&this->record, record_open((char *)tuple.blob));
           }
         }
+      } else if (strcmp(tuple.key, "record-opts") == 0) {
+        // {"record-opts", [direct, prealloc_seconds]} applies to the next "record"
+        if (tuple.type == exa_list && tuple.len >= 2) {
+          record_opts = tuple.list[0] ? RECORD_OPT_DIRECT : 0;
+          record_prealloc_seconds = tuple.list[1];
+        } else {
+          LOG("need [direct, prealloc_seconds]"CR);
+        }
       } else if (strcmp(tuple.key, "retrieve") == 0) {
         LOG("retrieve"CR);
         // needs a device id
         // expects a sample count, returns the array after the state is done
       } else if (strcmp(tuple.key, "store") == 0) {
-        LOG("store"CR);
-        // needs a device id
-        // expects a sample array
+        // {"store", slot, [s16 samples]} or {"store", slot, "file.raw"}
+        // at SAMPLERATE unless "rate" says otherwise
+        if (tuple.count < 3) {
+          LOG("need a slot and samples"CR);
+        } else if (tuple.type == exa_list) {
+          float *buffer = pool_alloc(tuple.len * sizeof(float));
+          if (buffer) {
+            for (int i=0; i<tuple.len; i++) buffer[i] = tuple.list[i] / 32768.0;
+            bank_store(tuple.val, buffer, tuple.len, SAMPLERATE);
+          }
+        } else if (tuple.type == exa_binary) {
+          bank_load_raw(tuple.val, (char *)tuple.blob, SAMPLERATE);
+        } else {
+          LOG("need samples or a file name"CR);
+        }
+      } else if (strcmp(tuple.key, "pool") == 0) {
+        // {"pool", mode} 0 normal pages, 1 thp, 2 hugetlb, for samples stored after
+        if (tuple.count < 2) {
+          LOG("need a mode"CR);
+        } else {
+          pool_set_mode(tuple.val);
+        }
+      } else if (strcmp(tuple.key, "codec") == 0) {
+        // {"codec", slot, codec} 0 f32, 1 adpcm, 2 pcm12, repacks what is there
+        int slot = tuple.val;
+        if (tuple.count < 3 || tuple.type != exa_int) {
+          LOG("need a slot and a codec"CR);
+        } else if (slot < 0 || slot >= BANK_SLOTS || tuple.arg < 0 || tuple.arg >= codec_count) {
+          LOG("bad slot or codec"CR);
+        } else if (bank_codec[slot] != tuple.arg) {
+          bank_codec[slot] = tuple.arg;
+          struct s_audio *a = bank[slot];
+          float *buffer = a ? audio_floats(a) : NULL;
+          if (buffer) bank_store(slot, buffer, a->len, a->rate);
+        }
+      } else if (strcmp(tuple.key, "trim") == 0) {
+        // {"trim", slot, [start, end]}
+        if (tuple.count < 3 || tuple.type != exa_list || tuple.len < 2) {
+          LOG("need a slot and [start, end]"CR);
+        } else {
+          bank_edit(tuple.val, edit_trim, tuple.list[0], tuple.list[1]);
+        }
+      } else if (strcmp(tuple.key, "reverse") == 0) {
+        // {"reverse", slot}
+        if (tuple.count < 2) {
+          LOG("need a slot"CR);
+        } else {
+          bank_edit(tuple.val, edit_reverse, 0, 0);
+        }
+      } else if (strcmp(tuple.key, "normalize") == 0) {
+        // {"normalize", slot} or {"normalize", slot, peak_milli}
+        if (tuple.count < 2) {
+          LOG("need a slot"CR);
+        } else {
+          bank_edit(tuple.val, edit_normalize, tuple.count > 2 ? tuple.arg : 0, 0);
+        }
+      } else if (strcmp(tuple.key, "load") == 0) {
+        // {"load", slot, "file.wav"} decodes in the background, see load_finish
+        if (tuple.count < 3 || tuple.type != exa_binary) {
+          LOG("need a slot and a file name"CR);
+        } else if (load_submit(tuple.val, (char *)tuple.blob) < 0) {
+          exa_event(fdout, "load-error", tuple.val, load_no_memory);
+        }
+      } else if (strcmp(tuple.key, "rate") == 0) {
+        // {"rate", slot, hz} says what rate a stored sample was recorded at
+        int slot = tuple.val;
+        if (tuple.count < 3 || tuple.type != exa_int || tuple.arg <= 0) {
+          LOG("need a slot and a rate"CR);
+        } else if (slot < 0 || slot >= BANK_SLOTS || !bank[slot]) {
+          LOG("empty slot"CR);
+        } else {
+          // same samples, new id, so the old variants go
+          struct s_audio *a = bank[slot];
+          float *buffer = audio_floats(a);
+          if (buffer) bank_store(slot, buffer, a->len, tuple.arg);
+        }
+      } else if (strcmp(tuple.key, "play") == 0) {
+        // {"play", devid, slot} plays a bank slot at the device's rate on "go"
+        struct s_device *this = NULL;
+        if (tuple.count < 3 || tuple.type != exa_int) {
+          LOG("need a device id and a slot"CR);
+        } else if (!(this = find_device(tuple.val)) || this->type != TYPE_PLAYBACK || !this->assigned) {
+          LOG("need an assigned playback device"CR);
+        } else {
+          struct s_variant *v = cache_get(tuple.arg, this->dev.sampleRate);
+          if (!v) {
+            LOG("empty slot"CR);
+          } else {
+            atomic_store(&this->state, audio_state_idle);
+            device_set_audio(this, v->audio);
+          }
+        }
         // ----
         // more command ideas
         // 44100 16bit signed 1 channel
@@ -1095,6 +6244,12 @@ int main(int argc, char *argv[]) {
         LOG("data_cb_count:%d"CR, data_cb_count);
         LOG("data_cb_nodev:%d"CR, data_cb_nodev);
         LOG("data_cb_fail:%d"CR, data_cb_fail);
+        stream_info();
+        record_info();
+        bank_info();
+        pool_info();
+        wavetable_info();
+        synth_info(&synth);
         // LOG("capture state:%d"CR, capture_audio.state);
         // LOG("playback state:%d"CR, playback_audio.state);
       } else if (strcmp(tuple.key, "exit") == 0) {
@@ -1119,6 +6274,10 @@ int main(int argc, char *argv[]) {
 
   LOG("exit receive loop"CR);
 
+  disk_thread_stop();
+  load_stop();
+  crew_stop();
+
   // clean up etf parsing memory
   if (tuple.blob) free(tuple.blob);
   if (tuple.list) free(tuple.list);
@@ -1127,10 +6286,40 @@ int main(int argc, char *argv[]) {
   struct s_device *cur_dev, *tmp_dev;
     HASH_ITER(hh, devices, cur_dev, tmp_dev) {
     LOG("remove device %d"CR, cur_dev->id);
+    // stop the callback before the buffers it uses go away
+    if (cur_dev->assigned) ma_device_uninit(&cur_dev->dev);
+    audio_unref(atomic_load(&cur_dev->audio));
     HASH_DEL(devices, cur_dev);
     free(cur_dev);
   }
 
+  // finish any recordings that are still going
+  for (int i=0; i<RECORD_SLOTS; i++) {
+    struct s_record *r = atomic_exchange(&records[i], NULL);
+    if (r) {
+      record_close(r);
+      pthread_mutex_destroy(&r->lock);
+      free(r->block);
+      free(r);
+    }
+  }
+
+  // clean up bank and cache memory
+  for (int i=0; i<BANK_SLOTS; i++) bank_drop(i);
+  for (int i=0; i<WT_SLOTS; i++) wavetable_put(i, NULL);
+  reclaim(); // no devices left, so everything goes
+  pool_release();
+
+  // clean up stream memory
+  for (int i=0; i<STREAM_SLOTS; i++) {
+    struct s_stream *s = atomic_exchange(&streams[i], NULL);
+    if (s) {
+      stream_close(s);
+      pthread_mutex_destroy(&s->lock);
+      free(s);
+    }
+  }
+
   // clean up context memory
   struct s_context *cur_ctx, *tmp_ctx;
     HASH_ITER(hh, contexts, cur_ctx, tmp_ctx) {
@@ -1142,3 +6331,980 @@ int main(int argc, char *argv[]) {
   }
   return 0;
 }
+#endif // EXA_BENCH
+
+// -----------------------------------------------------------
+
+// benchmarks, built by "make bench" instead of the port's main
+//
+// ./exabench runs them all, ./exabench codec just the one
+
+#ifdef EXA_BENCH
+
+static double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t bench_rng = 12345;
+
+static uint32_t bench_rand(void) {
+  bench_rng = bench_rng * 1664525 + 1013904223;
+  return bench_rng >> 8;
+}
+
+// something like a drum loop: tones, and noise bursts that die away
+static float *bench_signal(uint32_t len) {
+  float *x = pool_alloc(len * sizeof(float));
+  if (!x) exit(1);
+  float env = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    if (i % 11025 == 0) env = 0.5;
+    env *= 0.9995;
+    float noise = (bench_rand() / 8388608.0 - 1.0) * env;
+    x[i] = 0.2 * sin(2 * M_PI * 110 * i / SAMPLERATE) +
+      0.1 * sin(2 * M_PI * 440 * i / SAMPLERATE) +
+      0.05 * sin(2 * M_PI * 3000 * i / SAMPLERATE) + noise;
+  }
+  return x;
+}
+
+#define BENCH_VOICES (64)
+#define BENCH_PERIOD (256)
+#define BENCH_PERIODS (2000)
+
+// ns per voice per frame to render periods of audio, either carrying
+// on from where the last period left off or starting somewhere random
+static double bench_render(struct s_audio *a, int random) {
+  static struct s_device *voices[BENCH_VOICES];
+  static struct s_params params = {.gain = 1, .loop = 1};
+  float mix[BENCH_PERIOD];
+  uint32_t positions[BENCH_VOICES];
+  for (int v = 0; v < BENCH_VOICES; v++) {
+    if (!voices[v]) voices[v] = calloc(1, sizeof(struct s_device));
+    positions[v] = bench_rand() % a->len;
+  }
+  double sink = 0;
+  double t0 = bench_now();
+  for (int n = 0; n < BENCH_PERIODS; n++) {
+    for (int v = 0; v < BENCH_VOICES; v++) {
+      struct s_period p = {.params = &params, .audio = a, .end = a->len, .running = 1};
+      p.position = random ? bench_rand() % a->len : positions[v];
+      render_playback(voices[v], &p, mix, BENCH_PERIOD);
+      positions[v] = p.position;
+      sink += mix[BENCH_PERIOD - 1];
+    }
+  }
+  double t = bench_now() - t0;
+  if (sink == 1234.5) printf("\n");
+  return t * 1e9 / ((double)BENCH_PERIODS * BENCH_VOICES * BENCH_PERIOD);
+}
+
+void bench_codec(void) {
+  uint32_t len = SAMPLERATE * 30;
+  float *x = bench_signal(len);
+  printf("codec: %d s at %d Hz, %d voices, %d frame periods\n", len / SAMPLERATE, SAMPLERATE,
+    BENCH_VOICES, BENCH_PERIOD);
+  printf("%-6s %10s %6s %8s %10s %12s %12s\n",
+    "codec", "bytes", "ratio", "snr dB", "encode ms", "seq ns/fr", "random ns/fr");
+  for (int c = 0; c < codec_count; c++) {
+    float *copy = pool_alloc(len * sizeof(float));
+    memcpy(copy, x, len * sizeof(float));
+    double t0 = bench_now();
+    struct s_audio *a = audio_pack(copy, len, SAMPLERATE, c);
+    double encode = bench_now() - t0;
+    float *y = audio_floats(a);
+    double sig = 0, err = 0;
+    for (uint32_t i = 0; i < len; i++) {
+      sig += (double)x[i] * x[i];
+      err += (double)(x[i] - y[i]) * (x[i] - y[i]);
+    }
+    pool_free(y);
+    double snr = err > 0 ? 10 * log10(sig / err) : INFINITY;
+    double seq = bench_render(a, 0);
+    double rnd = bench_render(a, 1);
+    printf("%-6s %10lu %5.2fx %8.1f %10.2f %12.3f %12.3f\n",
+      codec_info[c].name, audio_bytes(a), (double)len * sizeof(float) / audio_bytes(a),
+      snr, encode * 1e3, seq, rnd);
+    audio_unref(a);
+    reclaim();
+  }
+  pool_free(x);
+}
+
+// the playground's way for comparison: one sample at a time, through
+// the envelope's branches and a switch on the waveform
+struct bench_osc {
+  float phase, inc, amp, width, level, attack, decay, sustain;
+  int stage, wave;
+};
+
+static float bench_osc_sample(struct bench_osc *o) {
+  switch (o->stage) {
+    case env_attack:
+      o->level += o->attack;
+      if (o->level >= 1) {
+        o->level = 1;
+        o->stage = env_decay;
+      }
+      break;
+    case env_decay:
+      o->level -= o->decay;
+      if (o->level <= o->sustain) {
+        o->level = o->sustain;
+        o->stage = env_sustain;
+      }
+      break;
+  }
+  float p = o->phase;
+  float x = 0;
+  switch (o->wave) {
+    case wave_sine: x = sinf(2.0f * M_PI * p); break;
+    case wave_square: x = p < 0.5f ? 1.0f : -1.0f; break;
+    case wave_triangle: x = 4.0f * fabsf(p - 0.5f) - 1.0f; break;
+    case wave_saw: x = 2.0f * (p - floorf(p + 0.5f)); break;
+    case wave_pulse: x = p < o->width ? 1.0f : -1.0f; break;
+  }
+  o->phase += o->inc;
+  if (o->phase >= 1.0f) o->phase -= 1.0f;
+  return x * o->level * o->amp;
+}
+
+#define BENCH_FRAMES (512)
+
+void bench_osc(void) {
+  static int counts[] = {16, 64, 256, 1024, 4096};
+  static float mix[BENCH_FRAMES];
+  printf("osc: %d frame periods, all waveforms, attack then sustain\n", BENCH_FRAMES);
+  printf("%6s %14s %14s %8s\n", "voices", "block ns/v/fr", "sample ns/v/fr", "speedup");
+  for (int c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    int voices = counts[c];
+    int periods = 4 * 1024 * 1024 / (voices * BENCH_FRAMES) + 4;
+    synth_init(&synth, SAMPLERATE);
+    struct bench_osc *ref = calloc(voices, sizeof *ref);
+    for (int v = 0; v < voices; v++) {
+      float hz = 55 + v * 3.7;
+      synth_send(&synth, synth_osc, v, v % wave_table, hz, 1.0 / voices, 0.3);
+      synth_send(&synth, synth_adsr, v, 0.05, 0.2, 0.6, 0.5);
+      synth_send(&synth, synth_on, v, 0, 0, 0, 0);
+      // the queue only holds so much
+      if (v % 1000 == 999) synth_render(&synth, mix, 0, 1, 1);
+      ref[v] = (struct bench_osc){.inc = hz / SAMPLERATE, .amp = 1.0 / voices, .width = 0.3,
+        .attack = 1 / (0.05 * SAMPLERATE), .decay = 0.4 / (0.2 * SAMPLERATE), .sustain = 0.6,
+        .stage = env_attack, .wave = v % wave_table};
+    }
+    double t0 = bench_now();
+    for (int n = 0; n < periods; n++) synth_render(&synth, mix, BENCH_FRAMES, 1, 1);
+    double block = bench_now() - t0;
+    double sink = mix[0];
+    t0 = bench_now();
+    for (int n = 0; n < periods; n++) {
+      for (int i = 0; i < BENCH_FRAMES; i++) {
+        float x = 0;
+        for (int v = 0; v < voices; v++) x += bench_osc_sample(&ref[v]);
+        mix[i] = x;
+      }
+    }
+    double sample = bench_now() - t0;
+    sink += mix[0];
+    if (sink == 1234.5) printf("\n");
+    double work = (double)periods * voices * BENCH_FRAMES;
+    printf("%6d %14.3f %14.3f %7.1fx\n", voices, block * 1e9 / work, sample * 1e9 / work, sample / block);
+    free(ref);
+  }
+}
+
+// the multi-voice kernels: same bits as the C reference, and how many
+// voices each one fits in a fixed share of one core
+#define BENCH_BUDGET (0.5) // of a core
+#define BENCH_LANE_VOICES (1024)
+
+static struct {
+  char *name;
+  osc_lanes_fn fn;
+  int ok;
+} bench_kernels[] = {
+  {"c", osc_lanes_c, 1},
+#ifdef EXA_X86
+  {"sse2", osc_lanes_sse2, 0},
+  {"avx2", osc_lanes_avx2, 0},
+#endif
+#ifdef EXA_NEON
+  {"neon", osc_lanes_neon, 1},
+#endif
+};
+
+// every wave but wave_table in turn
+static int bench_lane_wave(int n) {
+  int w = n % (wave_count - 1);
+  return w < wave_table ? w : w + 1;
+}
+
+static double bench_voices(int wave, int voices) {
+  static float mix[BENCH_FRAMES];
+  synth_init(&synth, SAMPLERATE);
+  for (int v = 0; v < voices; v++) {
+    int w = wave < 0 ? bench_lane_wave(v) : wave;
+    synth_send(&synth, synth_osc, v, w, 55 + v * 3.7, 1.0 / voices, 0.3);
+    synth_send(&synth, synth_on, v, 0, 0, 0, 0);
+    if (v % 1000 == 999) synth_render(&synth, mix, 0, 1, 1);
+  }
+  int periods = 4 * 1024 * 1024 / (voices * BENCH_FRAMES) + 4;
+  double t0 = bench_now();
+  for (int n = 0; n < periods; n++) synth_render(&synth, mix, BENCH_FRAMES, 1, 1);
+  return (bench_now() - t0) * 1e9 / ((double)periods * voices * BENCH_FRAMES);
+}
+
+void bench_lanes(void) {
+  int count = sizeof(bench_kernels) / sizeof(bench_kernels[0]);
+#ifdef EXA_X86
+  __builtin_cpu_init();
+  bench_kernels[1].ok = __builtin_cpu_supports("sse2");
+  bench_kernels[2].ok = __builtin_cpu_supports("avx2");
+#endif
+  osc_lanes_fn keep = osc_lanes;
+  printf("lanes: %d voices a lane set, checked against the C reference\n", OSC_LANES);
+  struct s_lanes l;
+  static float want[SYNTH_BLOCK * OSC_LANES], got[SYNTH_BLOCK * OSC_LANES];
+  for (int k = 0; k < count; k++) {
+    if (!bench_kernels[k].ok) continue;
+    int same = 1;
+    for (int trial = 0; trial < 1000; trial++) {
+      for (int j = 0; j < OSC_LANES; j++) {
+        l.phase[j] = bench_rand() << 8;
+        l.inc[j] = bench_rand() << 7;
+        l.dinc[j] = ((int32_t)bench_rand() - (1 << 23)) / 4;
+        l.width[j] = bench_rand() / 16777216.0;
+        l.dwidth[j] = (bench_rand() / 16777216.0 - 0.5) / SYNTH_BLOCK;
+        l.g[j] = bench_rand() / 16777216.0;
+        l.dg[j] = (bench_rand() / 16777216.0 - 0.5) / SYNTH_BLOCK;
+      }
+      int wave = bench_lane_wave(trial);
+      memset(want, 0, sizeof want);
+      memset(got, 0, sizeof got);
+      osc_lanes_c(wave, &l, want, SYNTH_BLOCK);
+      bench_kernels[k].fn(wave, &l, got, SYNTH_BLOCK);
+      if (memcmp(want, got, sizeof want) != 0) same = 0;
+    }
+    printf("  %-5s %s\n", bench_kernels[k].name, same ? "same bits" : "DIFFERENT");
+  }
+  printf("%d voices at %d Hz, voices per core at %.0f%% of one core\n",
+    BENCH_LANE_VOICES, SAMPLERATE, BENCH_BUDGET * 100);
+  printf("%-9s", "kernel");
+  for (int w = 0; w < wave_count - 1; w++) printf(" %11s", wave_name[bench_lane_wave(w)]);
+  printf(" %11s\n", "mixed");
+  for (int k = 0; k < count; k++) {
+    if (!bench_kernels[k].ok) continue;
+    osc_lanes = bench_kernels[k].fn;
+    printf("%-5s ns  ", bench_kernels[k].name);
+    double ns[wave_count];
+    for (int w = 0; w < wave_count; w++) {
+      ns[w] = bench_voices(w < wave_count - 1 ? bench_lane_wave(w) : -1, BENCH_LANE_VOICES);
+      printf(" %11.3f", ns[w]);
+    }
+    printf("\n%-5s v   ", bench_kernels[k].name);
+    for (int w = 0; w < wave_count; w++) printf(" %11.0f", BENCH_BUDGET * 1e9 / (ns[w] * SAMPLERATE));
+    printf("\n");
+  }
+  osc_lanes = keep;
+}
+
+// wavetable voices: how close a table sine is to sin(), and what
+// linear, cubic and morphing lookups cost next to calling sinf
+#define BENCH_TABLE_VOICES (256)
+
+static double bench_table_voices(int interp, float morph) {
+  static float mix[BENCH_FRAMES];
+  synth_init(&synth, SAMPLERATE);
+  for (int v = 0; v < BENCH_TABLE_VOICES; v++) {
+    synth_send(&synth, synth_osc, v, wave_table, 55 + v * 3.7, 1.0 / BENCH_TABLE_VOICES, 0);
+    synth_send(&synth, synth_table, v, 0, 1, morph, interp);
+    synth_send(&synth, synth_on, v, 0, 0, 0, 0);
+  }
+  int periods = 4 * 1024 * 1024 / (BENCH_TABLE_VOICES * BENCH_FRAMES) + 4;
+  double t0 = bench_now();
+  for (int n = 0; n < periods; n++) synth_render(&synth, mix, BENCH_FRAMES, 1, 1);
+  return (bench_now() - t0) * 1e9 / ((double)periods * BENCH_TABLE_VOICES * BENCH_FRAMES);
+}
+
+void bench_table(void) {
+  // slot 1 is a saw to morph towards
+  static float saw[WT_SIZE];
+  for (int j = 0; j < WT_SIZE; j++) saw[j] = 2.0 * j / WT_SIZE - 1;
+  double t0 = bench_now();
+  wavetable_load(1, saw, WT_SIZE);
+  printf("table: %d samples, %d levels, built in %.1f ms\n", WT_SIZE, WT_MIPS, (bench_now() - t0) * 1e3);
+  const struct s_audio *sine = atomic_load(&wavetables[0]);
+  for (int interp = 0; interp < interp_count; interp++) {
+    double worst = 0;
+    uint32_t phase = 0, inc = phase_inc(440, SAMPLERATE);
+    for (int i = 0; i < SAMPLERATE; i++) {
+      float y = interp == interp_cubic ? wt_cubic(wt_level(sine, 0), phase) : wt_linear(wt_level(sine, 0), phase);
+      double e = fabs(y - sin(2 * M_PI * (phase / 4294967296.0)));
+      if (e > worst) worst = e;
+      phase += inc;
+    }
+    printf("  %-6s sine error %.1f dB\n", interp == interp_cubic ? "cubic" : "linear", 20 * log10(worst));
+  }
+  static float mix[BENCH_FRAMES];
+  float phase[BENCH_TABLE_VOICES], inc[BENCH_TABLE_VOICES];
+  for (int v = 0; v < BENCH_TABLE_VOICES; v++) {
+    phase[v] = 0;
+    inc[v] = (55 + v * 3.7) / SAMPLERATE;
+  }
+  int periods = 4 * 1024 * 1024 / (BENCH_TABLE_VOICES * BENCH_FRAMES) + 4;
+  t0 = bench_now();
+  for (int n = 0; n < periods; n++) {
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+      float x = 0;
+      for (int v = 0; v < BENCH_TABLE_VOICES; v++) {
+        x += sinf(2 * (float)M_PI * phase[v]);
+        phase[v] += inc[v];
+        phase[v] -= (int)phase[v];
+      }
+      mix[i] = x;
+    }
+  }
+  double libm = (bench_now() - t0) * 1e9 / ((double)periods * BENCH_TABLE_VOICES * BENCH_FRAMES);
+  if (mix[0] == 1234.5f) printf("\n");
+  printf("%d voices, ns a voice frame\n", BENCH_TABLE_VOICES);
+  printf("  %-14s %7.3f\n", "sinf", libm);
+  printf("  %-14s %7.3f\n", "linear", bench_table_voices(interp_linear, 0));
+  printf("  %-14s %7.3f\n", "cubic", bench_table_voices(interp_cubic, 0));
+  printf("  %-14s %7.3f\n", "linear morph", bench_table_voices(interp_linear, 0.5));
+  printf("  %-14s %7.3f\n", "cubic morph", bench_table_voices(interp_cubic, 0.5));
+  wavetable_put(1, NULL);
+}
+
+// modulation at control rate against working it out every sample the
+// way the playground does, and how far a block's linear ramp strays
+// from the curve it stands in for
+#define BENCH_CONTROL_VOICES (1024)
+
+// lfo 0 none, 1 the voice's own, 2 three routes from the bus
+static double bench_control_block(int lfo) {
+  static float mix[BENCH_FRAMES];
+  synth_init(&synth, SAMPLERATE);
+  for (int m = 0; m < 3; m++) synth_send(&synth, synth_bus_lfo, m, wave_sine, 5 + m, 0, 0);
+  for (int v = 0; v < BENCH_CONTROL_VOICES; v++) {
+    synth_send(&synth, synth_osc, v, wave_pulse, 55 + v * 3.7, 1.0 / BENCH_CONTROL_VOICES, 0.5);
+    if (lfo == 1) {
+      synth_send(&synth, synth_lfo, v, wave_sine, 5 + v % 7, 0, 0);
+      synth_send(&synth, synth_lfo_depth, v, 50 / 1200.0, 0.5, 0.3, 0);
+    } else if (lfo == 2) {
+      synth_send(&synth, synth_route, v, mod_bus, mod_pitch, 50 / 1200.0, 0);
+      synth_send(&synth, synth_route, v, mod_bus + 1, mod_amp, 0.25, 0);
+      synth_send(&synth, synth_route, v, mod_bus + 2, mod_width, 0.3, 0);
+    }
+    synth_send(&synth, synth_on, v, 0, 0, 0, 0);
+    if (v % 500 == 499) synth_render(&synth, mix, 0, 1, 1);
+  }
+  synth_render(&synth, mix, 0, 1, 1);
+  int periods = 4 * 1024 * 1024 / (BENCH_CONTROL_VOICES * BENCH_FRAMES) + 4;
+  double t0 = bench_now();
+  for (int n = 0; n < periods; n++) synth_render(&synth, mix, BENCH_FRAMES, 1, 1);
+  return (bench_now() - t0) * 1e9 / ((double)periods * BENCH_CONTROL_VOICES * BENCH_FRAMES);
+}
+
+static double bench_control_sample(int lfo) {
+  static float phase[BENCH_CONTROL_VOICES], inc[BENCH_CONTROL_VOICES];
+  static float lfo_phase[BENCH_CONTROL_VOICES], lfo_inc[BENCH_CONTROL_VOICES];
+  static float mix[BENCH_FRAMES];
+  for (int v = 0; v < BENCH_CONTROL_VOICES; v++) {
+    phase[v] = lfo_phase[v] = 0;
+    inc[v] = (55 + v * 3.7) / SAMPLERATE;
+    lfo_inc[v] = (5 + v % 7) / (float)SAMPLERATE;
+  }
+  float amp = 1.0f / BENCH_CONTROL_VOICES;
+  int periods = 4 * 1024 * 1024 / (BENCH_CONTROL_VOICES * BENCH_FRAMES) + 4;
+  double t0 = bench_now();
+  for (int n = 0; n < periods; n++) {
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+      float x = 0;
+      for (int v = 0; v < BENCH_CONTROL_VOICES; v++) {
+        float step = inc[v], g = amp, width = 0.5f;
+        if (lfo) {
+          float l = sinf(2 * (float)M_PI * lfo_phase[v]);
+          lfo_phase[v] += lfo_inc[v];
+          if (lfo_phase[v] >= 1) lfo_phase[v] -= 1;
+          step *= exp2f(50 / 1200.0f * l);
+          g *= 1 - 0.5f * (0.5f - 0.5f * l);
+          width += 0.3f * l;
+        }
+        x += (phase[v] < width ? 1.0f : -1.0f) * g;
+        phase[v] += step;
+        if (phase[v] >= 1) phase[v] -= 1;
+      }
+      mix[i] = x;
+    }
+  }
+  double ns = (bench_now() - t0) * 1e9 / ((double)periods * BENCH_CONTROL_VOICES * BENCH_FRAMES);
+  if (mix[0] == 1234.5f) printf("\n");
+  return ns;
+}
+
+// worst gap between the exact curve and SYNTH_BLOCK frame ramps over a second
+static double bench_control_ramp(double hz, double (*curve)(double)) {
+  double worst = 0;
+  for (int b = 0; b < SAMPLERATE; b += SYNTH_BLOCK) {
+    double y0 = curve(sin(2 * M_PI * hz * b / SAMPLERATE));
+    double y1 = curve(sin(2 * M_PI * hz * (b + SYNTH_BLOCK) / SAMPLERATE));
+    for (int i = 0; i < SYNTH_BLOCK; i++) {
+      double exact = curve(sin(2 * M_PI * hz * (b + i) / SAMPLERATE));
+      double e = fabs(y0 + (y1 - y0) * i / SYNTH_BLOCK - exact);
+      if (e > worst) worst = e;
+    }
+  }
+  return worst;
+}
+
+static double bench_vibrato(double l) { return exp2(100 / 1200.0 * l); } // a semitone each way
+static double bench_tremolo(double l) { return 0.5 + 0.5 * l; } // all the way down
+
+void bench_control(void) {
+  printf("control: %d pulse voices, an lfo on pitch, amplitude and width, %d frame blocks\n",
+    BENCH_CONTROL_VOICES, SYNTH_BLOCK);
+  printf("%-12s %10s %10s %12s\n", "", "plain ns", "lfo ns", "modulation");
+  double plain = bench_control_block(0), lfo = bench_control_block(1);
+  printf("%-12s %10.3f %10.3f %12.3f\n", "block", plain, lfo, lfo - plain);
+  lfo = bench_control_block(2);
+  printf("%-12s %10.3f %10.3f %12.3f\n", "bus routes", plain, lfo, lfo - plain);
+  plain = bench_control_sample(0);
+  lfo = bench_control_sample(1);
+  printf("%-12s %10.3f %10.3f %12.3f\n", "per sample", plain, lfo, lfo - plain);
+  for (double hz = 5; hz <= 20; hz *= 2) {
+    double pitch = bench_control_ramp(hz, bench_vibrato);
+    double amp = bench_control_ramp(hz, bench_tremolo);
+    printf("  %4.0f Hz lfo: vibrato off by %.4f cents, tremolo by %.1f dB under full scale\n",
+      hz, 1200 * log2(1 + pitch), 20 * log10(amp));
+  }
+}
+
+// key on and off through the pool against the playground's way of
+// scanning every voice for a free one, and what a block costs with a
+// few keys down in a small pool and in the largest
+#define BENCH_KEYS (1 << 20)
+
+static double bench_alloc_pool(int count, int steal) {
+  synth_init(&synth, SAMPLERATE);
+  struct s_synth_cmd c = {.op = synth_poly, .voice = 0, .v = {count, steal}};
+  synth_apply(&synth, &c);
+  double t0 = bench_now();
+  for (int i = 0; i < BENCH_KEYS; i++) {
+    int key = bench_rand() % SYNTH_KEYS;
+    c = (struct s_synth_cmd){.op = i & 1 ? synth_key_off : synth_key_on, .voice = key, .v = {220, 1}};
+    synth_apply(&synth, &c);
+    // now and then a voice finishes its release
+    if ((i & 7) == 0 && synth.active_count) {
+      int v = synth.active[bench_rand() % synth.active_count];
+      synth.stage[v] = env_idle;
+      synth_deactivate(&synth, v);
+    }
+  }
+  return (bench_now() - t0) * 1e9 / BENCH_KEYS;
+}
+
+static double bench_alloc_scan(int count) {
+  static uint8_t on[SYNTH_VOICES], key_of[SYNTH_VOICES];
+  static uint32_t started[SYNTH_VOICES];
+  memset(on, 0, sizeof on);
+  double t0 = bench_now();
+  for (int i = 0; i < BENCH_KEYS; i++) {
+    int key = bench_rand() % SYNTH_KEYS;
+    if (i & 1) {
+      for (int v = 0; v < count; v++) {
+        if (on[v] && key_of[v] == key) on[v] = 0;
+      }
+    } else {
+      int pick = -1, oldest = 0;
+      for (int v = 0; v < count && pick < 0; v++) {
+        if (!on[v]) pick = v;
+        else if (started[v] < started[oldest]) oldest = v;
+      }
+      if (pick < 0) pick = oldest;
+      on[pick] = 1;
+      key_of[pick] = key;
+      started[pick] = i;
+    }
+  }
+  double ns = (bench_now() - t0) * 1e9 / BENCH_KEYS;
+  if (on[0] == 2) printf("\n");
+  return ns;
+}
+
+static double bench_alloc_render(int count) {
+  static float mix[BENCH_FRAMES];
+  synth_init(&synth, SAMPLERATE);
+  synth_send(&synth, synth_poly, 0, count, steal_oldest, 0, 0);
+  for (int k = 0; k < 8; k++) synth_send(&synth, synth_key_on, 60 + k, 220 + k * 30, 1, 0, 0);
+  synth_render(&synth, mix, 0, 1, 1);
+  int periods = 2000;
+  double t0 = bench_now();
+  for (int n = 0; n < periods; n++) synth_render(&synth, mix, BENCH_FRAMES, 1, 1);
+  return (bench_now() - t0) * 1e9 / periods;
+}
+
+void bench_alloc(void) {
+  printf("alloc: %d key ons and offs over %d keys, ns an event\n", BENCH_KEYS, SYNTH_KEYS);
+  printf("%6s %10s %10s %10s %10s\n", "voices", "oldest", "quietest", "same-key", "scan");
+  static int counts[] = {16, 256, 4096};
+  for (int c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    printf("%6d", counts[c]);
+    for (int steal = 0; steal < steal_count; steal++) printf(" %10.1f", bench_alloc_pool(counts[c], steal));
+    printf(" %10.1f\n", bench_alloc_scan(counts[c]));
+  }
+  printf("8 keys down, ns a %d frame period: %.0f in 16 voices, %.0f in %d\n", BENCH_FRAMES,
+    bench_alloc_render(16), bench_alloc_render(SYNTH_VOICES), SYNTH_VOICES);
+}
+
+// band limited against naive and 4x oversampled naive: the loudest
+// alias of one voice relative to its fundamental, measured with an
+// FFT, and what a sample costs in time and, where perf allows, cycles
+#define BENCH_FFT (65536)
+#define BENCH_OVER (4)
+#define BENCH_TAPS (64) // decimation filter at the oversampled rate
+
+static void bench_fft(double *re, double *im, int n) {
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      double t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  for (int len = 2; len <= n; len <<= 1) {
+    double a = -2 * M_PI / len;
+    for (int i = 0; i < n; i += len) {
+      for (int k = 0; k < len / 2; k++) {
+        double wr = cos(a * k), wi = sin(a * k);
+        double *xr = &re[i + k], *xi = &im[i + k];
+        double yr = re[i + k + len / 2] * wr - im[i + k + len / 2] * wi;
+        double yi = re[i + k + len / 2] * wi + im[i + k + len / 2] * wr;
+        re[i + k + len / 2] = *xr - yr;
+        im[i + k + len / 2] = *xi - yi;
+        *xr += yr;
+        *xi += yi;
+      }
+    }
+  }
+}
+
+// dB of the loudest bin that isn't near dc or a harmonic below nyquist
+static double bench_alias(const float *x, double hz) {
+  static double re[BENCH_FFT], im[BENCH_FFT];
+  for (int i = 0; i < BENCH_FFT; i++) {
+    double t = 2 * M_PI * i / (BENCH_FFT - 1); // blackman-harris
+    re[i] = x[i] * (0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) - 0.01168 * cos(3 * t));
+    im[i] = 0;
+  }
+  bench_fft(re, im, BENCH_FFT);
+  double bin = (double)SAMPLERATE / BENCH_FFT, fundamental = 0, worst = 0;
+  for (int b = 1; b < BENCH_FFT / 2; b++) {
+    double power = re[b] * re[b] + im[b] * im[b];
+    double h = round(b * bin / hz);
+    int harmonic = h * hz < SAMPLERATE / 2 && fabs(b * bin - h * hz) < 8 * bin;
+    if (harmonic && h == 1 && power > fundamental) fundamental = power;
+    if (!harmonic && power > worst) worst = power;
+  }
+  return 10 * log10(worst / fundamental);
+}
+
+static int bench_cycles_fd = -1;
+
+static uint64_t bench_cycles(void) {
+  uint64_t count = 0;
+  if (bench_cycles_fd < 0 || read(bench_cycles_fd, &count, sizeof count) != sizeof count) return 0;
+  return count;
+}
+
+void bench_blep(void) {
+#ifdef __linux__
+  bench_cycles_fd = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+#endif
+  static struct {
+    int naive, bl;
+  } waves[] = {{wave_saw, wave_saw_bl}, {wave_square, wave_square_bl},
+    {wave_triangle, wave_triangle_bl}, {wave_pulse, wave_pulse_bl}};
+  static float out[BENCH_FFT];
+  float taps[BENCH_TAPS];
+  double sum = 0;
+  for (int j = 0; j < BENCH_TAPS; j++) {
+    double t = j - (BENCH_TAPS - 1) / 2.0, c = 0.9 / BENCH_OVER;
+    double w = 0.42 - 0.5 * cos(2 * M_PI * j / (BENCH_TAPS - 1)) + 0.08 * cos(4 * M_PI * j / (BENCH_TAPS - 1));
+    taps[j] = (t == 0 ? c : sin(M_PI * c * t) / (M_PI * t)) * w;
+    sum += taps[j];
+  }
+  for (int j = 0; j < BENCH_TAPS; j++) taps[j] /= sum;
+  double hz = 2093; // C7
+  printf("blep: one voice at %.0f Hz, loudest alias against the fundamental\n", hz);
+  printf("%-11s %-6s %9s %12s %14s\n", "wave", "how", "alias dB", "ns/sample", "cycles/sample");
+  for (int k = 0; k < sizeof(waves) / sizeof(waves[0]); k++) {
+    for (int how = 0; how < 3; how++) {
+      int wave = how == 2 ? waves[k].bl : waves[k].naive;
+      int over = how == 1 ? BENCH_OVER : 1;
+      uint32_t inc = phase_inc(hz, SAMPLERATE * over), phase = 0;
+      float dt = (inc >> 8) * PHASE_SCALE, inv = 1.0f / dt;
+      float history[BENCH_TAPS] = {0};
+      double t0 = bench_now();
+      uint64_t c0 = bench_cycles();
+      for (int i = 0; i < BENCH_FFT; i++) {
+        if (over == 1) {
+          out[i] = osc_c(wave, (phase >> 8) * PHASE_SCALE, 0.3f, dt, inv);
+          phase += inc;
+          continue;
+        }
+        memmove(history, history + over, (BENCH_TAPS - over) * sizeof(float));
+        for (int j = BENCH_TAPS - over; j < BENCH_TAPS; j++) {
+          history[j] = osc_c(wave, (phase >> 8) * PHASE_SCALE, 0.3f, dt, inv);
+          phase += inc;
+        }
+        float y = 0;
+        for (int j = 0; j < BENCH_TAPS; j++) y += history[j] * taps[j];
+        out[i] = y;
+      }
+      uint64_t cycles = bench_cycles() - c0;
+      double ns = (bench_now() - t0) * 1e9 / BENCH_FFT;
+      // leave the filter's start out of the measurement
+      for (int i = 0; i < BENCH_TAPS; i++) out[i] = out[BENCH_TAPS];
+      char c[32] = "-";
+      if (bench_cycles_fd >= 0) snprintf(c, sizeof c, "%.1f", (double)cycles / BENCH_FFT);
+      printf("%-11s %-6s %9.1f %12.2f %14s\n", how ? "" : wave_name[wave],
+        how == 0 ? "naive" : how == 1 ? "4x" : "blep", bench_alias(out, hz), ns, c);
+    }
+  }
+  if (bench_cycles_fd >= 0) close(bench_cycles_fd);
+}
+
+// how rendering scales with the number of voices: synth waves with
+// the envelope held or moving, and bank samples through render_playback
+// as separate voices. for each it gives ns a voice sample, how much of
+// the callback's time a period takes at three period sizes, and cache
+// misses where perf allows.
+static int bench_poly_counts[] = {16, 64, 256, 1024, 4096};
+static int bench_poly_periods[] = {64, 256, 1024};
+
+static struct {
+  char *name;
+  int wave; // -1 for bank samples
+  int env; // attack that lasts the whole run, or codec for samples
+} bench_poly_cases[] = {
+  {"sine", wave_sine, 0},
+  {"sine env", wave_sine, 1},
+  {"saw-bl", wave_saw_bl, 0},
+  {"saw-bl env", wave_saw_bl, 1},
+  {"pulse-bl env", wave_pulse_bl, 1},
+  {"table env", wave_table, 1},
+  {"mixed env", -2, 1},
+  {"sample f32", -1, codec_f32},
+  {"sample adpcm", -1, codec_adpcm},
+};
+
+static struct s_audio *bench_poly_audio[codec_count];
+static struct s_device *bench_poly_devices[SYNTH_VOICES];
+static uint32_t bench_poly_positions[SYNTH_VOICES];
+
+static void bench_poly_setup(int c, int voices) {
+  int wave = bench_poly_cases[c].wave;
+  if (wave == -1) {
+    struct s_audio *a = bench_poly_audio[bench_poly_cases[c].env];
+    for (int v = 0; v < voices; v++) {
+      if (!bench_poly_devices[v]) bench_poly_devices[v] = calloc(1, sizeof(struct s_device));
+      bench_poly_positions[v] = bench_rand() % a->len;
+    }
+    return;
+  }
+  static float mix[BENCH_FRAMES];
+  synth_init(&synth, SAMPLERATE);
+  for (int v = 0; v < voices; v++) {
+    int w = wave == -2 ? bench_lane_wave(v) : wave;
+    synth_send(&synth, synth_osc, v, w, 55 + v * 3.7, 1.0 / voices, 0.3);
+    if (bench_poly_cases[c].env) synth_send(&synth, synth_adsr, v, 1000, 0, 1, 0);
+    synth_send(&synth, synth_on, v, 0, 0, 0, 0);
+    if (v % 1000 == 999) synth_render(&synth, mix, 0, 1, 1);
+  }
+  synth_render(&synth, mix, 0, 1, 1);
+}
+
+static void bench_poly_period(int c, int voices, float *mix, int frames) {
+  if (bench_poly_cases[c].wave != -1) {
+    synth_render(&synth, mix, frames, 1, 1);
+    return;
+  }
+  static struct s_params params = {.gain = 1, .loop = 1};
+  float one[1024];
+  struct s_audio *a = bench_poly_audio[bench_poly_cases[c].env];
+  memset(mix, 0, frames * sizeof(float));
+  for (int v = 0; v < voices; v++) {
+    struct s_period p = {.params = &params, .audio = a, .end = a->len, .running = 1,
+      .position = bench_poly_positions[v]};
+    render_playback(bench_poly_devices[v], &p, one, frames);
+    bench_poly_positions[v] = p.position;
+    for (int i = 0; i < frames; i++) mix[i] += one[i] / voices;
+  }
+}
+
+void bench_poly(void) {
+  int misses_fd = -1;
+#ifdef __linux__
+  misses_fd = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+  uint32_t len = SAMPLERATE * 10;
+  for (int codec = 0; codec < codec_count; codec++) {
+    float *x = bench_signal(len);
+    bench_poly_audio[codec] = audio_pack(x, len, SAMPLERATE, codec);
+  }
+  static float mix[1024];
+  printf("poly: %d Hz, osc kernels %s, callback budget used at each period size\n", SAMPLERATE, osc_kernels);
+  printf("%-13s %6s %9s %8s %8s %8s %12s\n", "source", "voices", "ns/v/s",
+    "64 fr", "256 fr", "1024 fr", "misses/kvs");
+  for (int c = 0; c < sizeof(bench_poly_cases) / sizeof(bench_poly_cases[0]); c++) {
+    for (int k = 0; k < sizeof(bench_poly_counts) / sizeof(bench_poly_counts[0]); k++) {
+      int voices = bench_poly_counts[k];
+      bench_poly_setup(c, voices);
+      double use[3], ns = 0, misses = -1;
+      for (int q = 0; q < 3; q++) {
+        int frames = bench_poly_periods[q];
+        int periods = (1 << 21) / (voices * frames) + 8;
+        bench_poly_period(c, voices, mix, frames);
+        uint64_t m0 = 0, m1 = 0;
+        if (misses_fd >= 0 && read(misses_fd, &m0, sizeof m0) != sizeof m0) m0 = 0;
+        double t0 = bench_now();
+        for (int n = 0; n < periods; n++) bench_poly_period(c, voices, mix, frames);
+        double t = (bench_now() - t0) / periods;
+        if (misses_fd >= 0 && read(misses_fd, &m1, sizeof m1) != sizeof m1) m1 = m0;
+        use[q] = 100 * t * SAMPLERATE / frames;
+        if (frames == 256) {
+          ns = t * 1e9 / ((double)voices * frames);
+          if (misses_fd >= 0) misses = (m1 - m0) * 1000.0 / ((double)periods * voices * frames);
+        }
+      }
+      char m[32] = "-";
+      if (misses >= 0) snprintf(m, sizeof m, "%.2f", misses);
+      printf("%-13s %6d %9.3f %7.1f%% %7.1f%% %7.1f%% %12s\n", k ? "" : bench_poly_cases[c].name,
+        voices, ns, use[0], use[1], use[2], m);
+    }
+  }
+  for (int codec = 0; codec < codec_count; codec++) audio_unref(bench_poly_audio[codec]);
+  if (misses_fd >= 0) close(misses_fd);
+}
+
+// the same 4096 voices rendered by data_cb alone and with workers,
+// what a period costs and whether the output is still the same bits
+#define BENCH_WORKERS_CHECK (64) // periods compared
+
+static int bench_workers_render(int workers, int frames, float *out, int periods) {
+  bench_poly_setup(6, SYNTH_VOICES);
+  crew_start(workers);
+  crew.slices = crew.shared = crew.missed = 0;
+  crew.fallback = 0;
+  crew.patient = 1;
+  for (int n = 0; n < periods; n++) synth_render(&synth, out + n * frames, frames, 1, 1);
+  return atomic_load(&crew.count);
+}
+
+void bench_workers(void) {
+  static float want[BENCH_WORKERS_CHECK * 1024], got[BENCH_WORKERS_CHECK * 1024];
+  static float mix[1024];
+  int most = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  if (most > CREW_MAX) most = CREW_MAX;
+  int cores = most + 1;
+  if (most < 2) most = 2; // still checks the output on a small machine
+  printf("workers: %d mixed voices with envelopes, %d cores, %d voice batches\n",
+    SYNTH_VOICES, cores, SYNTH_BATCH);
+  printf("%-8s %10s %10s %8s %8s %8s %8s\n", "workers", "256 fr us", "1024 fr us", "speedup",
+    "budget", "missed", "same");
+  double alone = 0;
+  for (int w = 0; w <= most; w++) {
+    float *out = w ? got : want;
+    if (bench_workers_render(w, 1024, out, BENCH_WORKERS_CHECK) != w) break;
+    int same = w == 0 || memcmp(want, got, sizeof want) == 0;
+    double t[2];
+    for (int q = 0; q < 2; q++) {
+      int frames = q ? 1024 : 256;
+      int periods = (1 << 19) / frames;
+      synth_render(&synth, mix, frames, 1, 1);
+      double t0 = bench_now();
+      for (int n = 0; n < periods; n++) synth_render(&synth, mix, frames, 1, 1);
+      t[q] = (bench_now() - t0) / periods;
+    }
+    if (w == 0) alone = t[1];
+    printf("%-8d %10.1f %10.1f %7.2fx %7.1f%% %8lu %8s\n", w, t[0] * 1e6, t[1] * 1e6,
+      alone / t[1], 100 * t[1] * SAMPLERATE / 1024, crew.missed, same ? "yes" : "NO");
+  }
+  crew.patient = 0;
+  crew_stop();
+}
+
+// the ladder: the SIMD kernels against ladder_c, its response, and what
+// a filtered voice costs with the cutoff still, swept once a block and
+// swept with a tan every frame
+static struct {
+  char *name;
+  ladder_fn fn;
+  int ok;
+} bench_ladders[] = {
+  {"c", ladder_c, 1},
+#ifdef EXA_X86
+  {"sse2", ladder_sse2, 0},
+  {"avx2", ladder_avx2, 0},
+#endif
+#ifdef EXA_NEON
+  {"neon", ladder_neon, 1},
+#endif
+};
+
+// gain in dB of a quiet sine at hz through a still ladder at 1 kHz
+static double bench_ladder_gain(double hz, float res) {
+  struct s_lanes l;
+  memset(&l, 0, sizeof l);
+  l.cut[0] = ladder_g(1000, SAMPLERATE);
+  l.res[0] = res;
+  l.g[0] = 1;
+  static float in[SYNTH_BLOCK * OSC_LANES], out[SYNTH_BLOCK * OSC_LANES];
+  double sum = 0, ref = 0;
+  int blocks = SAMPLERATE / SYNTH_BLOCK;
+  for (int b = 0; b < blocks; b++) {
+    for (int i = 0; i < SYNTH_BLOCK; i++) {
+      in[i * OSC_LANES] = 0.01 * sin(2 * M_PI * hz * (b * SYNTH_BLOCK + i) / SAMPLERATE);
+    }
+    memset(out, 0, sizeof out);
+    ladder_c(&l, in, out, SYNTH_BLOCK);
+    if (b < blocks / 2) continue; // settled
+    for (int i = 0; i < SYNTH_BLOCK; i++) {
+      sum += out[i * OSC_LANES] * out[i * OSC_LANES];
+      ref += in[i * OSC_LANES] * in[i * OSC_LANES];
+    }
+  }
+  return 10 * log10(sum / ref);
+}
+
+// 0 no filter, 1 a still cutoff, 2 a bus lfo sweeping it
+static double bench_ladder_voices(int mode) {
+  static float mix[BENCH_FRAMES];
+  synth_init(&synth, SAMPLERATE);
+  synth_send(&synth, synth_bus_lfo, 0, wave_sine, 3, 0, 0);
+  for (int v = 0; v < BENCH_LANE_VOICES; v++) {
+    synth_send(&synth, synth_osc, v, wave_saw_bl, 55 + v * 3.7, 1.0 / BENCH_LANE_VOICES, 0.5);
+    if (mode) synth_send(&synth, synth_filter, v, 800, 3, 0, 0);
+    if (mode == 2) synth_send(&synth, synth_route, v, mod_bus, mod_cutoff, 2, 0);
+    synth_send(&synth, synth_on, v, 0, 0, 0, 0);
+    if (v % 500 == 499) synth_render(&synth, mix, 0, 1, 1);
+  }
+  synth_render(&synth, mix, 0, 1, 1);
+  int periods = 4 * 1024 * 1024 / (BENCH_LANE_VOICES * BENCH_FRAMES) + 4;
+  double t0 = bench_now();
+  for (int n = 0; n < periods; n++) synth_render(&synth, mix, BENCH_FRAMES, 1, 1);
+  return (bench_now() - t0) * 1e9 / ((double)periods * BENCH_LANE_VOICES * BENCH_FRAMES);
+}
+
+// one voice the obvious way, the cutoff's tan every frame
+static double bench_ladder_frame(void) {
+  float z[4] = {0}, x = 0, sum = 0;
+  int frames = 1 << 20;
+  double t0 = bench_now();
+  for (int i = 0; i < frames; i++) {
+    float hz = 800 * exp2f(2 * sinf(2 * (float)M_PI * 3 * i / SAMPLERATE));
+    float G = ladder_g(hz, SAMPLERATE), e = 1 - G, G2 = G * G;
+    float S = e * (G * (G * (G * z[0] + z[1]) + z[2]) + z[3]);
+    float u = ladder_clip((x - 3 * S) / (1 + 3 * (G2 * G2)));
+    float y = u;
+    for (int j = 0; j < 4; j++) {
+      float yj = G * y + e * z[j];
+      z[j] = yj + yj - z[j];
+      y = yj;
+    }
+    sum += y;
+    x = x < 1 ? x + 2.0f * 110 / SAMPLERATE : -1; // a saw
+  }
+  double ns = (bench_now() - t0) * 1e9 / frames;
+  if (sum == 12345) printf(" ");
+  return ns;
+}
+
+void bench_ladder(void) {
+  int count = sizeof(bench_ladders) / sizeof(bench_ladders[0]);
+#ifdef EXA_X86
+  __builtin_cpu_init();
+  bench_ladders[1].ok = __builtin_cpu_supports("sse2");
+  bench_ladders[2].ok = __builtin_cpu_supports("avx2");
+#endif
+  printf("ladder: %d voices a lane set, checked against the C reference\n", OSC_LANES);
+  static float in[SYNTH_BLOCK * OSC_LANES], want[SYNTH_BLOCK * OSC_LANES], got[SYNTH_BLOCK * OSC_LANES];
+  for (int k = 1; k < count; k++) {
+    if (!bench_ladders[k].ok) continue;
+    int same = 1;
+    for (int trial = 0; trial < 1000; trial++) {
+      struct s_lanes a, b;
+      for (int j = 0; j < OSC_LANES; j++) {
+        a.cut[j] = bench_rand() / 16777216.0 * 0.6;
+        a.dcut[j] = (bench_rand() / 16777216.0 - 0.5) * 0.2 / SYNTH_BLOCK;
+        a.res[j] = bench_rand() / 16777216.0 * 4;
+        a.g[j] = bench_rand() / 16777216.0;
+        a.dg[j] = (bench_rand() / 16777216.0 - 0.5) / SYNTH_BLOCK;
+        for (int z = 0; z < 4; z++) a.z[z][j] = bench_rand() / 16777216.0 - 0.5;
+      }
+      for (int i = 0; i < SYNTH_BLOCK * OSC_LANES; i++) in[i] = (bench_rand() / 16777216.0 - 0.5) * 4;
+      b = a;
+      memset(want, 0, sizeof want);
+      memset(got, 0, sizeof got);
+      ladder_c(&a, in, want, SYNTH_BLOCK);
+      bench_ladders[k].fn(&b, in, got, SYNTH_BLOCK);
+      if (memcmp(want, got, sizeof want) != 0 || memcmp(a.z, b.z, sizeof a.z) != 0) same = 0;
+    }
+    printf("  %-5s %s\n", bench_ladders[k].name, same ? "same bits" : "DIFFERENT");
+  }
+  printf("response at 1 kHz, dB:");
+  static double at[] = {250, 500, 1000, 2000, 4000};
+  for (int i = 0; i < 5; i++) printf(" %7.0f Hz", at[i]);
+  printf("\n");
+  for (int r = 0; r <= 3; r++) {
+    printf("  resonance %.2f      ", r * 0.3);
+    for (int i = 0; i < 5; i++) printf(" %10.1f", bench_ladder_gain(at[i], r * 1.2f));
+    printf("\n");
+  }
+  printf("%d saw-bl voices at %d Hz, ns a voice frame\n", BENCH_LANE_VOICES, SAMPLERATE);
+  printf("%-8s %10s %10s %10s %10s\n", "kernel", "no filter", "still", "swept", "filter");
+  ladder_fn keep = ladder_lanes;
+  double none = bench_ladder_voices(0);
+  for (int k = 0; k < count; k++) {
+    if (!bench_ladders[k].ok) continue;
+    ladder_lanes = bench_ladders[k].fn;
+    double still = bench_ladder_voices(1), swept = bench_ladder_voices(2);
+    printf("%-8s %10.3f %10.3f %10.3f %10.3f\n", bench_ladders[k].name, none, still, swept, swept - none);
+  }
+  ladder_lanes = keep;
+  printf("%-8s %10s %10s %10.3f %10s  (one voice, a tan every frame)\n", "frame", "", "", bench_ladder_frame(), "");
+}
+
+static struct {
+  char *name;
+  void (*run)(void);
+} benches[] = {
+  {"codec", bench_codec},
+  {"osc", bench_osc},
+  {"lanes", bench_lanes},
+  {"table", bench_table},
+  {"blep", bench_blep},
+  {"control", bench_control},
+  {"alloc", bench_alloc},
+  {"poly", bench_poly},
+  {"workers", bench_workers},
+  {"ladder", bench_ladder},
+};
+
+int main(int argc, char *argv[]) {
+  edge_init();
+  osc_init();
+  resample_init();
+  wavetable_init();
+  for (int i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    if (argc > 1 && strcmp(argv[1], benches[i].name) != 0) continue;
+    benches[i].run();
+  }
+  return 0;
+}
+
+#endif // EXA_BENCH
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#define MINIAUDIO_IMPLEMENTATION
+#include "miniaudio.h"
+
+// cz101-4.c made into phase distortion, the way the CZ-101 does it: a
+// cosine read with a bent phase, bent further the higher the DCW
+// envelope. the bends are worked out once into tables, a row for each
+// of PD_ROWS amounts, and a voice blends two rows and two points along
+// them. envelopes move once a PD_BLOCK and ramp in between, voices
+// render a block at a time in float.
+//
+// each voice has two lines, each with its own wave and envelopes, mixed
+// or ring modulated. "./cz101-5 -bench" renders without a device and
+// prints how many voices one core keeps up with.
+
+#define SAMPLE_RATE 44100
+#define NUM_VOICES 64
+#define PI 3.14159265358979323846
+#define PD_SIZE 1024 // points along a cycle
+#define PD_ROWS 33 // DCW amounts, 0 is a plain cosine
+#define PD_BLOCK 64 // frames between envelope steps
+#define ENV_STEPS 8
+
+typedef enum {
+    PD_SAW,
+    PD_SQUARE,
+    PD_PULSE,
+    PD_DOUBLE_SINE,
+    PD_SAW_PULSE,
+    PD_RESO_SAW, // the resonant ones window a faster cosine
+    PD_RESO_TRIANGLE,
+    PD_RESO_TRAPEZOID,
+    PD_WAVES
+} PDWave;
+
+typedef enum {
+    LINE_1,
+    LINE_1_2, // both lines added
+    LINE_RING // line 1 times line 2
+} LineMode;
+
+// the CZ's eight step envelopes: go to level in seconds, hold at the
+// sustain step while the key is down, then carry on from the step after
+typedef struct {
+    float level[ENV_STEPS];
+    float seconds[ENV_STEPS];
+    int steps;
+    int sustain;
+} Envelope;
+
+typedef struct {
+    int step; // -1 when done
+    float value;
+    float slope; // per frame
+    int left; // frames to the end of the step
+} EnvelopeState;
+
+typedef struct {
+    PDWave wave;
+    float detune; // ratio to the voice's pitch
+    Envelope dcw, dca;
+    EnvelopeState dcwState, dcaState;
+    uint32_t phase, inc;
+} Line;
+
+typedef struct {
+    Line line[2];
+    LineMode mode;
+    float amplitude;
+    int on, released;
+    uint32_t age;
+} Voice;
+
+typedef struct {
+    Voice voices[NUM_VOICES];
+    uint32_t clock;
+    ma_spinlock lock;
+} Synthesizer;
+
+static float pdTable[PD_WAVES][PD_ROWS][PD_SIZE + 1];
+
+// -----------------------------------------------------------
+
+// the bends, p the phase 0..1, d the amount 0..1
+
+// past the knee the cosine is done with its half cycle
+static double saw_phase(double p, double d) {
+    double k = 0.5 - 0.49 * d;
+    return p < k ? 0.5 * p / k : 0.5 + 0.5 * (p - k) / (1 - k);
+}
+
+// the cycle in a narrow part at the start, then held
+static double pulse_phase(double p, double d) {
+    double s = 1 - 0.96 * d;
+    return p < s ? p / s : 1;
+}
+
+// each half held, then a quick move to the other
+static double square_phase(double p, double d) {
+    double s = 1 - 0.96 * d;
+    double half = p < 0.5 ? 0 : 0.5;
+    double q = 2 * (p - half);
+    double w = q < 1 - s ? 0 : (q - (1 - s)) / s;
+    return half + 0.5 * w;
+}
+
+static double pd_value(PDWave wave, double p, double d) {
+    switch (wave) {
+        case PD_SAW:
+            return cos(2 * PI * saw_phase(p, d));
+        case PD_SQUARE:
+            return cos(2 * PI * square_phase(p, d));
+        case PD_PULSE:
+            return cos(2 * PI * pulse_phase(p, d));
+        case PD_DOUBLE_SINE:
+            // towards two cycles in one
+            return cos(2 * PI * (p + d * (p < 0.5 ? p : p - 1)));
+        case PD_SAW_PULSE:
+            return cos(2 * PI * (p < 0.5 ? 0.5 * saw_phase(2 * p, d) : 0.5 + 0.5 * pulse_phase(2 * p - 1, d)));
+        case PD_RESO_SAW:
+        case PD_RESO_TRIANGLE:
+        case PD_RESO_TRAPEZOID: {
+            // a cosine 1 to 16 times as fast, faded out by the end of the
+            // cycle, where it restarts
+            double window;
+            if (wave == PD_RESO_SAW) window = 1 - p;
+            else if (wave == PD_RESO_TRIANGLE) window = 1 - fabs(2 * p - 1);
+            else window = p < 0.5 ? 1 : 2 - 2 * p;
+            double r = 1 + 15 * d;
+            return 1 - window * (1 - cos(2 * PI * p * r));
+        }
+        default:
+            return cos(2 * PI * p);
+    }
+}
+
+void init_tables(void) {
+    for (int w = 0; w < PD_WAVES; w++) {
+        for (int r = 0; r < PD_ROWS; r++) {
+            for (int i = 0; i <= PD_SIZE; i++) {
+                pdTable[w][r][i] = pd_value(w, (double)(i % PD_SIZE) / PD_SIZE, (double)r / (PD_ROWS - 1));
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------
+
+// the next step, or sustain, or done
+static void next_step(const Envelope* env, EnvelopeState* s, int released) {
+    if (!released && s->step == env->sustain) {
+        s->slope = 0;
+        s->left = 1 << 30;
+        return;
+    }
+    s->step++;
+    if (s->step >= env->steps) {
+        s->step = -1;
+        s->slope = 0;
+        s->left = 1 << 30;
+        return;
+    }
+    int frames = env->seconds[s->step] * SAMPLE_RATE;
+    if (frames < 1) frames = 1;
+    s->slope = (env->level[s->step] - s->value) / frames;
+    s->left = frames;
+}
+
+void start_envelope(const Envelope* env, EnvelopeState* s, float from) {
+    s->value = from;
+    s->step = -1;
+    next_step(env, s, 0);
+}
+
+// from wherever it has got to on to the step after sustain
+void release_envelope(const Envelope* env, EnvelopeState* s) {
+    if (s->step < 0 || s->step > env->sustain) return;
+    s->step = env->sustain;
+    next_step(env, s, 1);
+}
+
+// n frames on, returns where it ends up
+static float run_envelope(const Envelope* env, EnvelopeState* s, int n, int released) {
+    while (n > 0 && s->step >= 0) {
+        int m = n < s->left ? n : s->left;
+        s->value += s->slope * m;
+        s->left -= m;
+        n -= m;
+        if (s->left == 0) {
+            s->value = env->level[s->step];
+            next_step(env, s, released);
+        }
+    }
+    return s->value;
+}
+
+// -----------------------------------------------------------
+
+// one line for n frames at unit level, the DCW ramping from d0 to d1
+static void run_line(Line* line, float* out, int n, float d0, float d1) {
+    const float(*rows)[PD_SIZE + 1] = pdTable[line->wave];
+    float d = d0 * (PD_ROWS - 1), dd = (d1 - d0) * (PD_ROWS - 1) / n;
+    uint32_t phase = line->phase, inc = line->inc;
+    for (int i = 0; i < n; i++) {
+        int r = (int)d;
+        if (r > PD_ROWS - 2) r = PD_ROWS - 2;
+        float rf = d - r;
+        uint32_t j = phase >> 22; // 10 bits for PD_SIZE
+        float f = ((phase >> 6) & 0xFFFF) * (1.0f / 65536.0f);
+        const float* a = &rows[r][j];
+        const float* b = &rows[r + 1][j];
+        float x = a[0] + (a[1] - a[0]) * f;
+        float y = b[0] + (b[1] - b[0]) * f;
+        out[i] = x + (y - x) * rf;
+        phase += inc;
+        d += dd;
+    }
+    line->phase = phase;
+}
+
+// a voice for one block of n frames, added to out
+static void run_voice(Voice* voice, float* out, int n) {
+    float a[PD_BLOCK], b[PD_BLOCK];
+    float level[2][2];
+    int lines = voice->mode == LINE_1 ? 1 : 2;
+    for (int k = 0; k < lines; k++) {
+        Line* line = &voice->line[k];
+        float d0 = line->dcwState.value, g0 = line->dcaState.value;
+        float d1 = run_envelope(&line->dcw, &line->dcwState, n, voice->released);
+        float g1 = run_envelope(&line->dca, &line->dcaState, n, voice->released);
+        run_line(line, k ? b : a, n, d0, d1);
+        level[k][0] = g0 * voice->amplitude;
+        level[k][1] = (g1 - g0) * voice->amplitude / n;
+    }
+    switch (voice->mode) {
+        case LINE_1:
+            for (int i = 0; i < n; i++) out[i] += a[i] * (level[0][0] + level[0][1] * i);
+            break;
+        case LINE_1_2:
+            for (int i = 0; i < n; i++) {
+                out[i] += a[i] * (level[0][0] + level[0][1] * i) + b[i] * (level[1][0] + level[1][1] * i);
+            }
+            break;
+        case LINE_RING:
+            // line 2's DCA has no say, the product takes line 1's
+            for (int i = 0; i < n; i++) out[i] += a[i] * b[i] * (level[0][0] + level[0][1] * i);
+            break;
+    }
+    if (voice->line[0].dcaState.step < 0 && (lines == 1 || voice->line[1].dcaState.step < 0)) voice->on = 0;
+}
+
+void render(Synthesizer* synth, float* out, int frames) {
+    memset(out, 0, frames * sizeof(float));
+    ma_spinlock_lock(&synth->lock);
+    for (int done = 0; done < frames; done += PD_BLOCK) {
+        int n = frames - done < PD_BLOCK ? frames - done : PD_BLOCK;
+        for (int v = 0; v < NUM_VOICES; v++) {
+            if (synth->voices[v].on) run_voice(&synth->voices[v], out + done, n);
+        }
+    }
+    ma_spinlock_unlock(&synth->lock);
+}
+
+// -----------------------------------------------------------
+
+// a patch: both lines' waves, detune and envelopes
+typedef struct {
+    LineMode mode;
+    PDWave wave[2];
+    float detune[2];
+    Envelope dcw[2], dca[2];
+} Patch;
+
+static const Patch brass = {
+    LINE_1_2, {PD_SAW, PD_SQUARE}, {1.0f, 1.004f},
+    {{{0.9f, 0.5f, 0}, {0.05f, 0.6f, 0.3f}, 3, 1}, {{0.7f, 0.3f, 0}, {0.08f, 0.8f, 0.3f}, 3, 1}},
+    {{{1, 0.8f, 0}, {0.02f, 0.3f, 0.3f}, 3, 1}, {{1, 0.8f, 0}, {0.03f, 0.3f, 0.3f}, 3, 1}},
+};
+
+static const Patch bell = {
+    LINE_RING, {PD_RESO_TRIANGLE, PD_DOUBLE_SINE}, {1.0f, 3.51f},
+    {{{0.8f, 0.1f, 0}, {0.001f, 1.5f, 0.5f}, 3, 1}, {{1, 0.4f, 0}, {0.001f, 2.0f, 0.5f}, 3, 1}},
+    {{{1, 0.4f, 0}, {0.002f, 2.0f, 0.8f}, 3, 1}, {{1, 1, 0}, {0.001f, 1, 0.5f}, 3, 1}},
+};
+
+void init_synth(Synthesizer* synth) {
+    memset(synth, 0, sizeof *synth);
+}
+
+// a free voice, or the one that has been going longest
+int note_on(Synthesizer* synth, const Patch* patch, double frequency, double amplitude) {
+    ma_spinlock_lock(&synth->lock);
+    int pick = 0;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (!synth->voices[v].on) {
+            pick = v;
+            break;
+        }
+        if (synth->voices[v].age < synth->voices[pick].age) pick = v;
+    }
+    Voice* voice = &synth->voices[pick];
+    voice->mode = patch->mode;
+    voice->amplitude = amplitude;
+    voice->on = 1;
+    voice->released = 0;
+    voice->age = ++synth->clock;
+    for (int k = 0; k < 2; k++) {
+        Line* line = &voice->line[k];
+        line->wave = patch->wave[k];
+        line->detune = patch->detune[k];
+        line->dcw = patch->dcw[k];
+        line->dca = patch->dca[k];
+        line->phase = 0;
+        line->inc = (uint32_t)(frequency * line->detune / SAMPLE_RATE * 4294967296.0);
+        start_envelope(&line->dcw, &line->dcwState, 0);
+        start_envelope(&line->dca, &line->dcaState, 0);
+    }
+    ma_spinlock_unlock(&synth->lock);
+    return pick;
+}
+
+void note_off(Synthesizer* synth, int v) {
+    ma_spinlock_lock(&synth->lock);
+    Voice* voice = &synth->voices[v];
+    if (voice->on && !voice->released) {
+        voice->released = 1;
+        for (int k = 0; k < 2; k++) {
+            release_envelope(&voice->line[k].dcw, &voice->line[k].dcwState);
+            release_envelope(&voice->line[k].dca, &voice->line[k].dcaState);
+        }
+    }
+    ma_spinlock_unlock(&synth->lock);
+}
+
+void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    render((Synthesizer*)pDevice->pUserData, (float*)pOutput, frameCount);
+    (void)pInput;
+}
+
+void play_music(Synthesizer* synth, int bpm) {
+    double seconds_per_beat = 60.0 / bpm;
+    double melody[] = {440.0, 392.0, 349.23, 329.63, 293.66, 261.63, 293.66, 329.63,
+                       392.0, 349.23, 329.63, 293.66, 261.63, 293.66, 329.63, 349.23};
+    int length = sizeof(melody) / sizeof(double);
+    for (int i = 0; i < length; i++) {
+        const Patch* patch = i % 4 == 3 ? &bell : &brass;
+        int v = note_on(synth, patch, melody[i], 0.2);
+        int w = note_on(synth, patch, melody[i] * 1.5, 0.15);
+        ma_sleep((int)(seconds_per_beat * 700));
+        note_off(synth, v);
+        note_off(synth, w);
+        ma_sleep((int)(seconds_per_beat * 300));
+    }
+    ma_sleep(2000);
+}
+
+// -----------------------------------------------------------
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// every voice held down on a two line patch, timed over a few seconds of output
+int bench(void) {
+    static Synthesizer synth;
+    static const Patch* patches[] = {&brass, &bell};
+    static float out[512];
+    printf("%-8s %8s %12s %14s\n", "patch", "voices", "ns/voice/fr", "voices a core");
+    for (int p = 0; p < 2; p++) {
+        for (int voices = 8; voices <= NUM_VOICES; voices *= 2) {
+            init_synth(&synth);
+            Patch held = *patches[p];
+            for (int k = 0; k < 2; k++) {
+                // long steps so nothing finishes while timing
+                held.dca[k].seconds[1] = held.dcw[k].seconds[1] = 1000;
+            }
+            for (int v = 0; v < voices; v++) note_on(&synth, &held, 110 * pow(2, v / 12.0), 1.0 / voices);
+            int frames = 5 * SAMPLE_RATE;
+            double t0 = now_seconds();
+            for (int done = 0; done < frames; done += 512) render(&synth, out, 512);
+            double t = now_seconds() - t0;
+            double ns = t * 1e9 / ((double)frames * voices);
+            printf("%-8s %8d %12.2f %14.0f\n", p ? "bell" : "brass", voices, ns, 1e9 / (ns * SAMPLE_RATE));
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    init_tables();
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0) return bench();
+
+    Synthesizer* synth = malloc(sizeof(Synthesizer));
+    init_synth(synth);
+
+    ma_device_config deviceConfig;
+    ma_device device;
+
+    deviceConfig = ma_device_config_init(ma_device_type_playback);
+    deviceConfig.playback.format = ma_format_f32;
+    deviceConfig.playback.channels = 1;
+    deviceConfig.sampleRate = SAMPLE_RATE;
+    deviceConfig.dataCallback = data_callback;
+    deviceConfig.pUserData = synth;
+
+    if (ma_device_init(NULL, &deviceConfig, &device) != MA_SUCCESS) {
+        printf("Failed to initialize playback device.\n");
+        return -1;
+    }
+
+    if (ma_device_start(&device) != MA_SUCCESS) {
+        printf("Failed to start playback device.\n");
+        ma_device_uninit(&device);
+        return -1;
+    }
+
+    int bpm = 90;
+
+    // Play the music
+    play_music(synth, bpm);
+
+    ma_device_uninit(&device);
+    free(synth);
+
+    return 0;
+}
@@ -36,12 +36,13 @@ typedef struct {
 } Voice;
 
 // Global variables
+ma_context context;
 ma_device device;
 Voice voice;
 
 // Function declarations
 void initVoice();
-void processAudio(float* pOutput, float* pInput, ma_uint32 frameCount);
+void processAudio(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
 double calculateEnvelope(Voice* voice);
 double calculateLFO(double frequency, double lfoDepth, double lfoFrequency);
 double applyFilter(double inputSample, double cutoff, double resonance);
@@ -68,11 +69,12 @@ void initVoice() {
 }
 
 // Process audio callback function
-void processAudio(float* pOutput, float* pInput, ma_uint32 frameCount) {
+void processAudio(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    float* out = (float*)pOutput;
     ma_uint32 i;
     for (i = 0; i < frameCount; ++i) {
         double sample = nextSample();
-        pOutput[i] = (float)sample;
+        out[i] = (float)sample;
     }
 }
 
@@ -98,11 +100,34 @@ double calculateLFO(double frequency, double lfoDepth, double lfoFrequency) {
     return lfoDepth * sin(2.0 * PI * lfoFrequency * voice.phase / voice.sampleRate);
 }
 
+// Soft clipper standing in for tanh, exact at 0 and 1 at +-3
+double ladderClip(double x) {
+    if (x > 3.0) x = 3.0;
+    if (x < -3.0) x = -3.0;
+    return x * (27.0 + x * x) / (27.0 + 9.0 * x * x);
+}
+
 // Apply Moog ladder filter
+//
+// Four trapezoidal one pole stages with the output fed back, the
+// feedback solved for the current sample (zero delay feedback) and the
+// input soft clipped. resonance is 0..1, the filter rings at 1.
+// exaudio.c has the same ladder running eight voices at a time.
 double applyFilter(double inputSample, double cutoff, double resonance) {
-    // Implement Moog ladder filter algorithm
-    // ...
-    return inputSample;
+    static double z[4];
+    if (cutoff < 20.0) cutoff = 20.0;
+    if (cutoff > 0.45 * voice.sampleRate) cutoff = 0.45 * voice.sampleRate;
+    double g = tan(PI * cutoff / voice.sampleRate);
+    double G = g / (1.0 + g);
+    double k = 4.0 * resonance;
+    double S = (1.0 - G) * (G * (G * (G * z[0] + z[1]) + z[2]) + z[3]);
+    double y = ladderClip((inputSample - k * S) / (1.0 + k * G * G * G * G));
+    for (int i = 0; i < 4; i++) {
+        double stage = G * y + (1.0 - G) * z[i];
+        z[i] = 2.0 * stage - z[i];
+        y = stage;
+    }
+    return y;
 }
 
 // Generate next audio sample
@@ -110,7 +135,7 @@ double nextSample() {
     double envelope = calculateEnvelope(&voice);
     double lfoValue = calculateLFO(voice.frequency, voice.filterLFOAmount, voice.lfoFrequency);
     double filteredSample = applyFilter(voice.amplitude * sin(2.0 * PI * voice.frequency * voice.phase / voice.sampleRate), 
-                                        voice.filterCutoff + voice.filterEnvAmount * envelope + voice.filterLFOAmount * lfoValue, 
+                                        voice.filterCutoff + voice.filterEnvAmount * envelope + lfoValue, 
                                         voice.filterResonance);
     
     voice.phase += 1.0;
@@ -121,7 +146,7 @@ int main() {
     ma_result result;
 
     // Initialize miniaudio context
-    result = ma_context_init(NULL, 0, NULL, &device.context);
+    result = ma_context_init(NULL, 0, NULL, &context);
     if (result != MA_SUCCESS) {
         printf("Failed to initialize miniaudio context.\n");
         return -1;
@@ -138,10 +163,10 @@ int main() {
     deviceConfig.dataCallback = processAudio;
 
     // Initialize the playback device
-    result = ma_device_init(NULL, &deviceConfig, &device);
+    result = ma_device_init(&context, &deviceConfig, &device);
     if (result != MA_SUCCESS) {
         printf("Failed to initialize playback device.\n");
-        ma_context_uninit(&device.context);
+        ma_context_uninit(&context);
         return -1;
     }
 
@@ -150,7 +175,7 @@ int main() {
     if (result != MA_SUCCESS) {
         printf("Failed to start playback device.\n");
         ma_device_uninit(&device);
-        ma_context_uninit(&device.context);
+        ma_context_uninit(&context);
         return -1;
     }
 
@@ -161,7 +186,7 @@ int main() {
     ma_device_uninit(&device);
 
     // Uninitialize miniaudio context
-    ma_context_uninit(&device.context);
+    ma_context_uninit(&context);
 
     return 0;
 }
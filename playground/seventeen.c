@@ -0,0 +1,684 @@
+#define MINIAUDIO_IMPLEMENTATION
+#include "miniaudio.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// sixteen.c without the per-sample dispatch. sixteen runs every sample
+// of every oscillator through the switch in generate_waveform and the
+// enableAmpEnvelope / enableFreqEnvelope / enablePWM checks, which never
+// change while a note plays. here configure_oscillator looks at them
+// once and picks a block kernel out of voiceKernels, one function per
+// waveform, amplitude mode and frequency mode, all stamped out by
+// VOICE_KERNEL from the same inline body with the features as
+// constants, so each one only has the code its voice needs.
+//
+// LFOs render a block ahead into a buffer that the voices read, rather
+// than being stepped by every get_lfo_value call as in sixteen, so an
+// LFO runs at its own rate however many oscillators it modulates. only
+// oscillators marked isLFO can be routed.
+//
+// "./seventeen -bench" renders mixes of configurations both ways, the
+// sixteen way per sample and with the kernels, checks they come out the
+// same and prints the speedup.
+
+#define SAMPLE_RATE 44100
+#define MAX_OSCILLATORS 64
+#define MAX_SAMPLE_FRAMES SAMPLE_RATE * 10  // Maximum sample length of 10 seconds at SAMPLE_RATE
+#define BLOCK 64 // frames a kernel renders at a time
+
+typedef enum {
+    WAVEFORM_SQUARE,
+    WAVEFORM_SINE,
+    WAVEFORM_TRIANGLE,
+    WAVEFORM_SAWTOOTH,
+    WAVEFORM_SAMPLE,
+    WAVEFORM_PULSE
+} WaveformType;
+
+// the waves as the kernels see them, pulse split on whether an LFO moves the width
+typedef enum {
+    KERNEL_SQUARE,
+    KERNEL_SINE,
+    KERNEL_TRIANGLE,
+    KERNEL_SAWTOOTH,
+    KERNEL_SAMPLE,
+    KERNEL_PULSE,
+    KERNEL_PWM,
+    KERNEL_WAVES
+} KernelWave;
+
+// how an envelope applies: not at all, on its own, or with an LFO on top
+typedef enum {
+    MOD_OFF,
+    MOD_ENVELOPE,
+    MOD_ENVELOPE_LFO,
+    MOD_MODES
+} ModMode;
+
+typedef struct Oscillator Oscillator;
+
+typedef void (*VoiceKernel)(Oscillator *osc, float *out, int n, const float *ampLfo, const float *freqLfo, const float *pwmLfo);
+typedef void (*LfoKernel)(Oscillator *osc, float *out, int n);
+
+struct Oscillator {
+    float amplitude;
+    float baseFrequency;
+    float sampleRate;
+    float phase;
+    float ampAttack;
+    float ampDecay;
+    float ampSustain;
+    float ampRelease;
+    float freqAttack;
+    float freqDecay;
+    float freqSustain;
+    float freqRelease;
+    WaveformType waveformType;
+    int noteOn;
+    int noteOff;
+    float time;
+    float releaseStartTime;
+    float* sampleData;
+    size_t sampleFrames;
+    float sampleOriginalSampleRate;
+    int enableAmpEnvelope;   // Flag to enable/disable amplitude envelope
+    int enableFreqEnvelope;  // Flag to enable/disable frequency envelope
+    int enablePWM;           // Flag to enable/disable pulse width modulation
+    float pulseWidth;        // Pulse width for pulse waveform
+    int ampLfoIndex;         // Index of the oscillator used for amplitude modulation
+    int freqLfoIndex;        // Index of the oscillator used for frequency modulation
+    int pwmLfoIndex;         // Index of the oscillator used for pulse width modulation
+    int isLFO;               // Flag to indicate if this oscillator is used as an LFO
+    // set by configure_oscillator from everything above
+    VoiceKernel kernel;
+    LfoKernel lfoKernel;
+    int ampLfo, freqLfo, pwmLfo; // LFO oscillators actually routed, -1 for none
+};
+
+typedef struct {
+    Oscillator oscillators[MAX_OSCILLATORS];
+    int numOscillators;
+    float lfo[MAX_OSCILLATORS][BLOCK]; // this block of each LFO
+} OscillatorSystem;
+
+// -----------------------------------------------------------
+// pieces shared by both ways of rendering
+
+static inline float sample_value(const Oscillator *osc, float phase) {
+    if (osc->sampleData && osc->sampleFrames > 0) {
+        // Adjust the phase increment according to the original sample rate
+        size_t index = (size_t)(phase * osc->sampleFrames * (osc->sampleOriginalSampleRate / osc->sampleRate));
+        index = index % osc->sampleFrames;
+        return osc->sampleData[index];
+    }
+    return 0.0f;
+}
+
+// the envelope stages at time t, without any LFO; clears noteOff once released to the end
+static inline float amp_stages(Oscillator *osc, float t) {
+    float ampEnv = 0.0f;
+    if (osc->noteOn && !osc->noteOff) {
+        if (t < osc->ampAttack) {
+            ampEnv = t / osc->ampAttack;
+        } else if (t < osc->ampAttack + osc->ampDecay) {
+            ampEnv = 1.0f - ((t - osc->ampAttack) / osc->ampDecay) * (1.0f - osc->ampSustain);
+        } else {
+            ampEnv = osc->ampSustain;
+        }
+    } else if (osc->noteOff) {
+        float r = t - osc->releaseStartTime;
+        if (r < osc->ampRelease) {
+            ampEnv = osc->ampSustain * (1.0f - r / osc->ampRelease);
+        } else {
+            osc->noteOff = 0;  // Reset noteOff flag after release phase is done
+        }
+    }
+    return ampEnv;
+}
+
+static inline float freq_stages(Oscillator *osc, float t) {
+    float freqEnv = osc->baseFrequency;
+    if (osc->noteOn && !osc->noteOff) {
+        if (t < osc->freqAttack) {
+            freqEnv *= (1.0f + t / osc->freqAttack);
+        } else if (t < osc->freqAttack + osc->freqDecay) {
+            freqEnv *= (2.0f - (t - osc->freqAttack) / osc->freqDecay * (1.0f - osc->freqSustain));
+        } else {
+            freqEnv *= osc->freqSustain;
+        }
+    } else if (osc->noteOff) {
+        float r = t - osc->releaseStartTime;
+        if (r < osc->freqRelease) {
+            freqEnv *= osc->freqSustain * (1.0f - r / osc->freqRelease);
+        } else {
+            osc->noteOff = 0;  // Reset noteOff flag after release phase is done
+        }
+    }
+    return freqEnv;
+}
+
+// an LFO index that can be read, or -1
+static int lfo_route(const OscillatorSystem *oscSystem, int lfoIndex) {
+    if (lfoIndex < 0 || lfoIndex >= oscSystem->numOscillators) return -1;
+    return oscSystem->oscillators[lfoIndex].isLFO ? lfoIndex : -1;
+}
+
+// -----------------------------------------------------------
+// the sixteen.c way, a sample at a time, kept for the bench
+
+float generate_waveform(Oscillator *osc, float phase, WaveformType type) {
+    switch (type) {
+        case WAVEFORM_SQUARE:
+            return phase < 0.5f ? 1.0f : -1.0f;
+        case WAVEFORM_SINE:
+            return sinf(2.0f * M_PI * phase);
+        case WAVEFORM_TRIANGLE:
+            return 4.0f * fabsf(phase - 0.5f) - 1.0f;
+        case WAVEFORM_SAWTOOTH:
+            return 2.0f * (phase - floorf(phase + 0.5f));
+        case WAVEFORM_PULSE:
+            return phase < osc->pulseWidth ? 1.0f : -1.0f;
+        case WAVEFORM_SAMPLE:
+            return sample_value(osc, phase);
+        default:
+            return 0.0f;
+    }
+}
+
+float get_lfo_value(OscillatorSystem *oscSystem, const float *lfo, int lfoIndex) {
+    int route = lfo_route(oscSystem, lfoIndex);
+    return route < 0 ? 0.0f : lfo[route];
+}
+
+float amplitude_envelope(OscillatorSystem *oscSystem, Oscillator *osc, const float *lfo) {
+    if (!osc->enableAmpEnvelope) return 1.0f;
+    float ampEnv = amp_stages(osc, osc->time);
+    float lfoValue = get_lfo_value(oscSystem, lfo, osc->ampLfoIndex);
+    return ampEnv + 0.1f * lfoValue;  // Adjust the depth as needed
+}
+
+float frequency_envelope(OscillatorSystem *oscSystem, Oscillator *osc, const float *lfo) {
+    if (!osc->enableFreqEnvelope) return osc->baseFrequency;
+    float freqEnv = freq_stages(osc, osc->time);
+    float lfoValue = get_lfo_value(oscSystem, lfo, osc->freqLfoIndex);
+    return freqEnv * (1.0f + 0.1f * lfoValue);  // Adjust the depth as needed
+}
+
+float generate_oscillator(OscillatorSystem *oscSystem, Oscillator *osc, const float *lfo) {
+    if (!osc->noteOn && !osc->noteOff) {
+        return 0.0f;
+    }
+
+    float currentFrequency = frequency_envelope(oscSystem, osc, lfo);
+    if (osc->enablePWM) {
+        float lfoValue = get_lfo_value(oscSystem, lfo, osc->pwmLfoIndex);
+        osc->pulseWidth = 0.5f + 0.5f * lfoValue;  // Adjust the depth as needed
+    }
+    float value = generate_waveform(osc, osc->phase, osc->waveformType);
+    osc->phase += currentFrequency / osc->sampleRate;
+    if (osc->phase >= 1.0f) osc->phase -= 1.0f;
+    return value * amplitude_envelope(oscSystem, osc, lfo) * osc->amplitude;
+}
+
+// mono, normalised like sixteen's callback
+void render_switch(OscillatorSystem *oscSystem, float *out, int frames) {
+    float lfo[MAX_OSCILLATORS];
+    for (int i = 0; i < frames; ++i) {
+        for (int j = 0; j < oscSystem->numOscillators; ++j) {
+            Oscillator *lfoOsc = &oscSystem->oscillators[j];
+            if (!lfoOsc->isLFO) continue;
+            lfoOsc->phase += lfoOsc->baseFrequency / lfoOsc->sampleRate;
+            if (lfoOsc->phase >= 1.0f) lfoOsc->phase -= 1.0f;
+            lfo[j] = generate_waveform(lfoOsc, lfoOsc->phase, lfoOsc->waveformType);
+        }
+        float sample = 0.0f;
+        for (int j = 0; j < oscSystem->numOscillators; ++j) {
+            if (!oscSystem->oscillators[j].isLFO) {
+                sample += generate_oscillator(oscSystem, &oscSystem->oscillators[j], lfo);
+            }
+        }
+        sample /= oscSystem->numOscillators; // Normalize to avoid clipping
+        out[i] = sample;
+        for (int j = 0; j < oscSystem->numOscillators; ++j) {
+            if (oscSystem->oscillators[j].noteOn || oscSystem->oscillators[j].noteOff) {
+                oscSystem->oscillators[j].time += 1.0f / oscSystem->oscillators[j].sampleRate;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------
+// block kernels. wave, amp, freq are constants in every caller, so the
+// switch and the ifs on them fold away and leave one straight loop
+
+static inline __attribute__((always_inline)) float wave_value(const Oscillator *osc, float phase, float pulseWidth, KernelWave wave) {
+    switch (wave) {
+        case KERNEL_SQUARE:
+            return phase < 0.5f ? 1.0f : -1.0f;
+        case KERNEL_SINE:
+            return sinf(2.0f * M_PI * phase);
+        case KERNEL_TRIANGLE:
+            return 4.0f * fabsf(phase - 0.5f) - 1.0f;
+        case KERNEL_SAWTOOTH:
+            return 2.0f * (phase - floorf(phase + 0.5f));
+        case KERNEL_PULSE:
+        case KERNEL_PWM:
+            return phase < pulseWidth ? 1.0f : -1.0f;
+        case KERNEL_SAMPLE:
+            return sample_value(osc, phase);
+        default:
+            return 0.0f;
+    }
+}
+
+// n frames of a playing voice added to out, stopping early if its release runs out
+static inline __attribute__((always_inline)) void render_voice(Oscillator *osc, float *out, int n,
+        const float *ampLfo, const float *freqLfo, const float *pwmLfo, KernelWave wave, ModMode amp, ModMode freq) {
+    float phase = osc->phase, time = osc->time, pulseWidth = osc->pulseWidth;
+    float step = 1.0f / osc->sampleRate;
+    for (int i = 0; i < n; ++i) {
+        float currentFrequency = osc->baseFrequency;
+        if (freq != MOD_OFF) currentFrequency = freq_stages(osc, time);
+        if (freq == MOD_ENVELOPE_LFO) currentFrequency *= 1.0f + 0.1f * freqLfo[i];
+        if (wave == KERNEL_PWM) pulseWidth = 0.5f + 0.5f * pwmLfo[i];
+        float value = wave_value(osc, phase, pulseWidth, wave);
+        phase += currentFrequency / osc->sampleRate;
+        if (phase >= 1.0f) phase -= 1.0f;
+        float ampEnv = 1.0f;
+        if (amp != MOD_OFF) ampEnv = amp_stages(osc, time);
+        if (amp == MOD_ENVELOPE_LFO) ampEnv += 0.1f * ampLfo[i];
+        out[i] += value * ampEnv * osc->amplitude;
+        // only the envelopes end a note
+        if ((amp != MOD_OFF || freq != MOD_OFF) && !osc->noteOn && !osc->noteOff) break;
+        time += step;
+    }
+    osc->phase = phase;
+    osc->time = time;
+    osc->pulseWidth = pulseWidth;
+}
+
+static inline __attribute__((always_inline)) void render_lfo(Oscillator *osc, float *out, int n, KernelWave wave) {
+    float phase = osc->phase, inc = osc->baseFrequency / osc->sampleRate;
+    for (int i = 0; i < n; ++i) {
+        phase += inc;
+        if (phase >= 1.0f) phase -= 1.0f;
+        out[i] = wave_value(osc, phase, osc->pulseWidth, wave);
+    }
+    osc->phase = phase;
+}
+
+#define VOICE_KERNEL(w, wave, a, amp, f, freq) \
+    static void voice_##w##_##a##_##f(Oscillator *osc, float *out, int n, \
+            const float *ampLfo, const float *freqLfo, const float *pwmLfo) { \
+        render_voice(osc, out, n, ampLfo, freqLfo, pwmLfo, wave, amp, freq); \
+    }
+
+#define VOICE_KERNELS(w, wave) \
+    VOICE_KERNEL(w, wave, off, MOD_OFF, off, MOD_OFF) \
+    VOICE_KERNEL(w, wave, off, MOD_OFF, env, MOD_ENVELOPE) \
+    VOICE_KERNEL(w, wave, off, MOD_OFF, lfo, MOD_ENVELOPE_LFO) \
+    VOICE_KERNEL(w, wave, env, MOD_ENVELOPE, off, MOD_OFF) \
+    VOICE_KERNEL(w, wave, env, MOD_ENVELOPE, env, MOD_ENVELOPE) \
+    VOICE_KERNEL(w, wave, env, MOD_ENVELOPE, lfo, MOD_ENVELOPE_LFO) \
+    VOICE_KERNEL(w, wave, lfo, MOD_ENVELOPE_LFO, off, MOD_OFF) \
+    VOICE_KERNEL(w, wave, lfo, MOD_ENVELOPE_LFO, env, MOD_ENVELOPE) \
+    VOICE_KERNEL(w, wave, lfo, MOD_ENVELOPE_LFO, lfo, MOD_ENVELOPE_LFO) \
+    static void lfo_##w(Oscillator *osc, float *out, int n) { \
+        render_lfo(osc, out, n, wave); \
+    }
+
+#define KERNEL_ROW(w) { \
+    {voice_##w##_off_off, voice_##w##_off_env, voice_##w##_off_lfo}, \
+    {voice_##w##_env_off, voice_##w##_env_env, voice_##w##_env_lfo}, \
+    {voice_##w##_lfo_off, voice_##w##_lfo_env, voice_##w##_lfo_lfo}, \
+}
+
+VOICE_KERNELS(square, KERNEL_SQUARE)
+VOICE_KERNELS(sine, KERNEL_SINE)
+VOICE_KERNELS(triangle, KERNEL_TRIANGLE)
+VOICE_KERNELS(sawtooth, KERNEL_SAWTOOTH)
+VOICE_KERNELS(sample, KERNEL_SAMPLE)
+VOICE_KERNELS(pulse, KERNEL_PULSE)
+VOICE_KERNELS(pwm, KERNEL_PWM)
+
+// [wave][amp][freq]
+static const VoiceKernel voiceKernels[KERNEL_WAVES][MOD_MODES][MOD_MODES] = {
+    KERNEL_ROW(square),
+    KERNEL_ROW(sine),
+    KERNEL_ROW(triangle),
+    KERNEL_ROW(sawtooth),
+    KERNEL_ROW(sample),
+    KERNEL_ROW(pulse),
+    KERNEL_ROW(pwm),
+};
+
+static const LfoKernel lfoKernels[KERNEL_WAVES] = {
+    lfo_square, lfo_sine, lfo_triangle, lfo_sawtooth, lfo_sample, lfo_pulse, lfo_pwm,
+};
+
+// picks the kernels; call again after changing the waveform, flags or routing
+void configure_oscillator(OscillatorSystem *oscSystem, Oscillator *osc) {
+    static const KernelWave waves[] = {
+        [WAVEFORM_SQUARE] = KERNEL_SQUARE,
+        [WAVEFORM_SINE] = KERNEL_SINE,
+        [WAVEFORM_TRIANGLE] = KERNEL_TRIANGLE,
+        [WAVEFORM_SAWTOOTH] = KERNEL_SAWTOOTH,
+        [WAVEFORM_SAMPLE] = KERNEL_SAMPLE,
+        [WAVEFORM_PULSE] = KERNEL_PULSE,
+    };
+    KernelWave wave = waves[osc->waveformType];
+    osc->ampLfo = osc->enableAmpEnvelope ? lfo_route(oscSystem, osc->ampLfoIndex) : -1;
+    osc->freqLfo = osc->enableFreqEnvelope ? lfo_route(oscSystem, osc->freqLfoIndex) : -1;
+    osc->pwmLfo = osc->enablePWM ? lfo_route(oscSystem, osc->pwmLfoIndex) : -1;
+    // PWM with nothing routed holds the width at the middle
+    if (osc->enablePWM && osc->pwmLfo < 0) osc->pulseWidth = 0.5f;
+    if (wave == KERNEL_PULSE && osc->pwmLfo >= 0) wave = KERNEL_PWM;
+    ModMode amp = !osc->enableAmpEnvelope ? MOD_OFF : osc->ampLfo < 0 ? MOD_ENVELOPE : MOD_ENVELOPE_LFO;
+    ModMode freq = !osc->enableFreqEnvelope ? MOD_OFF : osc->freqLfo < 0 ? MOD_ENVELOPE : MOD_ENVELOPE_LFO;
+    osc->kernel = voiceKernels[wave][amp][freq];
+    osc->lfoKernel = lfoKernels[waves[osc->waveformType]];
+}
+
+void configure_system(OscillatorSystem *oscSystem) {
+    for (int j = 0; j < oscSystem->numOscillators; ++j) {
+        configure_oscillator(oscSystem, &oscSystem->oscillators[j]);
+    }
+}
+
+// mono, a block at a time: the LFOs first, then each voice's kernel
+void render_kernels(OscillatorSystem *oscSystem, float *out, int frames) {
+    for (int done = 0; done < frames; done += BLOCK) {
+        int n = frames - done < BLOCK ? frames - done : BLOCK;
+        float mix[BLOCK] = {0};
+        for (int j = 0; j < oscSystem->numOscillators; ++j) {
+            Oscillator *osc = &oscSystem->oscillators[j];
+            if (osc->isLFO) osc->lfoKernel(osc, oscSystem->lfo[j], n);
+        }
+        for (int j = 0; j < oscSystem->numOscillators; ++j) {
+            Oscillator *osc = &oscSystem->oscillators[j];
+            if (osc->isLFO || (!osc->noteOn && !osc->noteOff)) continue;
+            osc->kernel(osc, mix, n,
+                osc->ampLfo < 0 ? NULL : oscSystem->lfo[osc->ampLfo],
+                osc->freqLfo < 0 ? NULL : oscSystem->lfo[osc->freqLfo],
+                osc->pwmLfo < 0 ? NULL : oscSystem->lfo[osc->pwmLfo]);
+        }
+        for (int i = 0; i < n; ++i) {
+            out[done + i] = mix[i] / oscSystem->numOscillators; // Normalize to avoid clipping
+        }
+    }
+}
+
+void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    float* pOutputF32 = (float*)pOutput;
+    OscillatorSystem* oscSystem = (OscillatorSystem*)pDevice->pUserData;
+    float mono[BLOCK];
+
+    for (ma_uint32 done = 0; done < frameCount; done += BLOCK) {
+        int n = frameCount - done < BLOCK ? frameCount - done : BLOCK;
+        render_kernels(oscSystem, mono, n);
+        for (int i = 0; i < n; ++i) {
+            *pOutputF32++ = mono[i];
+            *pOutputF32++ = mono[i];
+        }
+    }
+
+    (void)pInput;
+}
+
+float* load_sample(const char* filename, size_t* outSampleFrames, float* outSampleRate) {
+    // Here you need to load the sample file and get its sample rate and sample frames.
+    // For simplicity, we'll assume the sample is in raw float format with a known sample rate.
+    // Replace this with actual code to load your sample correctly.
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("Failed to open sample file.\n");
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size_t fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    float* sampleData = (float*)malloc(fileSize);
+    if (!sampleData) {
+        printf("Failed to allocate memory for sample data.\n");
+        fclose(file);
+        return NULL;
+    }
+
+    size_t framesRead = fread(sampleData, sizeof(float), fileSize / sizeof(float), file);
+    fclose(file);
+
+    *outSampleFrames = framesRead;
+    *outSampleRate = 44100.0f; // Set this to the actual sample rate of your sample file
+
+    return sampleData;
+}
+
+// -----------------------------------------------------------
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float frand(float lo, float hi) {
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+typedef enum { MIX_PLAIN, MIX_ENVELOPES, MIX_MIXED, MIX_FULL, MIXES } BenchMix;
+
+// LFOS LFOs then voices, everything else picked at random for the mix
+static void bench_system(OscillatorSystem *oscSystem, BenchMix mix, float *sampleData, size_t sampleFrames) {
+    enum { LFOS = 4 };
+    memset(oscSystem, 0, sizeof *oscSystem);
+    oscSystem->numOscillators = MAX_OSCILLATORS;
+    for (int j = 0; j < MAX_OSCILLATORS; ++j) {
+        Oscillator *osc = &oscSystem->oscillators[j];
+        int lfo = j < LFOS;
+        *osc = (Oscillator){
+            .amplitude = 0.5f,
+            .baseFrequency = lfo ? frand(0.2f, 7) : frand(55, 880),
+            .sampleRate = SAMPLE_RATE,
+            .ampAttack = frand(0.01f, 0.5f),
+            .ampDecay = frand(0.1f, 1),
+            .ampSustain = frand(0.3f, 1),
+            .ampRelease = frand(0.5f, 3),
+            .freqAttack = frand(0.01f, 0.2f),
+            .freqDecay = frand(0.1f, 0.5f),
+            .freqSustain = 1,
+            .freqRelease = frand(1, 4),
+            .waveformType = rand() % 6,
+            .noteOn = 1,
+            .sampleData = sampleData,
+            .sampleFrames = sampleFrames,
+            .sampleOriginalSampleRate = SAMPLE_RATE,
+            .pulseWidth = frand(0.1f, 0.9f),
+            .ampLfoIndex = -1,
+            .freqLfoIndex = -1,
+            .pwmLfoIndex = -1,
+            .isLFO = lfo
+        };
+        if (lfo) continue;
+        switch (mix) {
+            case MIX_PLAIN:
+                osc->waveformType = rand() % 4;
+                break;
+            case MIX_ENVELOPES:
+                osc->enableAmpEnvelope = osc->enableFreqEnvelope = 1;
+                break;
+            case MIX_MIXED:
+                osc->enableAmpEnvelope = rand() & 1;
+                osc->enableFreqEnvelope = rand() & 1;
+                osc->enablePWM = rand() & 1;
+                osc->ampLfoIndex = rand() % (LFOS + 1) - 1;
+                osc->freqLfoIndex = rand() % (LFOS + 1) - 1;
+                osc->pwmLfoIndex = rand() % (LFOS + 1) - 1;
+                break;
+            default:
+                osc->enableAmpEnvelope = osc->enableFreqEnvelope = osc->enablePWM = 1;
+                osc->ampLfoIndex = rand() % LFOS;
+                osc->freqLfoIndex = rand() % LFOS;
+                osc->pwmLfoIndex = rand() % LFOS;
+                break;
+        }
+    }
+    configure_system(oscSystem);
+}
+
+// half the voices let go a second in
+static void bench_release(OscillatorSystem *oscSystem) {
+    for (int j = 0; j < oscSystem->numOscillators; j += 2) {
+        Oscillator *osc = &oscSystem->oscillators[j];
+        if (osc->isLFO) continue;
+        osc->noteOn = 0;
+        osc->noteOff = 1;
+        osc->releaseStartTime = osc->time;
+    }
+}
+
+typedef void (*RenderFn)(OscillatorSystem *oscSystem, float *out, int frames);
+
+static double bench_run(OscillatorSystem *oscSystem, RenderFn render, float *out, int frames) {
+    double t0 = now_seconds();
+    for (int done = 0; done < frames; done += 512) {
+        if (done == SAMPLE_RATE / 512 * 512) bench_release(oscSystem);
+        int n = frames - done < 512 ? frames - done : 512;
+        render(oscSystem, out + done, n);
+    }
+    return now_seconds() - t0;
+}
+
+int bench(void) {
+    static const char *names[] = {"plain", "envelopes", "mixed", "full"};
+    static OscillatorSystem a, b;
+    int frames = 5 * SAMPLE_RATE;
+    size_t sampleFrames = SAMPLE_RATE;
+    float *sampleData = malloc(sampleFrames * sizeof(float));
+    float *outA = malloc(frames * sizeof(float)), *outB = malloc(frames * sizeof(float));
+    for (size_t i = 0; i < sampleFrames; ++i) sampleData[i] = sinf(i * 0.05f) * expf(-(float)i / sampleFrames);
+    srand(17);
+    printf("%-10s %8s %14s %14s %8s %8s\n", "mix", "voices", "switch ns/fr", "kernel ns/fr", "speedup", "same");
+    for (int m = 0; m < MIXES; ++m) {
+        bench_system(&a, m, sampleData, sampleFrames);
+        b = a;
+        double ts = bench_run(&a, render_switch, outA, frames);
+        double tk = bench_run(&b, render_kernels, outB, frames);
+        int voices = 0, same = 1;
+        for (int j = 0; j < a.numOscillators; ++j) voices += !a.oscillators[j].isLFO;
+        for (int i = 0; i < frames; ++i) same &= outA[i] == outB[i];
+        double ns = 1e9 / ((double)frames * voices);
+        printf("%-10s %8d %14.2f %14.2f %7.2fx %8s\n", names[m], voices, ts * ns, tk * ns, ts / tk, same ? "yes" : "NO");
+    }
+    free(sampleData);
+    free(outA);
+    free(outB);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "-bench") == 0) return bench();
+
+    ma_result result;
+    ma_device_config deviceConfig;
+    ma_device device;
+
+    static OscillatorSystem oscSystem;
+    oscSystem.numOscillators = 2; // You can set this to any value up to MAX_OSCILLATORS
+
+    // Load a sample file (replace "sample.raw" with your actual sample file)
+    size_t sampleFrames;
+    float sampleRate;
+    float* sampleData = load_sample("sample.raw", &sampleFrames, &sampleRate);
+    if (!sampleData) {
+        return -1;
+    }
+
+    // this is the LFO in the example
+    oscSystem.oscillators[0] = (Oscillator){
+        .amplitude = 1.5f,
+        .baseFrequency = .5,
+        .sampleRate = SAMPLE_RATE,
+        .waveformType = WAVEFORM_SQUARE,
+        .noteOn = 1,
+        .pulseWidth = 0.5,
+        .ampLfoIndex = -1,
+        .freqLfoIndex = -1,
+        .pwmLfoIndex = -1,
+        .isLFO = 1
+    };
+
+    // this is the audible OSC
+    oscSystem.oscillators[1] = (Oscillator){
+        .amplitude = 0.25f,
+        .baseFrequency = 440,
+        .sampleRate = SAMPLE_RATE,
+        .phase = 0,
+        .ampAttack = 1,
+        .ampDecay = 2,
+        .ampSustain = 1,
+        .ampRelease = 3,
+        .freqAttack = 2,
+        .freqDecay = 1,
+        .freqSustain = 2,
+        .freqRelease = 1,
+        .waveformType = WAVEFORM_SQUARE,
+        .noteOn = 0, // Set to 0 initially to start generating only when set to 1
+        .noteOff = 0,
+        .sampleData = sampleData,
+        .sampleFrames = sampleFrames,
+        .sampleOriginalSampleRate = sampleRate, // Store the original sample rate of the sample
+        .enableAmpEnvelope = 0,
+        .enableFreqEnvelope = 1,
+        .enablePWM = 1,
+        .pulseWidth = 0.5,
+        .ampLfoIndex = 0, // the LFO above, though only with the amplitude envelope on
+        .freqLfoIndex = 0,
+        .pwmLfoIndex = -1,
+        .isLFO = 0
+    };
+    configure_system(&oscSystem);
+
+    deviceConfig = ma_device_config_init(ma_device_type_playback);
+    deviceConfig.playback.format   = ma_format_f32;
+    deviceConfig.playback.channels = 2;
+    deviceConfig.sampleRate        = SAMPLE_RATE;
+    deviceConfig.dataCallback      = data_callback;
+    deviceConfig.pUserData         = &oscSystem;
+
+    result = ma_device_init(NULL, &deviceConfig, &device);
+    if (result != MA_SUCCESS) {
+        printf("Failed to initialize playback device.\n");
+        return -1;
+    }
+
+    result = ma_device_start(&device);
+    if (result != MA_SUCCESS) {
+        printf("Failed to start playback device.\n");
+        ma_device_uninit(&device);
+        return -1;
+    }
+
+    puts("?"); getchar();
+    // Example of turning on a note after initialization
+    oscSystem.oscillators[1].noteOff = 0;
+    oscSystem.oscillators[1].noteOn = 1;
+    puts("?"); getchar();
+
+    // Example of turning off a note after some time (simulate this with a delay in real applications)
+    oscSystem.oscillators[1].noteOn = 0;
+    oscSystem.oscillators[1].noteOff = 1;
+    oscSystem.oscillators[1].releaseStartTime = oscSystem.oscillators[1].time;
+
+    puts("?"); getchar();
+
+    ma_device_uninit(&device);
+    free(sampleData);
+
+    return 0;
+}
@@ -0,0 +1,705 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#define MINIAUDIO_IMPLEMENTATION
+#include "miniaudio.h"
+
+// sid3.c with register writes that land on the sample they were meant
+// for. writes carry the SID clock cycle they happen at and go through a
+// lock-free queue; sid_render splits each block at the writes that fall
+// inside it and runs the voices a segment at a time, so the output is
+// the same however the blocks are cut. "./sid4 -offline" renders a tune
+// with no device at several block sizes, checks they all match and
+// prints how many times realtime that runs.
+//
+// the chip doesn't need the device, so it also plays register dumps
+// straight to WAV files, one dump per core at a time:
+//
+//   ./sid4 -write tune.dump          the built in tune as a dump
+//   ./sid4 -render [-j n] *.dump     each one to a .wav next to it
+//
+// a dump is text, a write a line: PAL frame (50 a second), register,
+// value and optionally the cycle within the frame, all in decimal or
+// 0x hex. # starts a comment.
+
+#define SAMPLE_RATE 44100
+#define PI 3.14159265358979323846
+#define MAX_VOICES 3
+#define SID_CLOCK 985248.0 // PAL
+#define SID_FRAME 19705 // cycles between two PAL vblanks, where players write
+#define SID_QUEUE 4096 // writes, a power of two
+#define SID_SEGMENT 256 // frames rendered in one go at most
+
+typedef enum {
+    ATTACK,
+    DECAY, // and sustain, the level heads for the sustain level and stays there
+    RELEASE
+} ADSRState;
+
+typedef struct {
+    uint32_t phase; // the 24 bit accumulator in the top of 32 bits
+    uint32_t inc; // per output frame
+    uint32_t lastPhase; // at the frame before, for the noise clock
+    uint32_t noise; // 23 bit LFSR
+    uint16_t pulseWidth; // 12 bits
+    uint8_t control; // noise pulse saw tri test ring sync gate
+    ADSRState state;
+    float level;
+    float attackStep; // per frame
+    float decayCoef; // level moves this much closer to where it's going each frame
+    float sustainLevel;
+    float releaseCoef;
+} SIDVoice;
+
+typedef struct {
+    SIDVoice voices[MAX_VOICES];
+    uint8_t registers[32];
+    float low, band; // filter state
+    float filterF, filterQ;
+    float volume;
+    uint64_t frame; // rendered so far
+    atomic_uint_fast64_t played; // frame, for the thread that queues writes
+} SIDChip;
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t reg;
+    uint8_t value;
+} SIDWrite;
+
+// one producer, one consumer (sid_render)
+typedef struct {
+    SIDWrite writes[SID_QUEUE];
+    atomic_uint head; // only the producer writes this
+    atomic_uint tail; // only the consumer writes this
+} SIDQueue;
+
+int sid_queue_push(SIDQueue* q, uint64_t cycle, uint8_t reg, uint8_t value) {
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - tail == SID_QUEUE) return 0;
+    SIDWrite* w = &q->writes[head & (SID_QUEUE - 1)];
+    w->cycle = cycle;
+    w->reg = reg;
+    w->value = value;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return 1;
+}
+
+SIDWrite* sid_queue_peek(SIDQueue* q) {
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+    return tail == head ? NULL : &q->writes[tail & (SID_QUEUE - 1)];
+}
+
+void sid_queue_pop(SIDQueue* q) {
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+// the frame a cycle falls in
+uint64_t sid_cycle_frame(uint64_t cycle) {
+    return cycle * SAMPLE_RATE / (uint64_t)SID_CLOCK;
+}
+
+// attack in ms from the 6581 data sheet, decay and release take three times as long
+static const float attackMs[16] = {
+    2, 8, 16, 24, 38, 56, 68, 80, 100, 250, 500, 800, 1000, 3000, 5000, 8000
+};
+
+// down to -60 dB in ms
+float fall_coef(float ms) {
+    return expf(logf(0.001f) / (ms * 0.001f * SAMPLE_RATE));
+}
+
+void init_sid_chip(SIDChip* sid) {
+    memset(sid, 0, sizeof *sid);
+    for (int v = 0; v < MAX_VOICES; v++) {
+        SIDVoice* voice = &sid->voices[v];
+        voice->noise = 0x7ffff8;
+        voice->state = RELEASE;
+        voice->attackStep = 1.0f / (attackMs[0] * 0.001f * SAMPLE_RATE);
+        voice->decayCoef = voice->releaseCoef = fall_coef(3 * attackMs[0]);
+    }
+    sid->filterF = 1;
+    sid->filterQ = 1.4f;
+}
+
+// one register, decoded into just what it changes. sid3.c decoded every
+// register of every voice on each call.
+void apply_register(SIDChip* sid, uint8_t reg, uint8_t value) {
+    if (reg >= 0x19) return; // the read only ones
+    uint8_t old = sid->registers[reg];
+    sid->registers[reg] = value;
+    if (reg < 0x15) {
+        SIDVoice* voice = &sid->voices[reg / 7];
+        const uint8_t* r = &sid->registers[reg / 7 * 7];
+        switch (reg % 7) {
+            case 0:
+            case 1: {
+                // Fout = Fn * clock / 2^24, in 32 bit phase per output frame
+                uint16_t freq = r[0] | (r[1] << 8);
+                voice->inc = (uint32_t)(freq * (SID_CLOCK / SAMPLE_RATE) * 256.0);
+                break;
+            }
+            case 2:
+            case 3:
+                voice->pulseWidth = r[2] | ((r[3] & 0x0F) << 8);
+                break;
+            case 4:
+                voice->control = value;
+                if ((value & 0x01) && !(old & 0x01)) voice->state = ATTACK;
+                if (!(value & 0x01) && (old & 0x01)) voice->state = RELEASE;
+                if (value & 0x08) {
+                    voice->phase = 0;
+                    voice->noise = 0x7ffff8;
+                }
+                break;
+            case 5:
+                voice->attackStep = 1.0f / (attackMs[value >> 4] * 0.001f * SAMPLE_RATE);
+                voice->decayCoef = fall_coef(3 * attackMs[value & 0x0F]);
+                break;
+            case 6:
+                voice->sustainLevel = (value >> 4) / 15.0f;
+                voice->releaseCoef = fall_coef(3 * attackMs[value & 0x0F]);
+                break;
+        }
+        return;
+    }
+    // the 11 bit cutoff goes from about 30 Hz to 12 kHz
+    int cutoff = (sid->registers[0x15] & 0x07) | (sid->registers[0x16] << 3);
+    float hz = 30.0f + cutoff * 5.8f;
+    sid->filterF = 2.0f * sinf(PI * hz / SAMPLE_RATE);
+    sid->filterQ = 1.4f - (sid->registers[0x17] >> 4) * (1.3f / 15.0f);
+    sid->volume = (sid->registers[0x18] & 0x0F) / 15.0f;
+}
+
+// the envelope for n frames, one tight loop for each stage it goes through
+void run_envelope(SIDVoice* voice, float* env, int n) {
+    float level = voice->level;
+    int i = 0;
+    if (voice->state == ATTACK) {
+        float step = voice->attackStep;
+        for (; i < n; i++) {
+            level += step;
+            if (level >= 1.0f) {
+                level = 1.0f;
+                env[i++] = level;
+                voice->state = DECAY;
+                break;
+            }
+            env[i] = level;
+        }
+    }
+    if (voice->state == DECAY) {
+        float target = voice->sustainLevel, k = voice->decayCoef;
+        for (; i < n; i++) {
+            level = target + (level - target) * k;
+            env[i] = level;
+        }
+    } else if (voice->state == RELEASE) {
+        float k = voice->releaseCoef;
+        for (; i < n; i++) {
+            level *= k;
+            level = level < 1e-6f ? 0.0f : level;
+            env[i] = level;
+        }
+    }
+    voice->level = level;
+}
+
+// where each voice is in its cycle for n frames. hard sync needs the
+// three voices a frame at a time, without it each one is a plain ramp.
+void run_phases(SIDChip* sid, uint32_t phase[MAX_VOICES][SID_SEGMENT], int n) {
+    SIDVoice* v = sid->voices;
+    int sync = (v[0].control | v[1].control | v[2].control) & 0x02;
+    if (!sync) {
+        for (int k = 0; k < MAX_VOICES; k++) {
+            uint32_t p = v[k].phase, inc = v[k].control & 0x08 ? 0 : v[k].inc;
+            for (int i = 0; i < n; i++) {
+                phase[k][i] = p;
+                p += inc;
+            }
+            v[k].phase = p;
+        }
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        uint32_t before[MAX_VOICES];
+        for (int k = 0; k < MAX_VOICES; k++) {
+            before[k] = v[k].phase;
+            phase[k][i] = v[k].phase;
+            if (!(v[k].control & 0x08)) v[k].phase += v[k].inc;
+        }
+        // a voice restarts when the one before it (voice 3 for voice 1) crosses its msb
+        for (int k = 0; k < MAX_VOICES; k++) {
+            int from = (k + MAX_VOICES - 1) % MAX_VOICES;
+            if ((v[k].control & 0x02) && !(before[from] & 0x80000000u) && (v[from].phase & 0x80000000u)) {
+                v[k].phase = 0;
+            }
+        }
+    }
+}
+
+// one voice's 12 bit waveform, the selected ones ANDed like the chip
+// does, times its envelope, added to out
+void run_wave(SIDVoice* voice, const uint32_t* phase, const uint32_t* ringPhase, const float* env, float* out, int n) {
+    uint8_t c = voice->control;
+    uint32_t last = voice->lastPhase;
+    voice->lastPhase = phase[n - 1];
+    if (!(c & 0xF0)) return;
+    uint32_t pw = voice->pulseWidth;
+    uint32_t noise = voice->noise;
+    for (int i = 0; i < n; i++) {
+        uint32_t p = phase[i];
+        uint32_t w = 0xFFF;
+        if (c & 0x10) {
+            uint32_t msb = p >> 31;
+            if (c & 0x04) msb ^= ringPhase[i] >> 31;
+            uint32_t x = p << 1;
+            w &= ((msb ? ~x : x) >> 20) & 0xFFF;
+        }
+        if (c & 0x20) w &= p >> 20;
+        if (c & 0x40) w &= (p >> 20) >= pw || (c & 0x08) ? 0xFFF : 0;
+        if (c & 0x80) {
+            // clocked when bit 19 of the accumulator goes high
+            if ((p & ~last) & (1u << 27)) {
+                uint32_t bit = ((noise >> 22) ^ (noise >> 17)) & 1;
+                noise = ((noise << 1) | bit) & 0x7FFFFF;
+            }
+            uint32_t x = ((noise >> 22) & 1) << 11 | ((noise >> 20) & 1) << 10 | ((noise >> 16) & 1) << 9 |
+                ((noise >> 13) & 1) << 8 | ((noise >> 11) & 1) << 7 | ((noise >> 7) & 1) << 6 |
+                ((noise >> 4) & 1) << 5 | ((noise >> 2) & 1) << 4;
+            w &= x;
+        }
+        last = p;
+        out[i] += (w * (1.0f / 2048.0f) - 1.0f) * env[i];
+    }
+    voice->noise = noise;
+}
+
+// n frames with no register writes in them
+void render_segment(SIDChip* sid, float* out, int n) {
+    uint32_t phase[MAX_VOICES][SID_SEGMENT];
+    float env[SID_SEGMENT];
+    float direct[SID_SEGMENT], filtered[SID_SEGMENT];
+    memset(direct, 0, n * sizeof(float));
+    memset(filtered, 0, n * sizeof(float));
+    run_phases(sid, phase, n);
+    uint8_t routing = sid->registers[0x17], mode = sid->registers[0x18];
+    for (int k = 0; k < MAX_VOICES; k++) {
+        run_envelope(&sid->voices[k], env, n);
+        int viaFilter = routing & (1 << k);
+        if (k == 2 && (mode & 0x80) && !viaFilter) {
+            sid->voices[k].lastPhase = phase[k][n - 1]; // voice 3 off
+            continue;
+        }
+        run_wave(&sid->voices[k], phase[k], phase[(k + MAX_VOICES - 1) % MAX_VOICES], env,
+            viaFilter ? filtered : direct, n);
+    }
+    // a state variable filter, low, band and high pass picked by the mode bits
+    float low = sid->low, band = sid->band, f = sid->filterF, q = sid->filterQ;
+    float lp = mode & 0x10 ? 1.0f : 0.0f, bp = mode & 0x20 ? 1.0f : 0.0f, hp = mode & 0x40 ? 1.0f : 0.0f;
+    float gain = sid->volume * (1.0f / MAX_VOICES);
+    for (int i = 0; i < n; i++) {
+        low += f * band;
+        float high = filtered[i] - low - q * band;
+        band += f * high;
+        out[i] = (direct[i] + lp * low + bp * band + hp * high) * gain;
+    }
+    sid->low = low;
+    sid->band = band;
+}
+
+// frames more of the chip, with every queued write up to the end of
+// them applied at the frame it belongs to. writes that are late land
+// on the first frame. 0 frames only applies the writes that are due.
+void sid_render(SIDChip* sid, SIDQueue* queue, float* out, int frames) {
+    uint64_t start = sid->frame;
+    int done = 0;
+    for (;;) {
+        int upto = frames;
+        SIDWrite* w = sid_queue_peek(queue);
+        if (w) {
+            uint64_t at = sid_cycle_frame(w->cycle);
+            if (at <= start + done) {
+                apply_register(sid, w->reg, w->value);
+                sid_queue_pop(queue);
+                continue;
+            }
+            if (at < start + frames) upto = at - start;
+        }
+        if (done == frames) break;
+        while (done < upto) {
+            int n = upto - done < SID_SEGMENT ? upto - done : SID_SEGMENT;
+            render_segment(sid, out + done, n);
+            done += n;
+        }
+    }
+    sid->frame = start + frames;
+    atomic_store_explicit(&sid->played, sid->frame, memory_order_relaxed);
+}
+
+// -----------------------------------------------------------
+
+// a tune, as the writes a player routine would make once a frame, with
+// a few in the middle of frames to show they land where they should
+
+typedef struct {
+    SIDWrite* writes;
+    int count, size;
+} SIDTune;
+
+void tune_add(SIDTune* t, uint64_t cycle, uint8_t reg, uint8_t value) {
+    if (t->count == t->size) {
+        t->size = t->size ? t->size * 2 : 1024;
+        t->writes = realloc(t->writes, t->size * sizeof(SIDWrite));
+    }
+    t->writes[t->count++] = (SIDWrite){cycle, reg, value};
+}
+
+uint16_t note_freq(int note) {
+    // midi note to the frequency register
+    double hz = 440.0 * pow(2.0, (note - 69) / 12.0);
+    return (uint16_t)(hz * 16777216.0 / SID_CLOCK);
+}
+
+void make_tune(SIDTune* t, int seconds) {
+    static const int chord[4][3] = {{57, 60, 64}, {53, 57, 60}, {48, 52, 55}, {55, 59, 62}};
+    uint64_t c = 0;
+    tune_add(t, c, 0x18, 0x1F); // low pass, full volume
+    tune_add(t, c, 0x17, 0xA1); // voice 1 through the filter, some resonance
+    tune_add(t, c, 0x05, 0x09);
+    tune_add(t, c, 0x06, 0x84);
+    tune_add(t, c, 0x0C, 0x28);
+    tune_add(t, c, 0x0D, 0x89);
+    tune_add(t, c, 0x13, 0x00);
+    tune_add(t, c, 0x14, 0x08);
+    int frames = seconds * 50;
+    for (int f = 0; f < frames; f++) {
+        c = (uint64_t)f * SID_FRAME;
+        const int* ch = chord[(f / 96) % 4];
+        // voice 1, a pulse arpeggio with the width and cutoff sweeping
+        uint16_t n = note_freq(ch[f % 3] + 12);
+        tune_add(t, c, 0x00, n & 0xFF);
+        tune_add(t, c, 0x01, n >> 8);
+        int pw = 0x400 + (int)(0x300 * sin(f * 0.05));
+        tune_add(t, c, 0x02, pw & 0xFF);
+        tune_add(t, c, 0x03, pw >> 8);
+        if (f % 12 == 0) tune_add(t, c, 0x04, 0x41);
+        if (f % 12 == 8) tune_add(t, c, 0x04, 0x40);
+        int cutoff = 600 + (int)(500 * sin(f * 0.013));
+        tune_add(t, c, 0x15, cutoff & 0x07);
+        tune_add(t, c, 0x16, cutoff >> 3);
+        // voice 2, a saw bass on the beat
+        if (f % 24 == 0) {
+            n = note_freq(ch[0] - 24);
+            tune_add(t, c, 0x07, n & 0xFF);
+            tune_add(t, c, 0x08, n >> 8);
+            tune_add(t, c, 0x0B, 0x21);
+        }
+        if (f % 24 == 18) tune_add(t, c, 0x0B, 0x20);
+        // voice 3, a noise hat off the beat, gated a third of the way into the frame
+        if (f % 12 == 6) {
+            tune_add(t, c + SID_FRAME / 3, 0x0E, 0x00);
+            tune_add(t, c + SID_FRAME / 3, 0x0F, 0xC0);
+            tune_add(t, c + SID_FRAME / 3, 0x12, 0x81);
+        }
+        if (f % 12 == 7) tune_add(t, c + SID_FRAME / 3, 0x12, 0x80);
+    }
+}
+
+// -----------------------------------------------------------
+
+SIDChip sid;
+SIDQueue queue;
+
+void data_callback(ma_device* device, void* output, const void* input, ma_uint32 frameCount) {
+    sid_render(&sid, &queue, (float*)output, frameCount);
+}
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the whole tune on a chip of its own with no device, blocks of frames at a time
+float* render_offline(SIDTune* t, int frames, int block, double* seconds) {
+    float* out = malloc(frames * sizeof(float));
+    SIDChip* chip = malloc(sizeof(SIDChip));
+    SIDQueue* q = calloc(1, sizeof(SIDQueue));
+    if (!out || !chip || !q) {
+        free(out);
+        free(chip);
+        free(q);
+        return NULL;
+    }
+    init_sid_chip(chip);
+    int next = 0;
+    double t0 = now_seconds();
+    for (int done = 0; done < frames; ) {
+        int n = frames - done < block ? frames - done : block;
+        while (next < t->count && sid_queue_push(q, t->writes[next].cycle,
+            t->writes[next].reg, t->writes[next].value)) next++;
+        // the queue filled before the block's last write: only go as far
+        // as the first one left out, and push the rest once there is room
+        if (next < t->count) {
+            uint64_t at = sid_cycle_frame(t->writes[next].cycle);
+            if (at < chip->frame + n) n = at > chip->frame ? at - chip->frame : 0;
+        }
+        sid_render(chip, q, out + done, n);
+        done += n;
+    }
+    *seconds = now_seconds() - t0;
+    free(chip);
+    free(q);
+    return out;
+}
+
+int offline(int seconds) {
+    SIDTune t = {0};
+    make_tune(&t, seconds);
+    int frames = seconds * SAMPLE_RATE;
+    static const int blocks[] = {64, 441, 1024, 4096};
+    float* want = NULL;
+    int same = 1;
+    for (int b = 0; b < 4; b++) {
+        double took;
+        float* got = render_offline(&t, frames, blocks[b], &took);
+        if (!got) {
+            fprintf(stderr, "no memory for %d frames\n", frames);
+            same = 0;
+            break;
+        }
+        int match = !want || memcmp(want, got, frames * sizeof(float)) == 0;
+        same &= match;
+        printf("%4d frame blocks: %d writes, %.0fx realtime, %s\n", blocks[b], t.count,
+            seconds / took, want ? (match ? "same output" : "DIFFERENT output") : "reference");
+        if (want) free(got);
+        else want = got;
+    }
+    free(want);
+    free(t.writes);
+    return same ? 0 : 1;
+}
+
+// -----------------------------------------------------------
+
+// register dumps to WAV files
+
+int tune_write(SIDTune* t, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "# frame reg value cycle\n");
+    for (int i = 0; i < t->count; i++) {
+        const SIDWrite* w = &t->writes[i];
+        fprintf(f, "%llu 0x%02x 0x%02x %llu\n", (unsigned long long)(w->cycle / SID_FRAME), w->reg, w->value,
+            (unsigned long long)(w->cycle % SID_FRAME));
+    }
+    return fclose(f);
+}
+
+int tune_load(SIDTune* t, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[256];
+    int number = 0;
+    while (fgets(line, sizeof line, f)) {
+        number++;
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) continue;
+        // frame, reg and value have to be there, the cycle may not be, and
+        // nothing but space after
+        char *end, *start = p;
+        int bad = 0;
+        unsigned long long frame = strtoull(start, &end, 0);
+        bad |= end == start;
+        long reg = strtol(start = end, &end, 0);
+        bad |= end == start;
+        long value = strtol(start = end, &end, 0);
+        bad |= end == start;
+        long cycle = strtol(end, &end, 0);
+        while (isspace((unsigned char)*end)) end++;
+        bad |= *end != 0;
+        if (bad || reg < 0 || reg > 0x1F || value < 0 || value > 0xFF || cycle < 0 || cycle >= SID_FRAME) {
+            fprintf(stderr, "%s:%d: bad write\n", path, number);
+            continue;
+        }
+        tune_add(t, frame * SID_FRAME + cycle, reg, value);
+    }
+    fclose(f);
+    // the queue wants them in order, a dump may not quite be. writes on
+    // the same cycle keep their order.
+    for (int i = 1; i < t->count; i++) {
+        SIDWrite w = t->writes[i];
+        int j = i;
+        for (; j > 0 && t->writes[j - 1].cycle > w.cycle; j--) t->writes[j] = t->writes[j - 1];
+        t->writes[j] = w;
+    }
+    return 0;
+}
+
+int write_wav(const char* path, const float* pcm, int frames) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return -1;
+    uint32_t bytes = frames * 2;
+    uint8_t h[44] = "RIFF....WAVEfmt ";
+    uint32_t fields[] = {36 + bytes, 16, 1 | (1 << 16), SAMPLE_RATE, SAMPLE_RATE * 2, 2 | (16 << 16)};
+    memcpy(h + 4, &fields[0], 4);
+    memcpy(h + 16, &fields[1], 20);
+    memcpy(h + 36, "data", 4);
+    memcpy(h + 40, &bytes, 4);
+    fwrite(h, 1, 44, f);
+    int16_t block[4096];
+    for (int i = 0; i < frames; i += 4096) {
+        int n = frames - i < 4096 ? frames - i : 4096;
+        for (int j = 0; j < n; j++) {
+            float x = pcm[i + j] * 32767.0f;
+            block[j] = x > 32767.0f ? 32767 : x < -32768.0f ? -32768 : (int16_t)lrintf(x);
+        }
+        fwrite(block, 2, n, f);
+    }
+    return fclose(f);
+}
+
+typedef struct {
+    char** paths;
+    int count;
+    atomic_int next; // the next dump for any worker
+    atomic_int failed;
+    atomic_uint_fast64_t frames; // rendered by everyone
+} RenderJobs;
+
+void* render_worker(void* arg) {
+    RenderJobs* jobs = arg;
+    int i;
+    while ((i = atomic_fetch_add(&jobs->next, 1)) < jobs->count) {
+        const char* path = jobs->paths[i];
+        SIDTune t = {0};
+        if (tune_load(&t, path) != 0 || t.count == 0) {
+            fprintf(stderr, "%s: can't read it\n", path);
+            atomic_fetch_add(&jobs->failed, 1);
+            free(t.writes);
+            continue;
+        }
+        // two seconds after the last write for the releases
+        uint64_t last = sid_cycle_frame(t.writes[t.count - 1].cycle) + 2 * SAMPLE_RATE;
+        int frames = last > INT32_MAX / sizeof(float) ? 0 : (int)last;
+        double took;
+        float* pcm = frames ? render_offline(&t, frames, 4096, &took) : NULL;
+        if (!pcm) {
+            fprintf(stderr, "%s: can't render %llu frames\n", path, (unsigned long long)last);
+            atomic_fetch_add(&jobs->failed, 1);
+            free(t.writes);
+            continue;
+        }
+        char out[4096];
+        snprintf(out, sizeof out, "%s", path);
+        char* dot = strrchr(out, '.');
+        if (dot && !strchr(dot, '/')) *dot = 0;
+        strncat(out, ".wav", sizeof out - strlen(out) - 1);
+        if (write_wav(out, pcm, frames) != 0) {
+            fprintf(stderr, "%s: can't write it\n", out);
+            atomic_fetch_add(&jobs->failed, 1);
+        } else {
+            printf("%s: %.1f s, %d writes, %.0fx realtime\n", out, (double)frames / SAMPLE_RATE, t.count,
+                frames / (took * SAMPLE_RATE));
+        }
+        atomic_fetch_add(&jobs->frames, frames);
+        free(pcm);
+        free(t.writes);
+    }
+    return NULL;
+}
+
+int render_dumps(int argc, char* argv[]) {
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 1 && strcmp(argv[0], "-j") == 0) {
+        workers = atoi(argv[1]);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 1) {
+        printf("usage: sid4 -render [-j workers] file.dump ...\n");
+        return 1;
+    }
+    RenderJobs jobs = {.paths = argv, .count = argc};
+    if (workers > argc) workers = argc;
+    if (workers < 1) workers = 1;
+    pthread_t threads[workers];
+    double t0 = now_seconds();
+    int started = 0;
+    for (int w = 0; w < workers; w++) {
+        if (pthread_create(&threads[started], NULL, render_worker, &jobs) == 0) started++;
+    }
+    // no threads at all, this one does the work
+    if (started == 0) render_worker(&jobs);
+    for (int w = 0; w < started; w++) pthread_join(threads[w], NULL);
+    workers = started ? started : 1;
+    double took = now_seconds() - t0;
+    double seconds = (double)atomic_load(&jobs.frames) / SAMPLE_RATE;
+    printf("%d dumps, %.0f s of audio in %.2f s on %d workers, %.0fx realtime\n", argc, seconds, took,
+        workers, seconds / took);
+    return atomic_load(&jobs.failed) ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "-offline") == 0) return offline(60);
+    if (argc > 1 && strcmp(argv[1], "-render") == 0) return render_dumps(argc - 2, argv + 2);
+    if (argc > 2 && strcmp(argv[1], "-write") == 0) {
+        SIDTune t = {0};
+        make_tune(&t, 60);
+        return tune_write(&t, argv[2]) == 0 ? 0 : 1;
+    }
+
+    init_sid_chip(&sid);
+
+    ma_device_config deviceConfig;
+    ma_device device;
+
+    deviceConfig = ma_device_config_init(ma_device_type_playback);
+    deviceConfig.playback.format = ma_format_f32;
+    deviceConfig.playback.channels = 1;
+    deviceConfig.sampleRate = SAMPLE_RATE;
+    deviceConfig.dataCallback = data_callback;
+
+    if (ma_device_init(NULL, &deviceConfig, &device) != MA_SUCCESS) {
+        printf("Failed to initialize playback device.\n");
+        return -1;
+    }
+
+    if (ma_device_start(&device) != MA_SUCCESS) {
+        printf("Failed to start playback device.\n");
+        ma_device_uninit(&device);
+        return -1;
+    }
+
+    // queue the tune a little ahead of the device, stamped from where it has got to
+    SIDTune t = {0};
+    make_tune(&t, 20);
+    uint64_t base = atomic_load(&sid.played) * (uint64_t)SID_CLOCK / SAMPLE_RATE + SID_CLOCK / 10;
+    uint64_t ahead = SID_CLOCK / 5;
+    int next = 0;
+    printf("Playing...\n");
+    while (next < t.count) {
+        uint64_t now = atomic_load(&sid.played) * (uint64_t)SID_CLOCK / SAMPLE_RATE;
+        while (next < t.count && base + t.writes[next].cycle < now + ahead &&
+            sid_queue_push(&queue, base + t.writes[next].cycle, t.writes[next].reg, t.writes[next].value)) next++;
+        usleep(10000);
+    }
+    sleep(1);
+    free(t.writes);
+
+    ma_device_uninit(&device);
+
+    return 0;
+}